@@ -0,0 +1,559 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "corpus.h"
+#include "duplicates.h"
+#include "entry.h"
+#include "events.h"
+#include "formatter.h"
+#include "lexer.h"
+#include "names.h"
+#include "normalize.h"
+#include "outputbuffer.h"
+#include "parser.h"
+#include "structural.h"
+#include "stringpool.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Measures the phases of the parser on the synthetic corpora:
+//
+// scan:      Finding the entries with the Lexer
+// split:     Splitting the bodies of the regular entries into fields
+// validate:  Checking the parsed entries for missing and extra fields
+// parse:     Everything that parse() does, which includes the three phases above
+// events:    parseEvents with a handler that only looks at the title and the year, which
+//            is what an embedding program that needs a few fields pays
+// output:    Formatting all entries into a buffer that is written to the null device
+//
+// The throughput is computed from parse and output together, which is what a run of
+// BibTexFormat --format spends on the same file. Every phase is repeated and the fastest
+// run is reported, which is the one least disturbed by the rest of the system. The lexer
+// uses the fastest block classification the processor supports, --scanner picks another
+// one to compare them
+//
+// With --near-duplicates, the search for near-duplicates is measured on the corpus of the
+// same name instead: the time to compute the shingles of all entries, the time to find
+// the groups of similar entries, and how many of the copies that the corpus contains
+// were found
+//
+// With --venues, the realistic corpus is parsed with and without interning the venues
+// into a StringPool. It reports how many bytes the venues take as separate strings and
+// in the pool, how long it takes to compute the ranks of the pool once, and how long it
+// takes to sort all entries by journal using the values and using the ranks
+//
+// With --names, the author and editor lists of the realistic corpus are folded with
+// foldText and decomposed into names with a NameCache, once while the cache is filled and
+// once more when every list is found in it
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+#ifdef _WIN32
+    constexpr const char* NullDevice = "NUL";
+#else // ^^^^ _WIN32 // !_WIN32 vvvv
+    constexpr const char* NullDevice = "/dev/null";
+#endif // _WIN32
+
+    struct Options {
+        std::vector<Corpus> corpora;
+        std::vector<size_t> sizes;
+        uint64_t seed = 1;
+        int repetitions = 3;
+        unsigned int nThreads = 1;
+        bool measuresNearDuplicates = false;
+        bool measuresVenues = false;
+        bool measuresNames = false;
+        double threshold = 0.8;
+    };
+
+    // Runs the function 'repetitions' times and returns the fastest time in seconds
+    template <typename F>
+    double measure(int repetitions, F function) {
+        double best = 0.0;
+        for (int i = 0; i < repetitions; ++i) {
+            const Clock::time_point start = Clock::now();
+            function();
+            const double seconds =
+                std::chrono::duration<double>(Clock::now() - start).count();
+            best = i == 0 ? seconds : std::min(best, seconds);
+        }
+        return best;
+    }
+
+    // Keeps the compiler from removing the computations whose results are not used
+    volatile size_t Sink = 0;
+
+    class TitleAndYear : public ParseHandler {
+    public:
+        bool field(const EntryEvent&, const FieldEvent& field) override {
+            if (field.keyword == Keyword::Title || field.keyword == Keyword::Year) {
+                size += field.value.size();
+            }
+            return true;
+        }
+
+        size_t size = 0;
+    };
+
+    void printRow(std::string_view corpus, size_t nEntries, size_t size,
+                  const double (&phases)[6], double total)
+    {
+        const double megabytes = size / (1024.0 * 1024.0);
+        std::printf("%-13.*s %8zu %8.1f", static_cast<int>(corpus.size()), corpus.data(),
+                    nEntries, megabytes);
+        for (double phase : phases) {
+            std::printf(" %9.2f", phase * 1000.0);
+        }
+        std::printf(" %9.1f %11.0f\n", megabytes / total, nEntries / total);
+    }
+
+    void run(Corpus corpus, size_t nEntries, const Options& options) {
+        const std::string source = generateCorpus(corpus, nEntries, options.seed);
+
+        std::vector<RawEntry> rawEntries;
+        const double scan = measure(options.repetitions, [&]() {
+            rawEntries.clear();
+            Lexer lexer(source);
+            RawEntry raw;
+            while (lexer.next(raw)) {
+                rawEntries.push_back(raw);
+            }
+        });
+
+        const double split = measure(options.repetitions, [&]() {
+            size_t nFields = 0;
+            for (const RawEntry& raw : rawEntries) {
+                if (raw.error != LexError::None || raw.kind != EntryKind::Regular) {
+                    continue;
+                }
+                FieldParser parser(raw.body, raw.kind);
+                RawField field;
+                while (parser.next(field)) {
+                    ++nFields;
+                }
+            }
+            Sink = nFields;
+        });
+
+        std::vector<ParseResult> results;
+        const double parse = measure(options.repetitions, [&]() {
+            ParseOptions parseOptions;
+            if (options.nThreads == 1) {
+                results.clear();
+                results.resize(1);
+                ::parse(source, 0, source.size(), false, parseOptions, results[0]);
+            }
+            else {
+                results = parseParallel(source, options.nThreads, parseOptions);
+            }
+        });
+
+        const double events = measure(options.repetitions, [&]() {
+            TitleAndYear handler;
+            parseEvents(source, handler);
+            Sink = handler.size;
+        });
+
+        // The same checks that parse() runs for every entry
+        const double validate = measure(options.repetitions, [&]() {
+            size_t nProblems = 0;
+            for (const ParseResult& result : results) {
+                for (const Entry& entry : result.entries) {
+                    nProblems += checkCompleteness(entry).size();
+                    const KeywordMask accepted = acceptedKeywordMask(entry.entryType);
+                    nProblems += (entry.keywordMask() & ~accepted) != 0;
+                }
+            }
+            Sink = nProblems;
+        });
+
+        const double output = measure(options.repetitions, [&]() {
+            std::FILE* file = std::fopen(NullDevice, "wb");
+            {
+                OutputBuffer buffer(file);
+                Formatter formatter(buffer);
+                for (const ParseResult& result : results) {
+                    for (const Block& block : result.blocks) {
+                        const bool canFormat = block.entryIndex != Block::NoEntry &&
+                            result.entries[block.entryIndex].entryType != Type::Unknown;
+                        if (canFormat) {
+                            formatter.write(result.entries[block.entryIndex]);
+                        }
+                        else {
+                            formatter.writeVerbatim(block.text);
+                        }
+                    }
+                }
+                buffer.flush();
+            }
+            std::fclose(file);
+        });
+
+        const double phases[] = { scan, split, validate, parse, events, output };
+        printRow(corpusName(corpus), rawEntries.size(), source.size(), phases,
+                 parse + output);
+    }
+
+    void runNearDuplicates(size_t nEntries, const Options& options) {
+        const std::string source =
+            generateCorpus(Corpus::NearDuplicates, nEntries, options.seed);
+        std::vector<ParseResult> results(1);
+        parse(source, 0, source.size(), false, ParseOptions(), results[0]);
+
+        std::vector<std::vector<EntryKeys>> files(1);
+        const double shingles = measure(options.repetitions, [&]() {
+            files[0] = collectKeys(source, results, true);
+        });
+
+        std::vector<NearDuplicateGroup> groups;
+        const double search = measure(options.repetitions, [&]() {
+            groups = findNearDuplicates(files, options.threshold);
+        });
+
+        // The copy of 'key' is 'keyb', which is the only way in which the corpus is
+        // supposed to contain near-duplicates. Entries without a title have no shingles
+        // and can't be found
+        const std::vector<EntryKeys>& keys = files[0];
+        std::unordered_map<std::string, size_t> indices;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            indices.emplace(keys[i].citeKey, i);
+        }
+        size_t nCopies = 0;
+        for (const EntryKeys& copy : keys) {
+            const std::string& key = copy.citeKey;
+            if (copy.shingles.empty() || key.empty() || key.back() != 'b') {
+                continue;
+            }
+            const auto original = indices.find(key.substr(0, key.size() - 1));
+            nCopies += original != indices.end() &&
+                       !keys[original->second].shingles.empty();
+        }
+        // A group is false if it is anything else than an original and its copy
+        size_t nFound = 0;
+        size_t nFalse = 0;
+        for (const NearDuplicateGroup& group : groups) {
+            const std::string& first = keys[group.members[0].entry].citeKey;
+            const std::string& second = keys[group.members[1].entry].citeKey;
+            const bool isCopy = group.members.size() == 2 &&
+                                second.size() == first.size() + 1 &&
+                                second.back() == 'b' &&
+                                second.compare(0, first.size(), first) == 0;
+            nFound += isCopy;
+            nFalse += !isCopy;
+        }
+
+        const double recall = nCopies > 0 ? 100.0 * nFound / nCopies : 100.0;
+        std::printf("%8zu %8.1f %8zu %8zu %8zu %8.1f %11.2f %9.2f %11.0f\n",
+                    keys.size(), source.size() / (1024.0 * 1024.0), nCopies,
+                    groups.size(), nFalse, recall, shingles * 1000.0, search * 1000.0,
+                    keys.size() / (shingles + search));
+    }
+
+    void runVenues(size_t nEntries, const Options& options) {
+        const std::string source =
+            generateCorpus(Corpus::Realistic, nEntries, options.seed);
+
+        std::vector<ParseResult> results;
+        const double plain = measure(options.repetitions, [&]() {
+            results = parseParallel(source, options.nThreads, ParseOptions());
+        });
+
+        std::unique_ptr<StringPool> pool;
+        const double interned = measure(options.repetitions, [&]() {
+            pool = std::make_unique<StringPool>();
+            ParseOptions parseOptions;
+            parseOptions.venues = pool.get();
+            results = parseParallel(source, options.nThreads, parseOptions);
+        });
+
+        // Separate strings pay for their header and for every copy of the characters
+        size_t nParsed = 0;
+        size_t nVenues = 0;
+        size_t stringBytes = 0;
+        std::vector<const Field*> journals;
+        for (const ParseResult& result : results) {
+            nParsed += result.entries.size();
+            for (const Entry& entry : result.entries) {
+                for (const Field& field : entry.fields()) {
+                    if (field.valueId != NoStringId) {
+                        ++nVenues;
+                        stringBytes += sizeof(std::string) + field.value.size();
+                    }
+                }
+                if (const Field* journal = entry.field(Keyword::Journal)) {
+                    journals.push_back(journal);
+                }
+            }
+        }
+        const size_t poolBytes =
+            pool->bytes() + pool->size() * (sizeof(std::string_view) + sizeof(void*));
+
+        std::vector<const Field*> sorted;
+        const double byValue = measure(options.repetitions, [&]() {
+            sorted = journals;
+            std::stable_sort(
+                sorted.begin(),
+                sorted.end(),
+                [](const Field* lhs, const Field* rhs) { return lhs->value < rhs->value; }
+            );
+        });
+        std::vector<uint32_t> ranks;
+        const double ranking = measure(options.repetitions, [&]() {
+            ranks = pool->ranks();
+        });
+        const double byRank = measure(options.repetitions, [&]() {
+            sorted = journals;
+            std::stable_sort(
+                sorted.begin(),
+                sorted.end(),
+                [&ranks](const Field* lhs, const Field* rhs) {
+                    return ranks[lhs->valueId] < ranks[rhs->valueId];
+                }
+            );
+        });
+
+        std::printf("%8zu %8zu %8zu %10.1f %10.1f %9.2f %11.2f %8.2f %9.2f %8.2f\n",
+                    nParsed, nVenues, pool->size(),
+                    stringBytes / 1024.0, poolBytes / 1024.0, plain * 1000.0,
+                    interned * 1000.0, ranking * 1000.0, byValue * 1000.0,
+                    byRank * 1000.0);
+    }
+
+    void runNames(size_t nEntries, const Options& options) {
+        const std::string source =
+            generateCorpus(Corpus::Realistic, nEntries, options.seed);
+        const std::vector<ParseResult> results =
+            parseParallel(source, options.nThreads, ParseOptions());
+
+        std::vector<std::string_view> lists;
+        size_t nParsed = 0;
+        for (const ParseResult& result : results) {
+            nParsed += result.entries.size();
+            for (const Entry& entry : result.entries) {
+                for (Keyword keyword : { Keyword::Author, Keyword::Editor }) {
+                    if (const Field* field = entry.field(keyword)) {
+                        lists.push_back(field->value);
+                    }
+                }
+            }
+        }
+
+        const double fold = measure(options.repetitions, [&]() {
+            size_t size = 0;
+            for (std::string_view list : lists) {
+                size += foldText(list).size();
+            }
+            Sink = size;
+        });
+
+        // Every repetition starts with an empty cache, the lookups reuse the last one
+        std::unique_ptr<NameCache> cache;
+        auto decompose = [&]() {
+            size_t nNames = 0;
+            for (std::string_view list : lists) {
+                nNames += cache->names(list).names.size();
+            }
+            return nNames;
+        };
+        size_t nNames = 0;
+        const double cold = measure(options.repetitions, [&]() {
+            cache = std::make_unique<NameCache>();
+            nNames = decompose();
+        });
+        const double warm = measure(options.repetitions, [&]() { Sink = decompose(); });
+
+        std::printf("%8zu %8zu %8zu %8zu %9.2f %9.2f %9.2f\n", nParsed, lists.size(),
+                    cache->size(), nNames, fold * 1000.0, cold * 1000.0, warm * 1000.0);
+    }
+
+    std::vector<size_t> parseSizes(std::string_view list) {
+        std::vector<size_t> sizes;
+        while (!list.empty()) {
+            const size_t comma = std::min(list.find(','), list.size());
+            sizes.push_back(std::strtoull(std::string(list.substr(0, comma)).c_str(),
+                                          nullptr, 10));
+            list.remove_prefix(std::min(comma + 1, list.size()));
+        }
+        return sizes;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--corpus" && i + 1 < argc) {
+            Corpus corpus;
+            if (!corpusFromName(argv[++i], corpus)) {
+                std::cerr << "Unknown corpus " << argv[i] << '\n';
+                return -1;
+            }
+            options.corpora.push_back(corpus);
+        }
+        else if (arg == "--entries" && i + 1 < argc) {
+            options.sizes = parseSizes(argv[++i]);
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--repetitions" && i + 1 < argc) {
+            options.repetitions = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "-j" && i + 1 < argc) {
+            options.nThreads =
+                static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--scanner" && i + 1 < argc) {
+            // Compares the classification of the blocks against the fastest one
+            const std::string_view name = argv[++i];
+            bool isKnown = false;
+            for (ScanImplementation implementation : { ScanImplementation::Scalar,
+                 ScanImplementation::Sse2, ScanImplementation::Avx2 })
+            {
+                if (scanImplementationName(implementation) == name) {
+                    isKnown = true;
+                    if (!setScanImplementation(implementation)) {
+                        std::cerr << "The processor does not support " << name << '\n';
+                        return -1;
+                    }
+                }
+            }
+            if (!isKnown) {
+                std::cerr << "Unknown scanner " << name << '\n';
+                return -1;
+            }
+        }
+        else if (arg == "--near-duplicates") {
+            options.measuresNearDuplicates = true;
+        }
+        else if (arg == "--venues") {
+            options.measuresVenues = true;
+        }
+        else if (arg == "--names") {
+            options.measuresNames = true;
+        }
+        else if (arg == "--threshold" && i + 1 < argc) {
+            options.threshold = std::strtod(argv[++i], nullptr);
+            if (!(options.threshold > 0.0) || options.threshold > 1.0) {
+                std::cerr << "The threshold has to be in (0, 1]\n";
+                return -1;
+            }
+        }
+        else {
+            std::cerr << "Usage: bibtex_bench [--corpus name]... [--entries n,...] ";
+            std::cerr << "[--seed n] [--repetitions n] [-j threads] ";
+            std::cerr << "[--scanner scalar|sse2|avx2]\n";
+            std::cerr << "       bibtex_bench --near-duplicates [--threshold t] ";
+            std::cerr << "[--entries n,...] [--seed n] [--repetitions n]\n";
+            std::cerr << "       bibtex_bench --venues [--entries n,...] [--seed n] ";
+            std::cerr << "[--repetitions n] [-j threads]\n";
+            std::cerr << "       bibtex_bench --names [--entries n,...] [--seed n] ";
+            std::cerr << "[--repetitions n]\n";
+            std::cerr << "Corpora:";
+            for (Corpus corpus : Corpora) {
+                std::cerr << ' ' << corpusName(corpus);
+            }
+            std::cerr << '\n';
+            return -1;
+        }
+    }
+    if (options.measuresNearDuplicates) {
+        if (options.sizes.empty()) {
+            options.sizes = { 100000 };
+        }
+        std::printf("%8s %8s %8s %8s %8s %8s %11s %9s %11s\n", "entries", "MB",
+                    "copies", "groups", "false", "recall %", "shingles ms", "search ms",
+                    "entries/s");
+        for (size_t nEntries : options.sizes) {
+            runNearDuplicates(nEntries, options);
+        }
+        return 0;
+    }
+
+    if (options.measuresVenues) {
+        if (options.sizes.empty()) {
+            options.sizes = { 100000 };
+        }
+        std::printf("%8s %8s %8s %10s %10s %9s %11s %8s %9s %8s\n", "entries",
+                    "venues", "distinct", "string KB", "pooled KB", "parse ms",
+                    "interned ms", "ranks ms", "value ms", "rank ms");
+        for (size_t nEntries : options.sizes) {
+            runVenues(nEntries, options);
+        }
+        return 0;
+    }
+
+    if (options.measuresNames) {
+        if (options.sizes.empty()) {
+            options.sizes = { 300000 };
+        }
+        std::printf("%8s %8s %8s %8s %9s %9s %9s\n", "entries", "lists", "distinct",
+                    "names", "fold ms", "parse ms", "cached ms");
+        for (size_t nEntries : options.sizes) {
+            runNames(nEntries, options);
+        }
+        return 0;
+    }
+
+    if (options.corpora.empty()) {
+        options.corpora.assign(std::begin(Corpora), std::end(Corpora));
+    }
+    if (options.sizes.empty()) {
+        // 1M entries are left out by default as they need a few hundred megabytes
+        options.sizes = { 1000, 10000, 100000 };
+    }
+
+    const std::string_view scanner = scanImplementationName(scanImplementation());
+    std::printf("Scanner: %.*s\n", static_cast<int>(scanner.size()), scanner.data());
+    std::printf("%-13s %8s %8s %9s %9s %9s %9s %9s %9s %9s %11s\n", "corpus", "entries",
+                "MB", "scan ms", "split ms", "valid ms", "parse ms", "events ms",
+                "output ms", "MB/s", "entries/s");
+    for (Corpus corpus : options.corpora) {
+        for (size_t nEntries : options.sizes) {
+            run(corpus, nEntries, options);
+        }
+    }
+    return 0;
+}
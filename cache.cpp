@@ -0,0 +1,269 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "cache.h"
+
+#include "parser.h"
+#include "validation.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// File layout, all integers are stored in native byte order:
+//
+// Header:     char[4] "BTFC", uint32_t FormatVersion, uint64_t rulesetFingerprint(),
+//             uint64_t number of records
+// Record:     uint64_t hash, uint32_t size, uint32_t cite key offset, uint32_t cite key
+//             length, uint32_t number of diagnostics, followed by the diagnostics
+// Diagnostic: uint8_t kind, uint32_t offset relative to the entry, uint32_t message
+//             length, followed by the message
+
+namespace {
+    constexpr char Magic[4] = { 'B', 'T', 'F', 'C' };
+    // Version 2 added Diagnostic::Kind::DuplicateField, which older caches never contain
+    constexpr uint32_t FormatVersion = 2;
+
+    template <typename T>
+    void append(std::string& buffer, T value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    // Reads values from the cache file while checking that they are within bounds
+    class Reader {
+    public:
+        Reader(const std::vector<char>& data, size_t offset)
+            : _data(data)
+            , _offset(offset)
+        {}
+
+        template <typename T>
+        bool read(T& value) {
+            if (_offset + sizeof(T) > _data.size()) {
+                return false;
+            }
+            std::memcpy(&value, _data.data() + _offset, sizeof(T));
+            _offset += sizeof(T);
+            return true;
+        }
+
+        bool read(std::string_view& string, size_t size) {
+            if (_offset + size > _data.size()) {
+                return false;
+            }
+            string = std::string_view(_data.data() + _offset, size);
+            _offset += size;
+            return true;
+        }
+
+        size_t offset() const {
+            return _offset;
+        }
+
+    private:
+        const std::vector<char>& _data;
+        size_t _offset;
+    };
+
+    // Moves the reader past one record and returns false if the record is damaged
+    bool skipRecord(Reader& reader) {
+        uint64_t hash = 0;
+        uint32_t size = 0;
+        uint32_t keyOffset = 0;
+        uint32_t keyLength = 0;
+        uint32_t nDiagnostics = 0;
+        bool success = reader.read(hash) && reader.read(size) &&
+                       reader.read(keyOffset) && reader.read(keyLength) &&
+                       reader.read(nDiagnostics);
+        for (uint32_t i = 0; success && i < nDiagnostics; ++i) {
+            uint8_t kind = 0;
+            uint32_t offset = 0;
+            uint32_t length = 0;
+            std::string_view message;
+            success = reader.read(kind) && reader.read(offset) && reader.read(length) &&
+                      reader.read(message, length);
+        }
+        return success;
+    }
+} // namespace
+
+bool ValidationCache::load(const std::string& path, const RuleSet* rules) {
+    _data.clear();
+    _records.clear();
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.good()) {
+        return false;
+    }
+    _data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(_data.data(), _data.size());
+    if (!file.good()) {
+        _data.clear();
+        return false;
+    }
+
+    Reader reader(_data, 0);
+    std::string_view magic;
+    uint32_t version;
+    uint64_t fingerprint;
+    uint64_t nRecords;
+    const bool isValid = reader.read(magic, sizeof(Magic)) &&
+                         magic == std::string_view(Magic, sizeof(Magic)) &&
+                         reader.read(version) && version == FormatVersion &&
+                         reader.read(fingerprint) &&
+                         fingerprint == rulesetFingerprint(rules) &&
+                         reader.read(nRecords);
+    if (!isValid) {
+        _data.clear();
+        return false;
+    }
+
+    _records.reserve(static_cast<size_t>(nRecords));
+    for (uint64_t i = 0; i < nRecords; ++i) {
+        const size_t offset = reader.offset();
+        uint64_t hash;
+        if (!Reader(_data, offset).read(hash) || !skipRecord(reader)) {
+            _data.clear();
+            _records.clear();
+            return false;
+        }
+        _records[hash] = offset;
+    }
+    return true;
+}
+
+bool ValidationCache::save(const std::string& path,
+                           const std::vector<ParseResult>& results, const RuleSet* rules)
+{
+    std::string buffer;
+    size_t nRecords = 0;
+    for (const ParseResult& result : results) {
+        nRecords += result.cacheRecords.size();
+    }
+
+    buffer.append(Magic, sizeof(Magic));
+    append(buffer, FormatVersion);
+    append(buffer, rulesetFingerprint(rules));
+    append(buffer, static_cast<uint64_t>(nRecords));
+
+    for (const ParseResult& result : results) {
+        for (const CacheRecord& record : result.cacheRecords) {
+            append(buffer, record.hash);
+            append(buffer, static_cast<uint32_t>(record.size));
+            append(buffer, static_cast<uint32_t>(record.citeKeyOffset));
+            append(buffer, static_cast<uint32_t>(record.citeKeyLength));
+            append(buffer, static_cast<uint32_t>(record.nDiagnostics));
+            for (size_t i = 0; i < record.nDiagnostics; ++i) {
+                const Diagnostic& d = result.diagnostics[record.firstDiagnostic + i];
+                append(buffer, static_cast<uint8_t>(d.kind));
+                append(buffer, static_cast<uint32_t>(d.offset - record.begin));
+                append(buffer, static_cast<uint32_t>(d.message.size()));
+                buffer.append(d.message);
+            }
+        }
+    }
+
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    std::FILE* file = std::fopen(temporary.string().c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const bool isWritten = std::fwrite(buffer.data(), 1, buffer.size(), file) ==
+                           buffer.size();
+    const bool isClosed = std::fclose(file) == 0;
+
+    std::error_code error;
+    if (isWritten && isClosed) {
+        std::filesystem::rename(temporary, path, error);
+    }
+    if (!isWritten || !isClosed || error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+bool ValidationCache::replay(std::string_view source, size_t begin,
+                             std::string_view rawText, uint64_t hash,
+                             std::vector<Diagnostic>& diagnostics) const
+{
+    auto it = _records.find(hash);
+    if (it == _records.end()) {
+        return false;
+    }
+
+    // The records have been checked for consistency when the cache was loaded, but a
+    // record that can't be read is still treated as a miss
+    Reader reader(_data, it->second);
+    uint64_t storedHash = 0;
+    uint32_t size = 0;
+    uint32_t keyOffset = 0;
+    uint32_t keyLength = 0;
+    uint32_t nDiagnostics = 0;
+    const bool isRead = reader.read(storedHash) && reader.read(size) &&
+                        reader.read(keyOffset) && reader.read(keyLength) &&
+                        reader.read(nDiagnostics);
+    if (!isRead || size != rawText.size() ||
+        uint64_t(keyOffset) + keyLength > rawText.size())
+    {
+        // Or a hash collision with an entry of a different length
+        return false;
+    }
+
+    const std::string_view citeKey = source.substr(begin + keyOffset, keyLength);
+    const size_t nPrevious = diagnostics.size();
+    for (uint32_t i = 0; i < nDiagnostics; ++i) {
+        uint8_t kind = 0;
+        uint32_t offset = 0;
+        uint32_t length = 0;
+        std::string_view message;
+        const bool isDiagnosticRead = reader.read(kind) && reader.read(offset) &&
+                                      reader.read(length) && reader.read(message, length);
+        if (!isDiagnosticRead || kind > uint8_t(Diagnostic::Kind::DuplicateField)) {
+            diagnostics.resize(nPrevious);
+            return false;
+        }
+        diagnostics.push_back({
+            static_cast<Diagnostic::Kind>(kind),
+            begin,
+            begin + offset,
+            citeKey,
+            std::string(message)
+        });
+    }
+    return true;
+}
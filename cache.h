@@ -0,0 +1,92 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___CACHE___H__
+#define __BIBTEXFORMAT___CACHE___H__
+
+#include "diagnostic.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class RuleSet;
+struct ParseResult;
+
+// The information about one validated entry that is needed to store it in the cache
+struct CacheRecord {
+    uint64_t hash;  // hash64 of the raw text of the entry, see ParseOptions::macros
+    size_t begin;   // Offset of the '@' of the entry
+    size_t size;    // Length of the raw text of the entry
+
+    // Position of the cite key relative to the '@' of the entry
+    size_t citeKeyOffset;
+    size_t citeKeyLength;
+
+    // The diagnostics of the entry in ParseResult::diagnostics
+    size_t firstDiagnostic;
+    size_t nDiagnostics;
+};
+
+// Remembers the diagnostics of every entry of a previous run, keyed by a hash of the raw
+// bytes of the entry. The cache is only valid for the set of rules it was created with;
+// a cache that was written with different rules is ignored when it is loaded
+class ValidationCache {
+public:
+    // Returns false if the file does not exist, is damaged, or was created for a
+    // different set of rules than 'rules', see rulesetFingerprint. The cache is empty in
+    // all of these cases
+    bool load(const std::string& path, const RuleSet* rules = nullptr);
+
+    // Replaces the cache file with the records of all results, which were checked with
+    // 'rules'. The file is written to a temporary file first, so a failed write does not
+    // destroy the previous cache
+    static bool save(const std::string& path, const std::vector<ParseResult>& results,
+                     const RuleSet* rules = nullptr);
+
+    // If an entry with the same raw text is in the cache, its diagnostics are appended,
+    // moved to 'begin' in the current source, and true is returned
+    bool replay(std::string_view source, size_t begin, std::string_view rawText,
+                uint64_t hash, std::vector<Diagnostic>& diagnostics) const;
+
+private:
+    std::vector<char> _data;
+
+    // Offset of the record in _data for each entry hash
+    std::unordered_map<uint64_t, size_t> _records;
+};
+
+#endif // __BIBTEXFORMAT___CACHE___H__
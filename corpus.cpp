@@ -0,0 +1,536 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "corpus.h"
+
+#include "entry.h"
+
+#include <array>
+#include <utility>
+#include <vector>
+
+namespace {
+    // SplitMix64, which is tiny and produces the same sequence everywhere
+    class Random {
+    public:
+        explicit Random(uint64_t seed) : _state(seed) {}
+
+        uint64_t next() {
+            uint64_t z = (_state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // Returns a number in [0, n)
+        size_t below(size_t n) {
+            return static_cast<size_t>(next() % n);
+        }
+
+        // Returns a number in [min, max]
+        size_t between(size_t min, size_t max) {
+            return min + below(max - min + 1);
+        }
+
+        bool chance(int percent) {
+            return below(100) < static_cast<size_t>(percent);
+        }
+
+        template <size_t N>
+        std::string_view pick(const std::array<std::string_view, N>& list) {
+            return list[below(N)];
+        }
+
+    private:
+        uint64_t _state;
+    };
+
+    constexpr std::array<std::string_view, 16> FirstNames = {
+        "Alexander", "Anders", "Charles", "Claudio", "Emil", "Hans-Christian", "Ingrid",
+        "Jan", "Karljohan", "Maria", "Martin", "Patric", "Ross", "Stefan", "Timo", "Ying"
+    };
+
+    constexpr std::array<std::string_view, 16> LastNames = {
+        "Bock", "Ynnerman", "Hansen", "Silva", "Axelsson", "Sand{\\'e}n", "Lindholm",
+        "M{\\\"u}ller", "Ljung", "Falk", "Ropinski", "{van der} Berg", "Whitaker",
+        "Gumhold", "Wang", "{\\O}sterberg"
+    };
+
+    constexpr std::array<std::string_view, 40> Words = {
+        "interactive", "visualization", "of", "large", "scale", "volumetric", "data",
+        "using", "adaptive", "sampling", "for", "the", "exploration", "space", "mission",
+        "planning", "in", "a", "dome", "environment", "efficient", "rendering", "with",
+        "uncertainty", "multi-field", "ensemble", "analysis", "on", "{GPU}", "clusters",
+        "{MRI}", "brain", "imaging", "and", "{Monte Carlo}", "simulation", "of", "light",
+        "transport", "through"
+    };
+
+    constexpr std::array<std::string_view, 6> JournalMacros = {
+        "tvcg", "cgf", "tog", "cga", "vc", "jvis"
+    };
+
+    constexpr std::array<std::string_view, 6> JournalNames = {
+        "{IEEE} Transactions on Visualization and Computer Graphics",
+        "Computer Graphics Forum",
+        "{ACM} Transactions on Graphics",
+        "{IEEE} Computer Graphics and Applications",
+        "The Visual Computer",
+        "Journal of Visualization"
+    };
+
+    constexpr std::array<std::string_view, 6> Publishers = {
+        "{IEEE}", "{ACM}", "Springer", "Elsevier", "The Eurographics Association",
+        "{CRC} Press"
+    };
+
+    constexpr std::array<std::string_view, 6> Cities = {
+        "Link{\\\"o}ping, Sweden", "New York, NY, USA", "Vienna, Austria",
+        "Salt Lake City, UT, USA", "Berlin, Germany", "Kyoto, Japan"
+    };
+
+    constexpr std::array<std::string_view, 12> Months = {
+        "jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"
+    };
+
+    constexpr std::array<std::string_view, 4> ExtraFields = {
+        "abstract", "keywords", "isbn", "issn"
+    };
+
+    // Number of bytes that one realistic entry occupies on average, which is used to
+    // scale the pathological corpora
+    constexpr size_t AverageEntrySize = 450;
+
+    // Appends words until the line is full and then continues on the next line, aligned
+    // with the beginning of the value, the way people tend to write long values
+    void appendWords(std::string& output, Random& random, size_t nWords) {
+        size_t lineLength = 0;
+        for (size_t i = 0; i < nWords; ++i) {
+            if (i > 0) {
+                if (lineLength > 60) {
+                    output += "\n                ";
+                    lineLength = 0;
+                }
+                else {
+                    output.push_back(' ');
+                }
+            }
+            std::string_view word = random.pick(Words);
+            output += word;
+            lineLength += word.size() + 1;
+        }
+    }
+
+    void appendNames(std::string& output, Random& random) {
+        const size_t nNames = random.between(1, 8);
+        for (size_t i = 0; i < nNames; ++i) {
+            if (i > 0) {
+                output += i % 3 == 0 ? " and\n                " : " and ";
+            }
+            output += random.pick(LastNames);
+            output += ", ";
+            output += random.pick(FirstNames);
+        }
+    }
+
+    // Writes the value including its delimiters
+    void appendValue(std::string& output, Random& random, Keyword keyword) {
+        switch (keyword) {
+            case Keyword::Year:
+                output += std::to_string(random.between(1970, 2024));
+                return;
+            case Keyword::Volume:
+            case Keyword::Number:
+            case Keyword::Edition:
+            case Keyword::Chapter:
+                output += std::to_string(random.between(1, 40));
+                return;
+            case Keyword::Month:
+                if (random.chance(80)) {
+                    output += random.pick(Months);
+                    return;
+                }
+                break;
+            case Keyword::Journal:
+                if (random.chance(50)) {
+                    output += random.pick(JournalMacros);
+                    return;
+                }
+                break;
+            default:
+                break;
+        }
+
+        // Quotes are only used for values that can't contain quotes themselves
+        const bool isQuoted = keyword != Keyword::Author && keyword != Keyword::Editor &&
+                              keyword != Keyword::Address && random.chance(10);
+        output.push_back(isQuoted ? '"' : '{');
+        switch (keyword) {
+            case Keyword::Author:
+            case Keyword::Editor:
+                appendNames(output, random);
+                break;
+            case Keyword::Title:
+            case Keyword::BookTitle:
+                if (random.chance(20)) {
+                    // Protected capitalization with nested groups
+                    output += "{{V}olume {R}endering of {\\em {";
+                    output += random.pick(Words);
+                    output += "}}} ";
+                }
+                appendWords(output, random, random.between(4, 18));
+                break;
+            case Keyword::Journal:
+                output += random.pick(JournalNames);
+                break;
+            case Keyword::Publisher:
+            case Keyword::Organization:
+            case Keyword::Institution:
+            case Keyword::School:
+                output += random.pick(Publishers);
+                break;
+            case Keyword::Address:
+                output += random.pick(Cities);
+                break;
+            case Keyword::Pages: {
+                const size_t first = random.between(1, 900);
+                output += std::to_string(first) + "--" +
+                          std::to_string(first + random.between(1, 30));
+                break;
+            }
+            case Keyword::Doi:
+                output += "10.1109/TVCG." + std::to_string(random.between(1990, 2024)) +
+                          "." + std::to_string(random.between(1000000, 9999999));
+                break;
+            case Keyword::Url:
+                output += "https://doi.org/10.1145/" +
+                          std::to_string(random.between(100000, 999999));
+                break;
+            case Keyword::Month:
+                output += "January";
+                break;
+            default:
+                appendWords(output, random, random.between(1, 8));
+                break;
+        }
+        output.push_back(isQuoted ? '"' : '}');
+    }
+
+    void appendRealisticEntry(std::string& output, Random& random, size_t index) {
+        const Type type = static_cast<Type>(random.below(NumTypes));
+        std::string_view name = typeName(type);
+
+        // Some files use capitalized types, some use the 'conference' alias
+        if (type == Type::InProceedings && random.chance(10)) {
+            name = "conference";
+        }
+        output.push_back('@');
+        if (random.chance(20)) {
+            output.push_back(static_cast<char>(name[0] - 'a' + 'A'));
+            output += name.substr(1);
+        }
+        else {
+            output += name;
+        }
+        output.push_back('{');
+        // Cite keys are made of the letters of a name, the year, and a running number
+        size_t nLetters = 0;
+        for (char c : random.pick(LastNames)) {
+            if (((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) && nLetters++ < 4) {
+                output.push_back(c);
+            }
+        }
+        output += std::to_string(random.between(1970, 2024));
+        output.push_back('-');
+        output += std::to_string(index);
+
+        // A few entries are broken, which is how real files look like as well
+        const bool isBroken = random.chance(1);
+        const KeywordList& accepted = AcceptedKeywords[static_cast<int>(type)];
+        size_t i = 0;
+        for (Keyword keyword : accepted) {
+            // The first keywords are the important ones, which are almost always present
+            const int probability = i++ < 4 ? 95 : 35;
+            if (!random.chance(probability)) {
+                continue;
+            }
+
+            output += isBroken && random.chance(30) ? "\n    " : ",\n    ";
+            output += keywordName(keyword);
+            output += " = ";
+            appendValue(output, random, keyword);
+        }
+        if (random.chance(5)) {
+            output += ",\n    ";
+            output += random.pick(ExtraFields);
+            output += " = {";
+            appendWords(output, random, random.between(10, 60));
+            output.push_back('}');
+        }
+        output += random.chance(50) ? ",\n}\n\n" : "\n}\n\n";
+    }
+
+    void appendJournalStrings(std::string& output) {
+        for (size_t i = 0; i < JournalMacros.size(); ++i) {
+            output += "@string{";
+            output += JournalMacros[i];
+            output += " = {";
+            output += JournalNames[i];
+            output += "}}\n";
+        }
+        output += "\n";
+    }
+
+    void appendRealistic(std::string& output, Random& random, size_t nEntries) {
+        appendJournalStrings(output);
+        for (size_t i = 0; i < nEntries; ++i) {
+            if (random.chance(2)) {
+                output += "% ";
+                appendWords(output, random, random.between(3, 8));
+                output += "\n";
+            }
+            if (random.chance(1)) {
+                output += "@comment{";
+                appendWords(output, random, random.between(3, 20));
+                output += "}\n\n";
+            }
+            appendRealisticEntry(output, random, i);
+        }
+    }
+
+    // Writes the entry the way it looks after it went through another reference manager:
+    // the cite key gets a suffix, the title is in title case and sometimes has another
+    // word in front, and the accents are UTF-8 characters
+    void appendReimported(std::string& output, Random& random, std::string_view entry) {
+        constexpr std::array<std::pair<std::string_view, std::string_view>, 4> Accents =
+        {{
+            { "{\\'e}", "\xc3\xa9" }, { "{\\\"u}", "\xc3\xbc" },
+            { "{\\\"o}", "\xc3\xb6" }, { "{\\O}", "\xc3\x98" }
+        }};
+        constexpr std::string_view Title = "\n    title = ";
+
+        // The cite key ends at the first comma or line break
+        const size_t keyEnd = entry.find_first_of(",\n");
+        output += entry.substr(0, keyEnd);
+        output.push_back('b');
+
+        bool isInTitle = false;
+        bool startsWord = false;
+        size_t i = keyEnd;
+        while (i < entry.size()) {
+            const std::string_view rest = entry.substr(i);
+            bool isAccent = false;
+            for (const auto& [latex, utf8] : Accents) {
+                if (rest.substr(0, latex.size()) == latex) {
+                    output += utf8;
+                    i += latex.size();
+                    isAccent = true;
+                    break;
+                }
+            }
+            if (isAccent) {
+                continue;
+            }
+
+            if (rest.substr(0, Title.size()) == Title && Title.size() < rest.size()) {
+                // Keep the delimiter in front of the new word
+                output += rest.substr(0, Title.size() + 1);
+                i += Title.size() + 1;
+                if (random.chance(30)) {
+                    output += "Towards ";
+                }
+                isInTitle = true;
+                startsWord = true;
+                continue;
+            }
+
+            // The title ends at the line of the next field, as continuation lines are
+            // indented further
+            const char c = entry[i];
+            if (c == '\n' && rest.substr(0, 6) != "\n     ") {
+                isInTitle = false;
+            }
+            if (isInTitle && startsWord && c >= 'a' && c <= 'z') {
+                output.push_back(static_cast<char>(c - 'a' + 'A'));
+            }
+            else {
+                output.push_back(c);
+            }
+            startsWord = c == ' ' || c == '\n';
+            ++i;
+        }
+    }
+
+    void appendNearDuplicates(std::string& output, Random& random, size_t nEntries) {
+        appendJournalStrings(output);
+
+        // The copies make up the last tenth of the file
+        const size_t nOriginals = nEntries - nEntries / 10;
+        std::vector<std::string> copies;
+        copies.reserve(nOriginals / 9 + 1);
+        std::string entry;
+        for (size_t i = 0; i < nOriginals; ++i) {
+            entry.clear();
+            appendRealisticEntry(entry, random, i);
+            output += entry;
+            if (copies.size() < nEntries / 10 && i % 9 == 0) {
+                appendReimported(copies.emplace_back(), random, entry);
+            }
+        }
+        for (const std::string& copy : copies) {
+            output += copy;
+        }
+    }
+
+    void appendPathologicalEntry(std::string& output, Random& random, Corpus corpus,
+                                 size_t index)
+    {
+        const std::string key = "key" + std::to_string(index);
+        switch (corpus) {
+            case Corpus::DeepNesting: {
+                const size_t depth = random.between(1000, 4000);
+                output += "@misc{" + key + ",\n    title = {";
+                for (size_t i = 0; i < depth; ++i) {
+                    output += i % 16 == 0 ? "{a " : "{";
+                }
+                for (size_t i = 0; i < depth; ++i) {
+                    output.push_back('}');
+                }
+                output += "},\n    year = 2000\n}\n\n";
+                break;
+            }
+            case Corpus::LongValues: {
+                constexpr std::array<std::string_view, 4> Whitespace = {
+                    " ", "   ", "\n        ", "\t \r\n  "
+                };
+                output += "@misc{" + key + ",\n    note = {";
+                const size_t nWords = random.between(20000, 60000);
+                for (size_t i = 0; i < nWords; ++i) {
+                    output += random.pick(Words);
+                    output += random.pick(Whitespace);
+                }
+                output += "},\n    year = 2000\n}\n\n";
+                break;
+            }
+            case Corpus::ManyAts: {
+                output += "Contact: someone@example.org, @ mentions and @misc without "
+                          "braces are ignored\n";
+                output += "@misc{" + key + ",\n    note = {";
+                const size_t nLines = random.between(200, 800);
+                for (size_t i = 0; i < nLines; ++i) {
+                    output += "\n@article{fake" + std::to_string(i) +
+                              ", author = {user@host}}";
+                }
+                output += "},\n    year = 2000\n}\n\n";
+                break;
+            }
+            case Corpus::Quotes: {
+                output += "@misc(" + key + ",\n    note = \"";
+                const size_t nQuotes = random.between(500, 2000);
+                for (size_t i = 0; i < nQuotes; ++i) {
+                    output += "{\"o} {\\\"a} {\"} ";
+                }
+                output += "\",\n    title = \"A title with a ) inside\",";
+                output += "\n    year = 2000\n)\n\n";
+                break;
+            }
+            case Corpus::TinyEntries:
+                output += "@misc{" + key + ",}\n";
+                break;
+            case Corpus::Realistic:
+            case Corpus::Unterminated:
+            case Corpus::NearDuplicates:
+            case Corpus::HugeValue:
+                break;
+        }
+    }
+} // namespace
+
+std::string_view corpusName(Corpus corpus) {
+    switch (corpus) {
+        case Corpus::Realistic:      return "realistic";
+        case Corpus::DeepNesting:    return "deep-nesting";
+        case Corpus::LongValues:     return "long-values";
+        case Corpus::ManyAts:        return "many-ats";
+        case Corpus::Unterminated:   return "unterminated";
+        case Corpus::Quotes:         return "quotes";
+        case Corpus::NearDuplicates: return "near-duplicates";
+        case Corpus::HugeValue:      return "huge-value";
+        case Corpus::TinyEntries:    return "tiny-entries";
+        default:                     return "";
+    }
+}
+
+bool corpusFromName(std::string_view name, Corpus& corpus) {
+    for (Corpus c : Corpora) {
+        if (corpusName(c) == name) {
+            corpus = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string generateCorpus(Corpus corpus, size_t nEntries, uint64_t seed) {
+    Random random(seed);
+    std::string output;
+    output.reserve(nEntries * AverageEntrySize);
+
+    if (corpus == Corpus::Realistic) {
+        appendRealistic(output, random, nEntries);
+    }
+    else if (corpus == Corpus::NearDuplicates) {
+        appendNearDuplicates(output, random, nEntries);
+    }
+    else if (corpus == Corpus::Unterminated) {
+        output += "@article{broken,\n    title = {The closing brace of this value and of "
+                  "the entry are missing,\n\n";
+        appendRealistic(output, random, nEntries);
+    }
+    else if (corpus == Corpus::HugeValue) {
+        const size_t targetSize = nEntries * AverageEntrySize;
+        output += "@misc{huge,\n    note = {";
+        while (output.size() < targetSize) {
+            output += random.pick(Words);
+            output += random.chance(10) ? "\n        " : " ";
+        }
+        output += "},\n    year = 2000\n}\n";
+    }
+    else {
+        const size_t targetSize = nEntries * AverageEntrySize;
+        for (size_t i = 0; output.size() < targetSize; ++i) {
+            appendPathologicalEntry(output, random, corpus, i);
+        }
+    }
+    return output;
+}
@@ -0,0 +1,88 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___CORPUS___H__
+#define __BIBTEXFORMAT___CORPUS___H__
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Synthetic inputs that are used to measure the parser. All of them are generated from a
+// seed with our own random number generator, so that the same seed produces the same
+// bytes on every platform and with every standard library
+enum class Corpus {
+    // Entries of all types with author lists, multi-line values, nested braces, numbers,
+    // macros, quoted values, and the occasional comment, @string, or broken entry
+    Realistic,
+    // Values that consist of thousands of nested brace groups
+    DeepNesting,
+    // Values that are hundreds of kilobytes long and contain many runs of whitespace
+    LongValues,
+    // Values with lines that look like the start of a new entry
+    ManyAts,
+    // A first entry without its closing brace, which forces the lexer to search until
+    // the end of the file and then recover
+    Unterminated,
+    // Parenthesized entries whose values are full of quotes and escaped braces
+    Quotes,
+    // Realistic entries of which every tenth is imported a second time at the end of the
+    // file, with a different cite key, title case, UTF-8 instead of LaTeX accents, and
+    // sometimes an additional word in the title. The copy of the entry with the cite key
+    // 'key' has the cite key 'keyb'
+    NearDuplicates,
+    // A single entry whose note makes up the whole file, which is more than ten megabytes
+    // at the size of 25000 realistic entries
+    HugeValue,
+    // Entries that consist of little more than their cite key, so that the cost per entry
+    // dominates. There are millions of them at the size of 100000 realistic entries
+    TinyEntries
+};
+
+constexpr Corpus Corpora[] = {
+    Corpus::Realistic, Corpus::DeepNesting, Corpus::LongValues, Corpus::ManyAts,
+    Corpus::Unterminated, Corpus::Quotes, Corpus::NearDuplicates, Corpus::HugeValue,
+    Corpus::TinyEntries
+};
+
+std::string_view corpusName(Corpus corpus);
+
+// Returns false if the name does not belong to any corpus
+bool corpusFromName(std::string_view name, Corpus& corpus);
+
+// Generates roughly 'nEntries' entries of the corpus. For the pathological corpora, the
+// entries are larger so that the total size is of the same order as for the realistic one
+std::string generateCorpus(Corpus corpus, size_t nEntries, uint64_t seed);
+
+#endif // __BIBTEXFORMAT___CORPUS___H__
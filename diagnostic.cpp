@@ -0,0 +1,303 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "diagnostic.h"
+
+#include "json.h"
+
+#include <algorithm>
+
+namespace {
+    // Identifiers of the kinds in the JSON and SARIF output, indexed by Diagnostic::Kind
+    constexpr std::string_view RuleIds[] = {
+        "parse-error", "unknown-type", "missing-field", "extra-field", "undefined-macro",
+        "duplicate-field"
+    };
+
+    // BibTeX ignores extra fields and only warns about undefined macros, which it
+    // expands to nothing, and about repeated fields, of which it uses the first
+    bool isWarning(Diagnostic::Kind kind) {
+        return kind == Diagnostic::Kind::ExtraField ||
+               kind == Diagnostic::Kind::UndefinedMacro ||
+               kind == Diagnostic::Kind::DuplicateField;
+    }
+
+    // Turns offsets, which have to be increasing, into lines and columns. Newlines and
+    // code points are counted incrementally, so that converting all offsets of a file is
+    // linear, even if the whole file is a single line
+    class PositionCounter {
+    public:
+        PositionCounter(std::string_view source, const SourceStart& start)
+            : _source(source)
+            , _line(start.line)
+            , _firstColumn(start.column)
+        {}
+
+        size_t lineOf(size_t offset) {
+            advance(offset);
+            return _line;
+        }
+
+        size_t columnOf(size_t offset) {
+            advance(offset);
+            size_t column = _column;
+            if (offset < _countedUntil) {
+                // An offset before the last one is only ever a few bytes back in the
+                // same entry, which is cheaper to count from the end
+                column -= std::count_if(
+                    _source.begin() + std::max(offset, _lineStart),
+                    _source.begin() + _countedUntil,
+                    isCodePointStart
+                );
+            }
+            return column + (_isFirstLine ? _firstColumn : 1);
+        }
+
+    private:
+        // Continuation bytes of UTF-8 sequences don't start a new code point
+        static bool isCodePointStart(char c) {
+            return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+        }
+
+        void advance(size_t offset) {
+            for (; _countedUntil < offset; ++_countedUntil) {
+                const char c = _source[_countedUntil];
+                if (c == '\n') {
+                    ++_line;
+                    _lineStart = _countedUntil + 1;
+                    _column = 0;
+                    _isFirstLine = false;
+                }
+                else if (isCodePointStart(c)) {
+                    ++_column;
+                }
+            }
+        }
+
+        std::string_view _source;
+        size_t _line;
+        size_t _firstColumn;
+        size_t _countedUntil = 0;
+        size_t _lineStart = 0;
+        // Code points between the start of the line and '_countedUntil'
+        size_t _column = 0;
+        bool _isFirstLine = true;
+    };
+
+    void appendText(std::string& output, std::string_view source,
+                    const std::vector<Diagnostic>& diagnostics, const SourceStart& start)
+    {
+        PositionCounter positions(source, start);
+        for (size_t i = 0; i < diagnostics.size(); ++i) {
+            const Diagnostic& d = diagnostics[i];
+            const bool isFirstOfEntry =
+                i == 0 || diagnostics[i - 1].entryOffset != d.entryOffset;
+            if (isFirstOfEntry) {
+                if (d.citeKey.empty()) {
+                    output += "Error in line ";
+                    output += std::to_string(positions.lineOf(d.entryOffset));
+                    output += '\n';
+                }
+                else {
+                    output += "Error in: ";
+                    output += d.citeKey;
+                    output += '\n';
+                }
+            }
+
+            switch (d.kind) {
+                case Diagnostic::Kind::ParseError:
+                    output += d.message;
+                    output += " in line ";
+                    output += std::to_string(positions.lineOf(d.offset));
+                    break;
+                case Diagnostic::Kind::UnknownType:
+                    output += "Unknown type: ";
+                    output += d.message;
+                    break;
+                case Diagnostic::Kind::MissingField:
+                    output += "Missing: ";
+                    output += d.message;
+                    break;
+                case Diagnostic::Kind::ExtraField:
+                    output += "Extra:   ";
+                    output += d.message;
+                    break;
+                case Diagnostic::Kind::UndefinedMacro:
+                    output += "Undefined macro: ";
+                    output += d.message;
+                    break;
+                case Diagnostic::Kind::DuplicateField:
+                    output += "Duplicate field: ";
+                    output += d.message;
+                    break;
+            }
+            output += '\n';
+
+            const bool isLastOfEntry = i + 1 == diagnostics.size() ||
+                                       diagnostics[i + 1].entryOffset != d.entryOffset;
+            if (isLastOfEntry) {
+                output += "\n\n";
+            }
+        }
+    }
+
+    void appendJson(std::string& output, std::string_view path, std::string_view source,
+                    const std::vector<Diagnostic>& diagnostics, const SourceStart& start)
+    {
+        PositionCounter positions(source, start);
+        for (size_t i = 0; i < diagnostics.size(); ++i) {
+            const Diagnostic& d = diagnostics[i];
+            output += i == 0 ? "{\"file\":" : ",\n{\"file\":";
+            appendJsonString(output, path);
+            output += ",\"kind\":\"";
+            output += RuleIds[static_cast<int>(d.kind)];
+            output += isWarning(d.kind) ? "\",\"severity\":\"warning\"" :
+                                          "\",\"severity\":\"error\"";
+            output += ",\"message\":";
+            appendJsonString(output, diagnosticMessage(d));
+            output += ",\"citeKey\":";
+            if (d.citeKey.empty()) {
+                output += "null";
+            }
+            else {
+                appendJsonString(output, d.citeKey);
+            }
+            output += ",\"offset\":" + std::to_string(start.offset + d.offset);
+            output += ",\"line\":" + std::to_string(positions.lineOf(d.offset));
+            output += ",\"column\":" + std::to_string(positions.columnOf(d.offset));
+            output += '}';
+        }
+    }
+
+    void appendSarif(std::string& output, std::string_view path, std::string_view source,
+                     const std::vector<Diagnostic>& diagnostics, const SourceStart& start)
+    {
+        // Artifact locations are URI references, which always use forward slashes
+        std::string uri(path);
+        std::replace(uri.begin(), uri.end(), '\\', '/');
+
+        PositionCounter positions(source, start);
+        for (size_t i = 0; i < diagnostics.size(); ++i) {
+            const Diagnostic& d = diagnostics[i];
+            output += i == 0 ? "{\"ruleId\":\"" : ",\n{\"ruleId\":\"";
+            output += RuleIds[static_cast<int>(d.kind)];
+            output += "\",\"ruleIndex\":" + std::to_string(static_cast<int>(d.kind));
+            output += isWarning(d.kind) ? ",\"level\":\"warning\"" :
+                                          ",\"level\":\"error\"";
+            output += ",\"message\":{\"text\":";
+            appendJsonString(output, diagnosticMessage(d));
+            output += "},\"locations\":[{\"physicalLocation\":{\"artifactLocation\":";
+            output += "{\"uri\":";
+            appendJsonString(output, uri);
+            output += "},\"region\":{\"startLine\":";
+            output += std::to_string(positions.lineOf(d.offset));
+            output += ",\"startColumn\":" + std::to_string(positions.columnOf(d.offset));
+            output += ",\"byteOffset\":" + std::to_string(start.offset + d.offset);
+            output += "}}";
+            if (!d.citeKey.empty()) {
+                output += ",\"logicalLocations\":[{\"name\":";
+                appendJsonString(output, d.citeKey);
+                output += "}]";
+            }
+            output += "}]}";
+        }
+    }
+} // namespace
+
+std::string diagnosticMessage(const Diagnostic& diagnostic) {
+    switch (diagnostic.kind) {
+        case Diagnostic::Kind::ParseError:   return diagnostic.message;
+        case Diagnostic::Kind::UnknownType:  return "Unknown type: " + diagnostic.message;
+        case Diagnostic::Kind::MissingField: return "Missing: " + diagnostic.message;
+        case Diagnostic::Kind::ExtraField:   return "Extra: " + diagnostic.message;
+        case Diagnostic::Kind::UndefinedMacro:
+            return "Undefined macro: " + diagnostic.message;
+        case Diagnostic::Kind::DuplicateField:
+            return "Duplicate field: " + diagnostic.message;
+        default:                             return diagnostic.message;
+    }
+}
+
+void appendDiagnostics(std::string& output, DiagnosticFormat format,
+                       std::string_view path, std::string_view source,
+                       const std::vector<Diagnostic>& diagnostics,
+                       const SourceStart& start)
+{
+    switch (format) {
+        case DiagnosticFormat::Text:
+            appendText(output, source, diagnostics, start);
+            break;
+        case DiagnosticFormat::Json:
+            appendJson(output, path, source, diagnostics, start);
+            break;
+        case DiagnosticFormat::Sarif:
+            appendSarif(output, path, source, diagnostics, start);
+            break;
+    }
+}
+
+std::string_view reportBegin(DiagnosticFormat format) {
+    switch (format) {
+        case DiagnosticFormat::Json:
+            return "{\"version\":1,\"diagnostics\":[\n";
+        case DiagnosticFormat::Sarif:
+            return "{\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\","
+                   "\"version\":\"2.1.0\",\"runs\":[{\"tool\":{\"driver\":{"
+                   "\"name\":\"BibTexFormat\",\"rules\":["
+                   "{\"id\":\"parse-error\",\"shortDescription\":{\"text\":"
+                   "\"The entry is not valid BibTeX\"}},"
+                   "{\"id\":\"unknown-type\",\"shortDescription\":{\"text\":"
+                   "\"The entry type is not one of the standard types\"}},"
+                   "{\"id\":\"missing-field\",\"shortDescription\":{\"text\":"
+                   "\"A field that the entry type requires is missing\"}},"
+                   "{\"id\":\"extra-field\",\"shortDescription\":{\"text\":"
+                   "\"The field is not used by the entry type\"}},"
+                   "{\"id\":\"undefined-macro\",\"shortDescription\":{\"text\":"
+                   "\"The value uses a macro that no @string defines\"}},"
+                   "{\"id\":\"duplicate-field\",\"shortDescription\":{\"text\":"
+                   "\"The field is repeated and only its first value is used\"}}]}},"
+                   "\"columnKind\":\"unicodeCodePoints\",\"results\":[\n";
+        default:
+            return "";
+    }
+}
+
+std::string_view reportEnd(DiagnosticFormat format) {
+    switch (format) {
+        case DiagnosticFormat::Json:    return "\n]}\n";
+        case DiagnosticFormat::Sarif:   return "\n]}]}\n";
+        default:                        return "";
+    }
+}
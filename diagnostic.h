@@ -0,0 +1,96 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___DIAGNOSTIC___H__
+#define __BIBTEXFORMAT___DIAGNOSTIC___H__
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct Diagnostic {
+    enum class Kind {
+        ParseError,
+        UnknownType,
+        MissingField,
+        ExtraField,
+        UndefinedMacro,
+        DuplicateField
+    };
+
+    Kind kind;
+    size_t entryOffset; // Offset of the '@' of the entry this diagnostic belongs to
+    size_t offset;      // Offset of the problem itself
+    std::string_view citeKey;
+    std::string message;
+};
+
+enum class DiagnosticFormat {
+    // Human readable, grouped by entry
+    Text,
+    // A JSON object with a "diagnostics" array
+    Json,
+    // A SARIF 2.1.0 log, which code scanning tools can ingest directly
+    Sarif
+};
+
+// The message as it is shown to the user, for example "Missing: year"
+std::string diagnosticMessage(const Diagnostic& diagnostic);
+
+// The position of the beginning of a source in its file, which is not the beginning of
+// the file if the source is only a piece of it
+struct SourceStart {
+    size_t offset = 0;
+    size_t line = 1;
+    size_t column = 1;
+};
+
+// Appends the diagnostics of one file to the output. The diagnostics have to be sorted by
+// their entry, which they are if they are reported in file order.
+//
+// In the text format, the diagnostics are grouped by the entry they belong to and the
+// path is not used. In the JSON and SARIF formats, every diagnostic becomes one object
+// with the path, the byte offset, and the line and column, which both start at 1 and
+// count code points. The objects are separated by commas, so that the output of several
+// files can be joined with commas and placed between reportBegin and reportEnd
+void appendDiagnostics(std::string& output, DiagnosticFormat format,
+                       std::string_view path, std::string_view source,
+                       const std::vector<Diagnostic>& diagnostics,
+                       const SourceStart& start = SourceStart());
+
+// The text that surrounds the diagnostics of all files in the given format
+std::string_view reportBegin(DiagnosticFormat format);
+std::string_view reportEnd(DiagnosticFormat format);
+
+#endif // __BIBTEXFORMAT___DIAGNOSTIC___H__
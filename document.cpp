@@ -0,0 +1,87 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "document.h"
+
+#include <utility>
+
+DocumentBuilder::DocumentBuilder(KeywordMask keywords, bool keepsExtraFields)
+    : _keywords(keywords)
+    , _keepsExtraFields(keepsExtraFields)
+{}
+
+bool DocumentBuilder::beginEntry(const EntryEvent& entry) {
+    if (entry.kind != EntryKind::Regular) {
+        return false;
+    }
+    _entry = Entry();
+    _entry.citeKey = entry.citeKey;
+    _entry.entryType = entry.entryType;
+    return true;
+}
+
+bool DocumentBuilder::field(const EntryEvent&, const FieldEvent& field) {
+    const bool isWanted = field.keyword == Keyword::Unknown ?
+        _keepsExtraFields :
+        (_keywords & maskOf(field.keyword)) != 0;
+    if (!isWanted) {
+        return true;
+    }
+
+    const std::string_view value = joinedValue(field.value, _document.arena);
+    const bool isExpression =
+        field.kind == ValueKind::Macro || field.kind == ValueKind::Concatenation;
+    _entry.set(field.keyword, field.key, value, isExpression);
+    return true;
+}
+
+void DocumentBuilder::endEntry(const EntryEvent& entry, LexError error, size_t) {
+    if (entry.kind == EntryKind::Regular && error == LexError::None) {
+        _document.entries.push_back(std::move(_entry));
+    }
+    _entry = Entry();
+}
+
+Document DocumentBuilder::release() {
+    Document document = std::move(_document);
+    _document = Document();
+    return document;
+}
+
+Document parseDocument(std::string_view source) {
+    DocumentBuilder builder;
+    parseEvents(source, builder);
+    return builder.release();
+}
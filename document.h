@@ -0,0 +1,82 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#ifndef __BIBTEXFORMAT___DOCUMENT___H__
+#define __BIBTEXFORMAT___DOCUMENT___H__
+
+#include "entry.h"
+#include "events.h"
+#include "stringarena.h"
+
+#include <string_view>
+#include <vector>
+
+constexpr KeywordMask AllKeywords = ~KeywordMask(0) >> (32 - NumKeywords);
+
+// The regular entries of a source. The fields are views into the source, except for the
+// values that had to be joined into a single line, which are stored in the arena
+struct Document {
+    std::vector<Entry> entries;
+    StringArena arena;
+};
+
+// Builds a Document from the events of parseEvents. Only the fields in 'keywords' are
+// stored and, if 'keepsExtraFields' is true, the fields whose name is not a Keyword, so
+// that a consumer that needs only a few fields does not store the others. Entries that
+// could not be parsed are left out
+class DocumentBuilder : public ParseHandler {
+public:
+    explicit DocumentBuilder(KeywordMask keywords = AllKeywords,
+                             bool keepsExtraFields = true);
+
+    bool beginEntry(const EntryEvent& entry) override;
+    bool field(const EntryEvent& entry, const FieldEvent& field) override;
+    void endEntry(const EntryEvent& entry, LexError error, size_t errorOffset) override;
+
+    // Hands over the entries that have been built so far and starts a new document
+    Document release();
+
+private:
+    KeywordMask _keywords;
+    bool _keepsExtraFields;
+
+    Document _document;
+    Entry _entry;
+};
+
+// Parses the source into a Document with all fields
+Document parseDocument(std::string_view source);
+
+#endif // __BIBTEXFORMAT___DOCUMENT___H__
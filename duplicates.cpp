@@ -0,0 +1,586 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "duplicates.h"
+
+#include "entry.h"
+#include "hash.h"
+#include "normalize.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+    char toLower(char c) {
+        return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+
+    bool startsWithIgnoreCase(std::string_view text, std::string_view prefix) {
+        if (text.size() < prefix.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < prefix.size(); ++i) {
+            if (toLower(text[i]) != prefix[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // An open-addressing hash table from a key to the group of all items with that key.
+    // The items of a group are linked through 'next', so that every insertion is O(1)
+    // and no per-group allocations are needed
+    class GroupIndex {
+    public:
+        static constexpr uint32_t None = UINT32_MAX;
+
+        struct Group {
+            uint64_t hash = 0;
+            uint32_t first = None;
+            uint32_t last = None;
+            uint32_t size = 0;
+        };
+
+        explicit GroupIndex(size_t nItems) {
+            // Keep the load factor below one half so that probe sequences stay short
+            size_t capacity = 16;
+            while (capacity < nItems * 2) {
+                capacity *= 2;
+            }
+            _slots.resize(capacity);
+            _next.resize(nItems, None);
+        }
+
+        // 'equals(a, b)' compares the keys of two items
+        template <typename Equals>
+        void insert(uint32_t item, uint64_t hash, Equals equals) {
+            const size_t mask = _slots.size() - 1;
+            for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+                Group& group = _slots[i];
+                if (group.size == 0) {
+                    group = { hash, item, item, 1 };
+                    return;
+                }
+                if (group.hash == hash && equals(group.first, item)) {
+                    _next[group.last] = item;
+                    group.last = item;
+                    ++group.size;
+                    return;
+                }
+            }
+        }
+
+        const std::vector<Group>& slots() const {
+            return _slots;
+        }
+
+        uint32_t next(uint32_t item) const {
+            return _next[item];
+        }
+
+    private:
+        std::vector<Group> _slots;
+        std::vector<uint32_t> _next;
+    };
+
+    // Seeds that keep title and author shingles apart, so that an author called 'Graph'
+    // does not match a title word
+    constexpr uint64_t TitleSeed = 0x7469746c65ull;
+    constexpr uint64_t AuthorSeed = 0x617574686f72ull;
+
+    // Word pairs of the folded title, so that the order of the words matters, and single
+    // words of the folded authors, so that 'Last, First' and 'First Last' are the same
+    std::vector<uint64_t> shinglesOf(const Entry& entry) {
+        std::vector<uint64_t> shingles;
+
+        const std::string title = foldText(entry[Keyword::Title]);
+        std::string_view previous;
+        size_t begin = 0;
+        while (begin < title.size()) {
+            const size_t end = std::min(title.find(' ', begin), title.size());
+            if (!previous.empty()) {
+                // Both words are adjacent in 'title', so the pair is a single view
+                const std::string_view pair(
+                    previous.data(),
+                    title.data() + end - previous.data()
+                );
+                shingles.push_back(hash64(pair, TitleSeed));
+            }
+            previous = std::string_view(title.data() + begin, end - begin);
+            begin = end + 1;
+        }
+        if (shingles.empty()) {
+            if (previous.empty()) {
+                // The authors alone are not enough, as they have written more than one
+                // entry in most bibliographies
+                return shingles;
+            }
+            // A title with a single word is still better than none
+            shingles.push_back(hash64(previous, TitleSeed));
+        }
+
+        const std::string author = foldText(entry[Keyword::Author]);
+        begin = 0;
+        while (begin < author.size()) {
+            const size_t end = std::min(author.find(' ', begin), author.size());
+            const std::string_view word(author.data() + begin, end - begin);
+            if (word != "and" && word != "others") {
+                shingles.push_back(hash64(word, AuthorSeed));
+            }
+            begin = end + 1;
+        }
+
+        std::sort(shingles.begin(), shingles.end());
+        shingles.erase(std::unique(shingles.begin(), shingles.end()), shingles.end());
+        return shingles;
+    }
+
+    // The finalizer of SplitMix64, which is used to derive the seeds of the MinHash
+    // functions
+    uint64_t mix(uint64_t value) {
+        value ^= value >> 30;
+        value *= 0xbf58476d1ce4e5b9ull;
+        value ^= value >> 27;
+        value *= 0x94d049bb133111ebull;
+        value ^= value >> 31;
+        return value;
+    }
+
+    double jaccard(const std::vector<uint64_t>& lhs, const std::vector<uint64_t>& rhs) {
+        size_t nShared = 0;
+        auto l = lhs.begin();
+        auto r = rhs.begin();
+        while (l != lhs.end() && r != rhs.end()) {
+            if (*l < *r) {
+                ++l;
+            }
+            else if (*r < *l) {
+                ++r;
+            }
+            else {
+                ++nShared;
+                ++l;
+                ++r;
+            }
+        }
+        return double(nShared) / double(lhs.size() + rhs.size() - nShared);
+    }
+
+    // Joins items into groups, each of which remembers the lowest similarity of the
+    // pairs that joined it. The root of a group is always its smallest item
+    class SimilarityGroups {
+    public:
+        explicit SimilarityGroups(size_t nItems)
+            : _parents(nItems)
+            , _lowest(nItems, 1.0)
+        {
+            for (size_t i = 0; i < nItems; ++i) {
+                _parents[i] = static_cast<uint32_t>(i);
+            }
+        }
+
+        uint32_t root(uint32_t item) {
+            while (_parents[item] != item) {
+                // Path halving keeps the trees flat
+                _parents[item] = _parents[_parents[item]];
+                item = _parents[item];
+            }
+            return item;
+        }
+
+        void join(uint32_t a, uint32_t b, double similarity) {
+            a = root(a);
+            b = root(b);
+            if (b < a) {
+                std::swap(a, b);
+            }
+            if (a != b) {
+                _parents[b] = a;
+                _lowest[a] = std::min(_lowest[a], _lowest[b]);
+            }
+            _lowest[a] = std::min(_lowest[a], similarity);
+        }
+
+        double lowest(uint32_t root) const {
+            return _lowest[root];
+        }
+
+    private:
+        std::vector<uint32_t> _parents;
+        std::vector<double> _lowest;
+    };
+} // namespace
+
+std::string normalizeDoi(std::string_view doi) {
+    const size_t begin = doi.find_first_not_of(" \t\r\n");
+    if (begin == std::string_view::npos) {
+        return std::string();
+    }
+    doi = doi.substr(begin, doi.find_last_not_of(" \t\r\n") - begin + 1);
+
+    constexpr std::string_view Prefixes[] = {
+        "https://doi.org/", "http://doi.org/", "https://dx.doi.org/",
+        "http://dx.doi.org/", "doi:"
+    };
+    for (std::string_view prefix : Prefixes) {
+        if (startsWithIgnoreCase(doi, prefix)) {
+            doi.remove_prefix(prefix.size());
+            break;
+        }
+    }
+
+    std::string result(doi);
+    std::transform(result.begin(), result.end(), result.begin(), toLower);
+    return result;
+}
+
+std::vector<EntryKeys> collectKeys(std::string_view source,
+                                   const std::vector<ParseResult>& results,
+                                   bool collectsShingles)
+{
+    std::vector<EntryKeys> keys;
+    size_t line = 1;
+    size_t lineCountedUntil = 0;
+    for (const ParseResult& result : results) {
+        for (const Block& block : result.blocks) {
+            if (block.entryIndex == Block::NoEntry) {
+                continue;
+            }
+            const Entry& entry = result.entries[block.entryIndex];
+            const size_t offset = block.text.data() - source.data();
+            line += std::count(
+                source.begin() + lineCountedUntil,
+                source.begin() + offset,
+                '\n'
+            );
+            lineCountedUntil = offset;
+            keys.push_back({
+                std::string(entry.citeKey),
+                normalizeDoi(entry[Keyword::Doi]),
+                line,
+                collectsShingles ? shinglesOf(entry) : std::vector<uint64_t>()
+            });
+        }
+    }
+    return keys;
+}
+
+std::vector<DuplicateGroup> findDuplicates(
+    const std::vector<std::vector<EntryKeys>>& files)
+{
+    // All entries of all files are numbered consecutively
+    std::vector<DuplicateGroup::Member> items;
+    for (size_t file = 0; file < files.size(); ++file) {
+        for (size_t entry = 0; entry < files[file].size(); ++entry) {
+            items.push_back({ file, entry });
+        }
+    }
+    auto keysOf = [&](uint32_t item) -> const EntryKeys& {
+        return files[items[item].file][items[item].entry];
+    };
+
+    GroupIndex citeKeys(items.size());
+    GroupIndex dois(items.size());
+    std::string folded;
+    for (uint32_t item = 0; item < items.size(); ++item) {
+        const EntryKeys& keys = keysOf(item);
+        if (!keys.citeKey.empty()) {
+            folded.assign(keys.citeKey);
+            std::transform(folded.begin(), folded.end(), folded.begin(), toLower);
+            citeKeys.insert(item, hash64(folded), [&](uint32_t a, uint32_t b) {
+                const std::string& lhs = keysOf(a).citeKey;
+                const std::string& rhs = keysOf(b).citeKey;
+                return std::equal(
+                    lhs.begin(), lhs.end(),
+                    rhs.begin(), rhs.end(),
+                    [](char l, char r) { return toLower(l) == toLower(r); }
+                );
+            });
+        }
+        if (!keys.doi.empty()) {
+            dois.insert(item, hash64(keys.doi), [&](uint32_t a, uint32_t b) {
+                return keysOf(a).doi == keysOf(b).doi;
+            });
+        }
+    }
+
+    std::vector<DuplicateGroup> groups;
+    auto addGroups = [&](const GroupIndex& index, DuplicateGroup::Kind kind) {
+        const size_t firstGroup = groups.size();
+        for (const GroupIndex::Group& group : index.slots()) {
+            if (group.size < 2) {
+                continue;
+            }
+            DuplicateGroup& g = groups.emplace_back();
+            g.kind = kind;
+            g.members.reserve(group.size);
+            for (uint32_t i = group.first; i != GroupIndex::None; i = index.next(i)) {
+                g.members.push_back(items[i]);
+            }
+        }
+        // The slots are in hash order, but the report should be in file order
+        std::sort(
+            groups.begin() + firstGroup,
+            groups.end(),
+            [](const DuplicateGroup& lhs, const DuplicateGroup& rhs) {
+                const DuplicateGroup::Member& l = lhs.members.front();
+                const DuplicateGroup::Member& r = rhs.members.front();
+                return l.file != r.file ? l.file < r.file : l.entry < r.entry;
+            }
+        );
+    };
+    addGroups(citeKeys, DuplicateGroup::Kind::CiteKey);
+    addGroups(dois, DuplicateGroup::Kind::Doi);
+    return groups;
+}
+
+void writeDuplicates(std::ostream& stream, const std::vector<DuplicateGroup>& groups,
+                     const std::vector<std::vector<EntryKeys>>& files,
+                     const std::vector<std::string>& paths)
+{
+    for (const DuplicateGroup& group : groups) {
+        const EntryKeys& first = files[group.members[0].file][group.members[0].entry];
+        if (group.kind == DuplicateGroup::Kind::CiteKey) {
+            stream << "Duplicate key: " << first.citeKey << '\n';
+        }
+        else {
+            stream << "Duplicate DOI: " << first.doi << '\n';
+        }
+
+        for (const DuplicateGroup::Member& member : group.members) {
+            const EntryKeys& keys = files[member.file][member.entry];
+            stream << "    " << paths[member.file] << " line " << keys.line;
+            if (group.kind == DuplicateGroup::Kind::Doi) {
+                stream << ": " << keys.citeKey;
+            }
+            stream << '\n';
+        }
+        stream << '\n' << '\n';
+    }
+}
+
+std::vector<NearDuplicateGroup> findNearDuplicates(
+    const std::vector<std::vector<EntryKeys>>& files, double threshold)
+{
+    // The signature of an entry is the minimum of each of the NHashes hash functions over
+    // its shingles. Two signatures agree in a row with a probability that is equal to the
+    // Jaccard similarity of the shingles
+    constexpr size_t NHashes = 64;
+
+    // The signature is cut into 'nBands' bands of 'nRows' rows, and entries that agree in
+    // all rows of at least one band become candidates, which happens with a probability
+    // of 1 - (1 - s^nRows)^nBands for a similarity 's'. Longer bands produce fewer false
+    // candidates, so use the longest ones that still find 99% of the pairs that are
+    // exactly at the threshold
+    size_t nRows = 1;
+    for (size_t rows = NHashes; rows > 1; --rows) {
+        const double nBands = double(NHashes / rows);
+        if (1.0 - std::pow(1.0 - std::pow(threshold, double(rows)), nBands) >= 0.99) {
+            nRows = rows;
+            break;
+        }
+    }
+    const size_t nBands = NHashes / nRows;
+
+    // Entries without any shingles have nothing to compare
+    std::vector<DuplicateGroup::Member> items;
+    for (size_t file = 0; file < files.size(); ++file) {
+        for (size_t entry = 0; entry < files[file].size(); ++entry) {
+            if (!files[file][entry].shingles.empty()) {
+                items.push_back({ file, entry });
+            }
+        }
+    }
+    auto shinglesOf = [&](uint32_t item) -> const std::vector<uint64_t>& {
+        return files[items[item].file][items[item].entry].shingles;
+    };
+
+    // Entries with the same shingles, such as the many that are only titled 'Editorial',
+    // would share every bucket and all of their pairs would be compared and reported.
+    // They are joined into one group right away and only the first of them is bucketed
+    SimilarityGroups groups(items.size());
+    std::vector<uint32_t> representatives;
+    {
+        GroupIndex identical(items.size());
+        for (uint32_t item = 0; item < items.size(); ++item) {
+            const std::vector<uint64_t>& shingles = shinglesOf(item);
+            const std::string_view bytes(
+                reinterpret_cast<const char*>(shingles.data()),
+                shingles.size() * sizeof(uint64_t)
+            );
+            identical.insert(item, hash64(bytes), [&](uint32_t a, uint32_t b) {
+                return shinglesOf(a) == shinglesOf(b);
+            });
+        }
+        for (const GroupIndex::Group& group : identical.slots()) {
+            if (group.size == 0) {
+                continue;
+            }
+            representatives.push_back(group.first);
+            for (uint32_t i = identical.next(group.first); i != GroupIndex::None;
+                 i = identical.next(i))
+            {
+                groups.join(group.first, i, 1.0);
+            }
+        }
+        // Keep the candidates in file order
+        std::sort(representatives.begin(), representatives.end());
+    }
+    const size_t nRepresentatives = representatives.size();
+
+    // The shingles are already hashes, so a bijection per function that scrambles the
+    // high bits is enough, which is a single multiplication with an odd number
+    uint64_t seeds[NHashes];
+    uint64_t multipliers[NHashes];
+    for (size_t i = 0; i < NHashes; ++i) {
+        seeds[i] = mix(2 * i + 1);
+        multipliers[i] = mix(2 * i + 2) | 1;
+    }
+
+    // The band hashes of all representatives, band by band
+    std::vector<uint64_t> bandHashes(nBands * nRepresentatives);
+    std::vector<uint32_t> sizes(nRepresentatives);
+    uint64_t signature[NHashes];
+    for (uint32_t r = 0; r < nRepresentatives; ++r) {
+        const std::vector<uint64_t>& shingles = shinglesOf(representatives[r]);
+        sizes[r] = static_cast<uint32_t>(shingles.size());
+        std::fill(std::begin(signature), std::end(signature), UINT64_MAX);
+        for (uint64_t shingle : shingles) {
+            for (size_t i = 0; i < NHashes; ++i) {
+                signature[i] =
+                    std::min(signature[i], (shingle ^ seeds[i]) * multipliers[i]);
+            }
+        }
+        for (size_t band = 0; band < nBands; ++band) {
+            const std::string_view rows(
+                reinterpret_cast<const char*>(signature + band * nRows),
+                nRows * sizeof(uint64_t)
+            );
+            bandHashes[band * nRepresentatives + r] = hash64(rows, band);
+        }
+    }
+
+    // Every pair of representatives that shares a bucket in any band is a candidate,
+    // stored as 'first << 32 | second' so that pairs found in several bands can be
+    // removed by sorting
+    std::vector<uint64_t> candidates;
+    std::vector<uint32_t> bucket;
+    for (size_t band = 0; band < nBands; ++band) {
+        const uint64_t* hashes = bandHashes.data() + band * nRepresentatives;
+        GroupIndex index(nRepresentatives);
+        for (uint32_t r = 0; r < nRepresentatives; ++r) {
+            index.insert(r, hashes[r], [hashes](uint32_t a, uint32_t b) {
+                return hashes[a] == hashes[b];
+            });
+        }
+        for (const GroupIndex::Group& group : index.slots()) {
+            if (group.size < 2) {
+                continue;
+            }
+            bucket.clear();
+            for (uint32_t i = group.first; i != GroupIndex::None; i = index.next(i)) {
+                bucket.push_back(i);
+            }
+            // Items are inserted in increasing order, so every pair is already ordered
+            for (size_t i = 0; i < bucket.size(); ++i) {
+                for (size_t j = i + 1; j < bucket.size(); ++j) {
+                    candidates.push_back(uint64_t(bucket[i]) << 32 | bucket[j]);
+                }
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    // Candidates are only likely to be similar, so verify them with the exact similarity
+    for (uint64_t candidate : candidates) {
+        const uint32_t first = uint32_t(candidate >> 32);
+        const uint32_t second = uint32_t(candidate);
+        // The similarity can't be larger than the ratio of the sizes, which rules out
+        // many candidates without touching their shingles
+        const double smaller = std::min(sizes[first], sizes[second]);
+        const double larger = std::max(sizes[first], sizes[second]);
+        if (smaller < threshold * larger) {
+            continue;
+        }
+        const uint32_t lhs = representatives[first];
+        const uint32_t rhs = representatives[second];
+        const double similarity = jaccard(shinglesOf(lhs), shinglesOf(rhs));
+        if (similarity >= threshold) {
+            groups.join(lhs, rhs, similarity);
+        }
+    }
+
+    // The root of every group is its first item, so visiting the items in file order
+    // creates the groups in file order as well
+    std::vector<uint32_t> groupSizes(items.size());
+    for (uint32_t item = 0; item < items.size(); ++item) {
+        ++groupSizes[groups.root(item)];
+    }
+    std::vector<NearDuplicateGroup> result;
+    std::vector<uint32_t> groupIndices(items.size(), GroupIndex::None);
+    for (uint32_t item = 0; item < items.size(); ++item) {
+        const uint32_t root = groups.root(item);
+        if (groupSizes[root] < 2) {
+            continue;
+        }
+        if (groupIndices[root] == GroupIndex::None) {
+            groupIndices[root] = static_cast<uint32_t>(result.size());
+            NearDuplicateGroup& group = result.emplace_back();
+            group.similarity = groups.lowest(root);
+            group.members.reserve(groupSizes[root]);
+        }
+        result[groupIndices[root]].members.push_back(items[item]);
+    }
+    return result;
+}
+
+void writeNearDuplicates(std::ostream& stream,
+                         const std::vector<NearDuplicateGroup>& groups,
+                         const std::vector<std::vector<EntryKeys>>& files,
+                         const std::vector<std::string>& paths)
+{
+    for (const NearDuplicateGroup& group : groups) {
+        const long percent = std::lround(group.similarity * 100.0);
+        stream << "Similar entries (" << percent << "%):\n";
+        for (const DuplicateGroup::Member& member : group.members) {
+            const EntryKeys& keys = files[member.file][member.entry];
+            stream << "    " << paths[member.file] << " line " << keys.line << ": "
+                   << keys.citeKey << '\n';
+        }
+        stream << '\n' << '\n';
+    }
+}
@@ -0,0 +1,123 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___DUPLICATES___H__
+#define __BIBTEXFORMAT___DUPLICATES___H__
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ParseResult;
+
+// The identifying parts of one entry. They are copied out of the source, so that they
+// remain valid after the file has been closed
+struct EntryKeys {
+    std::string citeKey;
+    std::string doi;    // Normalized with normalizeDoi, empty if there is none
+    size_t line;        // Line of the '@' of the entry
+
+    // Sorted hashes of the word pairs of the folded title and of the folded author
+    // names, see foldText. Empty for entries without a title and if the keys were
+    // collected without shingles
+    std::vector<uint64_t> shingles;
+};
+
+// Lower case DOI without surrounding whitespace and without a resolver prefix such as
+// 'https://doi.org/' or 'doi:', as DOIs are case-insensitive
+std::string normalizeDoi(std::string_view doi);
+
+// Collects the keys of all entries of one file in file order. The shingles are only
+// computed if 'collectsShingles' is true, as they are the expensive part
+std::vector<EntryKeys> collectKeys(std::string_view source,
+                                   const std::vector<ParseResult>& results,
+                                   bool collectsShingles = false);
+
+// A cite key or DOI that is used by more than one entry
+struct DuplicateGroup {
+    enum class Kind {
+        CiteKey,
+        Doi
+    };
+
+    struct Member {
+        size_t file;    // Index into the list of files that was searched
+        size_t entry;   // Index into the keys of that file
+    };
+
+    Kind kind;
+    std::vector<Member> members;
+};
+
+// Finds all cite keys and DOIs that occur more than once in any of the files, where
+// 'files[i]' are the keys of the i-th file. Cite keys are compared case-insensitively,
+// like BibTeX does. This takes linear time in the total number of entries. The groups
+// are ordered by their first member, cite keys before DOIs
+std::vector<DuplicateGroup> findDuplicates(
+    const std::vector<std::vector<EntryKeys>>& files);
+
+// Writes every group with the locations of all of its members
+void writeDuplicates(std::ostream& stream, const std::vector<DuplicateGroup>& groups,
+                     const std::vector<std::vector<EntryKeys>>& files,
+                     const std::vector<std::string>& paths);
+
+// Entries whose shingles are similar, but that do not necessarily share a key. Every
+// member is similar to at least one other member of the group, so in larger groups not
+// all members have to be similar to each other
+struct NearDuplicateGroup {
+    std::vector<DuplicateGroup::Member> members;
+    // The lowest Jaccard similarity in [0, 1] of the pairs that joined the group
+    double similarity;
+};
+
+// Finds all groups of entries whose shingles have a Jaccard similarity of at least
+// 'threshold', which has to be in (0, 1]. Entries with identical shingles are grouped
+// first, in linear time. Candidates among the remaining distinct entries are found by
+// bucketing MinHash signatures with locality-sensitive hashing, which takes linear time
+// in the total number of entries plus the number of candidates, and are then verified
+// with the exact similarity. Pairs that the bucketing misses are possible, but rare for
+// any pair that is above the threshold. The groups are ordered by their first member and
+// their members are in file order
+std::vector<NearDuplicateGroup> findNearDuplicates(
+    const std::vector<std::vector<EntryKeys>>& files, double threshold);
+
+// Writes every group with the locations and cite keys of its entries
+void writeNearDuplicates(std::ostream& stream,
+                         const std::vector<NearDuplicateGroup>& groups,
+                         const std::vector<std::vector<EntryKeys>>& files,
+                         const std::vector<std::string>& paths);
+
+#endif // __BIBTEXFORMAT___DUPLICATES___H__
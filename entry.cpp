@@ -0,0 +1,113 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "entry.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+namespace {
+    int bitCount(KeywordMask mask) {
+#ifdef _MSC_VER
+        return static_cast<int>(__popcnt(mask));
+#else // ^^^^ _MSC_VER // !_MSC_VER vvvv
+        return __builtin_popcount(mask);
+#endif // _MSC_VER
+    }
+} // namespace
+
+std::string_view Entry::operator[](Keyword keyword) const {
+    return has(keyword) ? _fields[slotOf(keyword)].value : std::string_view();
+}
+
+bool Entry::has(Keyword keyword) const {
+    return (_mask & maskOf(keyword)) != 0;
+}
+
+const Field* Entry::field(Keyword keyword) const {
+    return has(keyword) ? &_fields[slotOf(keyword)] : nullptr;
+}
+
+bool Entry::set(Keyword keyword, std::string_view key, std::string_view value,
+                bool isExpression, uint32_t valueId)
+{
+    if (keyword == Keyword::Unknown || has(keyword)) {
+        _fields.push_back({ key, value, isExpression, valueId });
+        return keyword == Keyword::Unknown;
+    }
+
+    const size_t slot = slotOf(keyword);
+    _fields.insert(_fields.begin() + slot, { key, value, isExpression, valueId });
+    _mask |= maskOf(keyword);
+    return true;
+}
+
+void Entry::reserve(size_t nFields) {
+    _fields.reserve(nFields);
+}
+
+KeywordMask Entry::keywordMask() const {
+    return _mask;
+}
+
+KeywordMask Entry::filledKeywordMask() const {
+    // The dense slots are in the order of the set bits
+    KeywordMask filled = _mask;
+    KeywordMask remaining = _mask;
+    for (size_t slot = 0; remaining != 0; ++slot) {
+        const KeywordMask bit = remaining & (~remaining + 1);
+        if (_fields[slot].value.empty()) {
+            filled &= ~bit;
+        }
+        remaining &= ~bit;
+    }
+    return filled;
+}
+
+const std::vector<Field>& Entry::fields() const {
+    return _fields;
+}
+
+const Field* Entry::extraFieldsBegin() const {
+    return _fields.data() + bitCount(_mask);
+}
+
+const Field* Entry::extraFieldsEnd() const {
+    return _fields.data() + _fields.size();
+}
+
+size_t Entry::slotOf(Keyword keyword) const {
+    return bitCount(_mask & (maskOf(keyword) - 1));
+}
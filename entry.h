@@ -0,0 +1,342 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___ENTRY___H__
+#define __BIBTEXFORMAT___ENTRY___H__
+
+#include "perfecthash.h"
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+#include <vector>
+
+enum class Type {
+    Unknown = -1,
+    Article = 0,
+    Book,
+    Booklet,
+    InBook,
+    InCollection,
+    InProceedings,
+    Manual,
+    MastersThesis,
+    Misc,
+    PhDThesis,
+    Proceedings,
+    TechReport,
+    Unpublished
+};
+
+constexpr int NumTypes = static_cast<int>(Type::Unpublished) + 1;
+
+namespace detail {
+    // 'conference' is an alias for 'inproceedings'
+    constexpr std::array<std::string_view, NumTypes + 1> TypeNames = {
+        "article", "book", "booklet", "inbook", "incollection", "inproceedings",
+        "manual", "mastersthesis", "misc", "phdthesis", "proceedings", "techreport",
+        "unpublished", "conference"
+    };
+
+    constexpr PerfectHash<TypeNames.size(), 32> TypeHash(TypeNames);
+} // namespace detail
+
+// Case-insensitive lookup of the entry type
+constexpr Type typeFromString(std::string_view type) {
+    const int index = detail::TypeHash.find(type);
+    if (index == -1) {
+        return Type::Unknown;
+    }
+    return index == NumTypes ? Type::InProceedings : static_cast<Type>(index);
+}
+
+// Returns the canonical lower case name of the type or an empty view for Type::Unknown
+constexpr std::string_view typeName(Type type) {
+    return type == Type::Unknown ? std::string_view() :
+                                   detail::TypeNames[static_cast<int>(type)];
+}
+
+enum class Keyword {
+    Unknown = -1,
+    Address = 0,
+    Author,
+    BookTitle,
+    Chapter,
+    Doi,
+    Edition,
+    Editor,
+    Institution,
+    Journal,
+    HowPublished,
+    Key,
+    Month,
+    Note,
+    Number,
+    Organization,
+    Pages,
+    Publisher,
+    School,
+    Series,
+    Title,
+    Type,
+    Url,
+    Volume,
+    Year
+};
+
+// Number of valid keywords, which all fit into the bits of a KeywordMask
+constexpr int NumKeywords = static_cast<int>(Keyword::Year) + 1;
+using KeywordMask = uint32_t;
+static_assert(NumKeywords <= 32, "Too many keywords for the KeywordMask");
+
+// Keyword::Unknown has an empty mask, so it is never part of any set of keywords
+constexpr KeywordMask maskOf(Keyword keyword) {
+    return keyword == Keyword::Unknown ? 0 : KeywordMask(1) << static_cast<int>(keyword);
+}
+
+namespace detail {
+    constexpr std::array<std::string_view, NumKeywords> KeywordNames = {
+        "address", "author", "booktitle", "chapter", "doi", "edition", "editor",
+        "institution", "journal", "howpublished", "key", "month", "note", "number",
+        "organization", "pages", "publisher", "school", "series", "title", "type", "url",
+        "volume", "year"
+    };
+
+    constexpr PerfectHash<KeywordNames.size(), 64> KeywordHash(KeywordNames);
+} // namespace detail
+
+// Case-insensitive lookup of a field name
+constexpr Keyword keywordFromString(std::string_view keyword) {
+    return static_cast<Keyword>(detail::KeywordHash.find(keyword));
+}
+
+// Returns the canonical lower case name of the keyword or an empty view for
+// Keyword::Unknown
+constexpr std::string_view keywordName(Keyword keyword) {
+    return keyword == Keyword::Unknown ? std::string_view() :
+                                         detail::KeywordNames[static_cast<int>(keyword)];
+}
+
+// The keywords that are accepted for one entry type, in the order in which they should
+// appear in an entry, together with the bitmask of the same keywords
+struct KeywordList {
+    constexpr KeywordList(std::initializer_list<Keyword> list) {
+        for (Keyword keyword : list) {
+            add(keyword);
+        }
+    }
+
+    // Keywords that are already in the list or unknown are ignored
+    constexpr void add(Keyword keyword) {
+        if (keyword != Keyword::Unknown && (mask & maskOf(keyword)) == 0) {
+            keywords[size++] = keyword;
+            mask |= maskOf(keyword);
+        }
+    }
+
+    constexpr const Keyword* begin() const { return keywords.data(); }
+    constexpr const Keyword* end() const { return keywords.data() + size; }
+
+    std::array<Keyword, NumKeywords> keywords = {};
+    size_t size = 0;
+    KeywordMask mask = 0;
+};
+
+// Indexed by Type
+inline constexpr std::array<KeywordList, NumTypes> AcceptedKeywords = {{
+    // Type::Article
+    {
+        Keyword::Author, Keyword::Title,  Keyword::Journal, Keyword::Year,
+        Keyword::Volume, Keyword::Number, Keyword::Pages,   Keyword::Month,
+        Keyword::Note,   Keyword::Key,    Keyword::Doi
+    },
+    // Type::Book
+    {
+        Keyword::Title,   Keyword::Publisher, Keyword::Year,   Keyword::Author,
+        Keyword::Editor,  Keyword::Volume,    Keyword::Number, Keyword::Series,
+        Keyword::Address, Keyword::Edition,   Keyword::Month,  Keyword::Note,
+        Keyword::Key,     Keyword::Url,       Keyword::Doi
+    },
+    // Type::Booklet
+    {
+        Keyword::Title, Keyword::Author, Keyword::HowPublished, Keyword::Address,
+        Keyword::Month, Keyword::Year,   Keyword::Note,         Keyword::Key,
+        Keyword::Doi
+    },
+    // Type::InBook
+    {
+        Keyword::Title,     Keyword::Publisher, Keyword::Year,  Keyword::Author,
+        Keyword::Editor,    Keyword::Chapter,   Keyword::Pages, Keyword::Volume,
+        Keyword::Number,    Keyword::Series,    Keyword::Type,  Keyword::Address,
+        Keyword::Edition,   Keyword::Month,     Keyword::Note,  Keyword::Key,
+        Keyword::Doi
+    },
+    // Type::InCollection
+    {
+        Keyword::Author,  Keyword::Title,   Keyword::BookTitle, Keyword::Publisher,
+        Keyword::Year,    Keyword::Editor,  Keyword::Volume,    Keyword::Number,
+        Keyword::Series,  Keyword::Type,    Keyword::Chapter,   Keyword::Pages,
+        Keyword::Address, Keyword::Edition, Keyword::Month,     Keyword::Note,
+        Keyword::Key,     Keyword::Doi
+    },
+    // Type::InProceedings
+    {
+        Keyword::Author,    Keyword::Title,   Keyword::BookTitle, Keyword::Year,
+        Keyword::Editor,    Keyword::Volume,  Keyword::Number,    Keyword::Series,
+        Keyword::Pages,     Keyword::Address, Keyword::Month,   Keyword::Organization,
+        Keyword::Publisher, Keyword::Note,    Keyword::Key,       Keyword::Doi
+    },
+    // Type::Manual
+    {
+        Keyword::Title,   Keyword::Author, Keyword::Organization, Keyword::Address,
+        Keyword::Edition, Keyword::Month,  Keyword::Year,         Keyword::Note,
+        Keyword::Key,     Keyword::Doi
+    },
+    // Type::MastersThesis
+    {
+        Keyword::Author, Keyword::Title,   Keyword::School, Keyword::Year,
+        Keyword::Type,   Keyword::Address, Keyword::Month,  Keyword::Note,
+        Keyword::Key,    Keyword::Doi
+    },
+    // Type::Misc
+    {
+        Keyword::Author, Keyword::Title, Keyword::HowPublished, Keyword::Month,
+        Keyword::Year,   Keyword::Note,  Keyword::Key,          Keyword::Doi
+    },
+    // Type::PhDThesis
+    {
+        Keyword::Author, Keyword::Title, Keyword::School, Keyword::Year,
+        Keyword::Type,   Keyword::Address, Keyword::Month,  Keyword::Note,
+        Keyword::Key,    Keyword::Doi
+    },
+    // Type::Proceedings
+    {
+        Keyword::Title,    Keyword::Year,          Keyword::Editor,  Keyword::Volume,
+        Keyword::Number,    Keyword::Series,       Keyword::Address, Keyword::Month,
+        Keyword::Publisher, Keyword::Organization, Keyword::Note,    Keyword::Key,
+        Keyword::Doi
+    },
+    // Type::TechReport
+    {
+        Keyword::Author, Keyword::Title,  Keyword::Institution, Keyword::Year,
+        Keyword::Type,   Keyword::Number, Keyword::Address,     Keyword::Month,
+        Keyword::Note,   Keyword::Key,    Keyword::Doi
+    },
+    // Type::Unpublished
+    {
+        Keyword::Author, Keyword::Title, Keyword::Note, Keyword::Month,
+        Keyword::Year,   Keyword::Key,   Keyword::Doi
+    }
+}};
+
+// Returns the mask of keywords that are accepted for the type. Unknown types don't
+// accept any keyword
+constexpr KeywordMask acceptedKeywordMask(Type type) {
+    return type == Type::Unknown ? 0 : AcceptedKeywords[static_cast<int>(type)].mask;
+}
+
+static_assert(typeFromString("Article") == Type::Article);
+static_assert(typeFromString("CONFERENCE") == Type::InProceedings);
+static_assert(typeFromString("articles") == Type::Unknown);
+static_assert(keywordFromString("HowPublished") == Keyword::HowPublished);
+static_assert(keywordFromString("titel") == Keyword::Unknown);
+static_assert(acceptedKeywordMask(Type::Article) & maskOf(Keyword::Journal));
+
+// Fields whose values repeat across many entries, as most entries were published in one
+// of a few venues. The parser can intern them, see ParseOptions::venues
+constexpr KeywordMask VenueKeywords =
+    maskOf(Keyword::Address) | maskOf(Keyword::BookTitle) | maskOf(Keyword::Journal) |
+    maskOf(Keyword::Organization) | maskOf(Keyword::Publisher) | maskOf(Keyword::School);
+
+constexpr uint32_t NoStringId = ~uint32_t(0);
+
+struct Field {
+    std::string_view key;
+    std::string_view value;
+    // The value is a macro or a '#' concatenation and is stored as it was written
+    bool isExpression = false;
+    // The id of the value in a StringPool if it was interned. Fits into the padding
+    uint32_t valueId = NoStringId;
+};
+
+// An entry stores only the fields that are actually present. The known keywords live in
+// dense slots that are sorted by their Keyword; which slots exist is recorded in a
+// bitmask, so the slot of a keyword is the number of set bits below its own bit. Fields
+// with a name that is not a Keyword are kept in the same vector after the dense slots
+class Entry {
+public:
+    // Returns an empty view if the keyword is not set
+    std::string_view operator[](Keyword keyword) const;
+
+    bool has(Keyword keyword) const;
+
+    // Returns nullptr if the keyword is not set
+    const Field* field(Keyword keyword) const;
+
+    // Sets the value for the keyword. Unknown keywords are stored as extra fields using
+    // the 'key' as their name. Like BibTeX, the first value of a keyword is the one that
+    // counts; a repeated keyword is kept as an extra field, so that it is not lost when
+    // the entry is written, and false is returned
+    bool set(Keyword keyword, std::string_view key, std::string_view value,
+             bool isExpression = false, uint32_t valueId = NoStringId);
+
+    // Preallocates space for the provided number of fields
+    void reserve(size_t nFields);
+
+    // Bitmask of all Keywords that are present in this entry
+    KeywordMask keywordMask() const;
+
+    // Bitmask of the Keywords that are present and whose value is not empty
+    KeywordMask filledKeywordMask() const;
+
+    // All fields in the order of their Keyword, followed by the extra fields
+    const std::vector<Field>& fields() const;
+
+    // Only the fields whose name is not a known Keyword or that repeat a Keyword, in the
+    // order they were added
+    const Field* extraFieldsBegin() const;
+    const Field* extraFieldsEnd() const;
+
+    std::string_view citeKey;
+    Type entryType = Type::Unknown;
+
+private:
+    size_t slotOf(Keyword keyword) const;
+
+    KeywordMask _mask = 0;
+    std::vector<Field> _fields;
+};
+
+#endif // __BIBTEXFORMAT___ENTRY___H__
@@ -0,0 +1,112 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "events.h"
+
+bool ParseHandler::beginEntry(const EntryEvent&) {
+    return true;
+}
+
+bool ParseHandler::field(const EntryEvent&, const FieldEvent&) {
+    return true;
+}
+
+void ParseHandler::endEntry(const EntryEvent&, LexError, size_t) {}
+
+void parseEvents(std::string_view source, ParseHandler& handler) {
+    parseEvents(source, 0, source.size(), false, handler);
+}
+
+EventRange parseEvents(std::string_view source, size_t begin, size_t limit,
+                       bool isRecovering, ParseHandler& handler)
+{
+    Lexer lexer(source, begin, limit, isRecovering);
+    RawEntry raw;
+    while (lexer.next(raw)) {
+        EntryEvent entry;
+        entry.kind = raw.kind;
+        entry.type = raw.type;
+        entry.begin = raw.begin;
+        entry.end = raw.end;
+        entry.error = raw.error;
+
+        if (raw.error != LexError::None) {
+            handler.beginEntry(entry);
+            handler.endEntry(entry, raw.error, raw.begin);
+            continue;
+        }
+
+        FieldParser parser(raw.body, raw.kind);
+        if (raw.kind == EntryKind::Regular) {
+            entry.entryType = typeFromString(raw.type);
+            entry.citeKey = parser.citeKey();
+        }
+        if (!handler.beginEntry(entry)) {
+            handler.endEntry(entry, LexError::None, 0);
+            continue;
+        }
+
+        RawField rawField;
+        bool wantsFields = true;
+        while (wantsFields && parser.next(rawField)) {
+            FieldEvent field;
+            field.key = rawField.key;
+            field.keyword = keywordFromString(rawField.key);
+            field.value = rawField.contents;
+            field.kind = rawField.kind;
+            wantsFields = handler.field(entry, field);
+        }
+
+        // An error that is found after the handler stopped looking doesn't matter
+        if (wantsFields && parser.error() != LexError::None) {
+            const size_t offset =
+                static_cast<size_t>(parser.errorPosition() - source.data());
+            handler.endEntry(entry, parser.error(), offset);
+        }
+        else {
+            handler.endEntry(entry, LexError::None, 0);
+        }
+    }
+    return { lexer.cursor(), lexer.isRecovering() };
+}
+
+std::string_view joinedValue(std::string_view value, StringArena& arena) {
+    if (!hasRedundantWhitespace(value)) {
+        return value;
+    }
+    char* buffer = arena.allocate(value.size());
+    const size_t size = normalizeWhitespace(value, buffer);
+    return std::string_view(buffer, size);
+}
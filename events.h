@@ -0,0 +1,110 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#ifndef __BIBTEXFORMAT___EVENTS___H__
+#define __BIBTEXFORMAT___EVENTS___H__
+
+#include "entry.h"
+#include "lexer.h"
+#include "stringarena.h"
+
+#include <string_view>
+
+// One '@' block of the source as it is passed to a ParseHandler. All views point into
+// the source
+struct EntryEvent {
+    EntryKind kind = EntryKind::Regular;
+    std::string_view type;         // As written in the source
+    Type entryType = Type::Unknown; // Only for EntryKind::Regular
+    std::string_view citeKey;      // Only for EntryKind::Regular
+
+    size_t begin = 0; // Byte offset of the '@'
+    size_t end = 0;   // Byte offset one past the closing delimiter
+
+    // Set if the block itself could not be lexed. It has no cite key and no fields and
+    // endEntry follows right after beginEntry with the same error
+    LexError error = LexError::None;
+};
+
+struct FieldEvent {
+    std::string_view key;
+    Keyword keyword = Keyword::Unknown;
+
+    // The value without the surrounding "" or {} and exactly as written, so it can
+    // still span multiple lines. normalizeWhitespace turns it into a single line
+    std::string_view value;
+    ValueKind kind = ValueKind::Braced;
+};
+
+// Receives the blocks of a source one by one while it is parsed. Nothing is stored or
+// copied on the way, so a handler only pays for what it keeps. The default
+// implementations accept everything and ignore it
+class ParseHandler {
+public:
+    virtual ~ParseHandler() = default;
+
+    // Called for every '@' block. The fields of the block are only split and reported
+    // if this returns true
+    virtual bool beginEntry(const EntryEvent& entry);
+
+    // Called for every field in the order of the source. @preamble has a single field
+    // without a key and @comment has none. Returning false skips the remaining fields
+    virtual bool field(const EntryEvent& entry, const FieldEvent& field);
+
+    // Called after the last field or right after beginEntry if it returned false.
+    // 'error' is LexError::None unless the block could not be parsed, in which case
+    // 'errorOffset' is the byte offset at which the problem was found
+    virtual void endEntry(const EntryEvent& entry, LexError error, size_t errorOffset);
+};
+
+// Where parseEvents stopped, so that the next range can continue from there
+struct EventRange {
+    size_t end = 0;
+    bool isRecovering = false;
+};
+
+// Pushes all blocks of the source to the handler
+void parseEvents(std::string_view source, ParseHandler& handler);
+
+// Pushes the blocks that start in [begin, limit) of the source to the handler, see the
+// Lexer constructor with the same parameters
+EventRange parseEvents(std::string_view source, size_t begin, size_t limit,
+                       bool isRecovering, ParseHandler& handler);
+
+// Returns the value joined into a single line as it is stored in an Entry. Only values
+// that have to be changed are copied into the arena
+std::string_view joinedValue(std::string_view value, StringArena& arena);
+
+#endif // __BIBTEXFORMAT___EVENTS___H__
@@ -0,0 +1,272 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "extract.h"
+
+#include "entry.h"
+#include "events.h"
+#include "formatter.h"
+#include "mappedfile.h"
+#include "outputbuffer.h"
+#include "parser.h"
+#include "stringarena.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+
+namespace {
+    // LaTeX never nests \@input deeply, this only protects against cycles
+    constexpr int MaxAuxDepth = 16;
+
+    std::string_view trim(std::string_view text) {
+        const size_t begin = text.find_first_not_of(" \t\r\n");
+        if (begin == std::string_view::npos) {
+            return std::string_view();
+        }
+        const size_t end = text.find_last_not_of(" \t\r\n");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    bool equalsIgnoringCase(std::string_view lhs, std::string_view rhs) {
+        return std::equal(
+            lhs.begin(),
+            lhs.end(),
+            rhs.begin(),
+            rhs.end(),
+            [](char a, char b) {
+                return std::tolower(static_cast<unsigned char>(a)) ==
+                       std::tolower(static_cast<unsigned char>(b));
+            }
+        );
+    }
+
+    // The argument of every occurrence of the command in the text, for example the
+    // 'a,b' of '\citation{a,b}'. Arguments can't contain braces in .aux files
+    template <typename F>
+    void forEachArgument(std::string_view text, std::string_view command, F function) {
+        size_t position = text.find(command);
+        while (position != std::string_view::npos) {
+            const size_t begin = position + command.size();
+            const size_t end = text.find('}', begin);
+            if (end == std::string_view::npos) {
+                return;
+            }
+            function(text.substr(begin, end - begin));
+            position = text.find(command, end);
+        }
+    }
+
+    bool readAuxFile(const std::filesystem::path& path, const std::filesystem::path& base,
+                     CitationSet& citations, int depth)
+    {
+        MappedFile file(path.string());
+        if (!file.isValid()) {
+            return false;
+        }
+        std::string_view contents = file.contents();
+
+        forEachArgument(contents, "\\citation{", [&citations](std::string_view keys) {
+            while (!keys.empty()) {
+                const size_t comma = std::min(keys.find(','), keys.size());
+                citations.add(trim(keys.substr(0, comma)));
+                keys.remove_prefix(std::min(comma + 1, keys.size()));
+            }
+        });
+
+        // The included files are relative to the directory in which LaTeX was run, which
+        // is where the main .aux file is. A missing included file is not an error, LaTeX
+        // only creates it once the chapter has been compiled
+        if (depth < MaxAuxDepth) {
+            forEachArgument(contents, "\\@input{", [&](std::string_view name) {
+                readAuxFile(base / std::string(trim(name)), base, citations, depth + 1);
+            });
+        }
+        return true;
+    }
+
+    // Collects the entries that are cited or that are the target of a 'crossref' of a
+    // cited entry. The fields of all other entries are never looked at
+    class ExtractionHandler : public ParseHandler {
+    public:
+        ExtractionHandler(std::string_view source, const CitationSet& citations,
+                          const std::unordered_set<std::string_view>& crossrefTargets,
+                          bool buildsEntries)
+            : _source(source)
+            , _citations(citations)
+            , _crossrefTargets(crossrefTargets)
+            , _buildsEntries(buildsEntries)
+        {}
+
+        bool beginEntry(const EntryEvent& entry) override {
+            std::string_view text = _source.substr(entry.begin, entry.end - entry.begin);
+            if (entry.kind == EntryKind::String || entry.kind == EntryKind::Preamble) {
+                blocks.push_back({ text });
+                return false;
+            }
+
+            // BibTeX uses the first of several entries with the same cite key
+            _isSelected = entry.kind == EntryKind::Regular && !entry.citeKey.empty() &&
+                          found.count(entry.citeKey) == 0 &&
+                          (_citations.citesAll() || _citations.contains(entry.citeKey) ||
+                           _crossrefTargets.count(entry.citeKey) != 0);
+            if (_isSelected) {
+                _entry = Entry();
+                _entry.citeKey = entry.citeKey;
+                _entry.entryType = entry.entryType;
+            }
+            return _isSelected;
+        }
+
+        bool field(const EntryEvent&, const FieldEvent& field) override {
+            if (equalsIgnoringCase(field.key, "crossref")) {
+                crossrefs.push_back(trim(field.value));
+            }
+            if (!_buildsEntries) {
+                return true;
+            }
+
+            const std::string_view value = joinedValue(field.value, arena);
+            const bool isExpression =
+                field.kind == ValueKind::Macro || field.kind == ValueKind::Concatenation;
+            _entry.set(field.keyword, field.key, value, isExpression);
+            return true;
+        }
+
+        void endEntry(const EntryEvent& entry, LexError error, size_t) override {
+            if (!_isSelected) {
+                return;
+            }
+            _isSelected = false;
+            found.insert(entry.citeKey);
+
+            // An entry that could not be parsed is reproduced as it was written
+            std::string_view text = _source.substr(entry.begin, entry.end - entry.begin);
+            if (error != LexError::None || !_buildsEntries) {
+                blocks.push_back({ text });
+            }
+            else {
+                blocks.push_back({ text, entries.size() });
+                entries.push_back(std::move(_entry));
+            }
+        }
+
+        std::vector<Block> blocks;
+        std::vector<Entry> entries;
+        StringArena arena;
+
+        std::unordered_set<std::string_view> found;
+        std::vector<std::string_view> crossrefs;
+
+    private:
+        std::string_view _source;
+        const CitationSet& _citations;
+        const std::unordered_set<std::string_view>& _crossrefTargets;
+        bool _buildsEntries;
+
+        bool _isSelected = false;
+        Entry _entry;
+    };
+} // namespace
+
+bool CitationSet::readAux(const std::string& path) {
+    const std::filesystem::path file = path;
+    return readAuxFile(file, file.parent_path(), *this, 0);
+}
+
+void CitationSet::add(std::string_view citeKey) {
+    if (citeKey == "*") {
+        _citesAll = true;
+    }
+    else if (!citeKey.empty() && !contains(citeKey)) {
+        _set.insert(_keys.emplace_back(citeKey));
+    }
+}
+
+bool CitationSet::contains(std::string_view citeKey) const {
+    return _set.count(citeKey) != 0;
+}
+
+bool CitationSet::citesAll() const {
+    return _citesAll;
+}
+
+const std::deque<std::string>& CitationSet::keys() const {
+    return _keys;
+}
+
+std::vector<std::string> extractCitations(std::string_view source,
+                                          const CitationSet& citations,
+                                          bool shouldFormat, OutputBuffer& output)
+{
+    // A crossref usually points to an entry further down, which has been skipped by the
+    // time the crossref is seen. In that case the source is scanned again with the new
+    // targets, which repeats only as long as crossrefs lead to more entries
+    std::unordered_set<std::string_view> crossrefTargets;
+    while (true) {
+        ExtractionHandler handler(source, citations, crossrefTargets, shouldFormat);
+        parseEvents(source, handler);
+
+        bool hasNewTargets = false;
+        for (std::string_view target : handler.crossrefs) {
+            if (handler.found.count(target) == 0 && !citations.contains(target)) {
+                hasNewTargets |= crossrefTargets.insert(target).second;
+            }
+        }
+        if (hasNewTargets) {
+            continue;
+        }
+
+        Formatter formatter(output);
+        for (const Block& block : handler.blocks) {
+            const bool canFormat = block.entryIndex != Block::NoEntry &&
+                handler.entries[block.entryIndex].entryType != Type::Unknown;
+            if (canFormat) {
+                formatter.write(handler.entries[block.entryIndex]);
+            }
+            else {
+                formatter.writeVerbatim(block.text);
+            }
+        }
+
+        std::vector<std::string> missing;
+        for (const std::string& citeKey : citations.keys()) {
+            if (handler.found.count(citeKey) == 0) {
+                missing.push_back(citeKey);
+            }
+        }
+        return missing;
+    }
+}
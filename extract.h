@@ -0,0 +1,79 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#ifndef __BIBTEXFORMAT___EXTRACT___H__
+#define __BIBTEXFORMAT___EXTRACT___H__
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+class OutputBuffer;
+
+// The cite keys that a LaTeX document uses, in the order in which they are first cited
+class CitationSet {
+public:
+    // Adds the keys of all \citation commands in the .aux file and in the .aux files it
+    // includes with \@input, which LaTeX writes for every \include. Returns false if the
+    // file could not be read
+    bool readAux(const std::string& path);
+
+    void add(std::string_view citeKey);
+    bool contains(std::string_view citeKey) const;
+
+    // \nocite{*} cites every entry of the bibliography
+    bool citesAll() const;
+
+    const std::deque<std::string>& keys() const;
+
+private:
+    // A deque never moves its elements, so the set can refer to them
+    std::deque<std::string> _keys;
+    std::unordered_set<std::string_view> _set;
+    bool _citesAll = false;
+};
+
+// Writes the cited entries of the source and the entries they refer to with 'crossref'
+// in the order of the source, either as they are written or formatted. All @string and
+// @preamble blocks are written as well, as the entries might use them. Entries that are
+// not cited are only scanned, their fields are never split. Returns the cite keys that
+// were not found
+std::vector<std::string> extractCitations(std::string_view source,
+                                          const CitationSet& citations,
+                                          bool shouldFormat, OutputBuffer& output);
+
+#endif // __BIBTEXFORMAT___EXTRACT___H__
@@ -0,0 +1,141 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "formatter.h"
+
+#include "entry.h"
+#include "outputbuffer.h"
+
+#include <algorithm>
+
+namespace {
+    constexpr std::string_view Indentation = "    ";
+
+    bool isWhitespace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    void writeField(OutputBuffer& output, std::string_view name, const Field& field,
+                    size_t width)
+    {
+        output.write(Indentation);
+        output.write(name);
+        output.writeSpaces(width - name.size());
+        output.write(" = ");
+        if (field.isExpression) {
+            output.write(field.value);
+        }
+        else {
+            output.write('{');
+            output.write(field.value);
+            output.write('}');
+        }
+        output.write(",\n");
+    }
+} // namespace
+
+Formatter::Formatter(OutputBuffer& output)
+    : _output(output)
+{}
+
+void Formatter::write(const Entry& entry) {
+    beginBlock();
+
+    _output.write('@');
+    _output.write(typeName(entry.entryType));
+    _output.write('{');
+    _output.write(entry.citeKey);
+
+    if (entry.fields().empty()) {
+        _output.write("}\n");
+        return;
+    }
+    _output.write(",\n");
+
+    const KeywordMask present = entry.keywordMask();
+    const KeywordMask accepted = acceptedKeywordMask(entry.entryType);
+
+    // The '=' of all fields are aligned
+    size_t width = 0;
+    for (int i = 0; i < NumKeywords; ++i) {
+        if (present & maskOf(static_cast<Keyword>(i))) {
+            width = std::max(width, keywordName(static_cast<Keyword>(i)).size());
+        }
+    }
+    for (const Field* f = entry.extraFieldsBegin(); f != entry.extraFieldsEnd(); ++f) {
+        width = std::max(width, f->key.size());
+    }
+
+    if (entry.entryType != Type::Unknown) {
+        for (Keyword keyword : AcceptedKeywords[static_cast<int>(entry.entryType)]) {
+            if (const Field* field = entry.field(keyword)) {
+                writeField(_output, keywordName(keyword), *field, width);
+            }
+        }
+    }
+    for (int i = 0; i < NumKeywords; ++i) {
+        const Keyword keyword = static_cast<Keyword>(i);
+        if ((present & ~accepted) & maskOf(keyword)) {
+            writeField(_output, keywordName(keyword), *entry.field(keyword), width);
+        }
+    }
+    for (const Field* f = entry.extraFieldsBegin(); f != entry.extraFieldsEnd(); ++f) {
+        writeField(_output, f->key, *f, width);
+    }
+
+    _output.write("}\n");
+}
+
+void Formatter::writeVerbatim(std::string_view text) {
+    while (!text.empty() && isWhitespace(text.front())) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && isWhitespace(text.back())) {
+        text.remove_suffix(1);
+    }
+    if (text.empty()) {
+        return;
+    }
+
+    beginBlock();
+    _output.write(text);
+    _output.write('\n');
+}
+
+void Formatter::beginBlock() {
+    if (!_isFirstBlock) {
+        _output.write('\n');
+    }
+    _isFirstBlock = false;
+}
@@ -0,0 +1,72 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___FORMATTER___H__
+#define __BIBTEXFORMAT___FORMATTER___H__
+
+#include <string_view>
+
+class Entry;
+class OutputBuffer;
+
+// Writes entries in a canonical form:
+//
+// @article{citeKey,
+//     author  = {...},
+//     journal = tvcg,
+// }
+//
+// The fields accepted by the entry type come first, in the order of AcceptedKeywords,
+// followed by other known keywords and then by the unknown fields in their original
+// order. All literal values are enclosed in braces, while macros and concatenations are
+// reproduced as written. Consecutive blocks are separated by one empty line
+class Formatter {
+public:
+    explicit Formatter(OutputBuffer& output);
+
+    void write(const Entry& entry);
+
+    // Writes text that is not reformatted, for example comments or entries that could
+    // not be parsed. Surrounding whitespace is removed and nothing is written if the text
+    // only consists of whitespace
+    void writeVerbatim(std::string_view text);
+
+private:
+    void beginBlock();
+
+    OutputBuffer& _output;
+    bool _isFirstBlock = true;
+};
+
+#endif // __BIBTEXFORMAT___FORMATTER___H__
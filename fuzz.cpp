@@ -0,0 +1,278 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "corpus.h"
+#include "document.h"
+#include "formatter.h"
+#include "macros.h"
+#include "outputbuffer.h"
+#include "parser.h"
+#include "sorting.h"
+#include "structural.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Runs every input through the parser, the event interface, and the formatter and checks
+// the invariants that have to hold for any input, no matter how broken it is. A violated
+// invariant aborts, so that both libFuzzer and ctest report it. With
+// BIBTEXFORMAT_LIBFUZZER, this is a libFuzzer target, otherwise the main function below
+// replays files or mutates the synthetic corpora
+
+namespace {
+#ifdef _WIN32
+    constexpr const char* NullDevice = "NUL";
+#else // ^^^^ _WIN32 // !_WIN32 vvvv
+    constexpr const char* NullDevice = "/dev/null";
+#endif // _WIN32
+
+    constexpr ScanImplementation Implementations[] = {
+        ScanImplementation::Scalar, ScanImplementation::Sse2, ScanImplementation::Avx2
+    };
+
+    void check(bool condition, const char* invariant) {
+        if (!condition) {
+            std::fprintf(stderr, "Violated invariant: %s\n", invariant);
+            std::abort();
+        }
+    }
+
+    bool isWithin(std::string_view source, std::string_view text) {
+        return text.empty() ||
+            (text.data() >= source.data() &&
+             text.data() + text.size() <= source.data() + source.size());
+    }
+
+    // The parts of a ParseResult that do not depend on how the source was scanned
+    struct Summary {
+        std::vector<size_t> blocks;
+        std::vector<std::pair<Diagnostic::Kind, size_t>> diagnostics;
+        size_t nEntries = 0;
+
+        bool operator==(const Summary& other) const {
+            return blocks == other.blocks && diagnostics == other.diagnostics &&
+                nEntries == other.nEntries;
+        }
+    };
+
+    Summary summarize(std::string_view source, const ParseResult& result) {
+        Summary summary;
+        for (const Block& block : result.blocks) {
+            summary.blocks.push_back(block.text.data() - source.data());
+            summary.blocks.push_back(block.text.size());
+        }
+        for (const Diagnostic& diagnostic : result.diagnostics) {
+            summary.diagnostics.emplace_back(diagnostic.kind, diagnostic.offset);
+        }
+        summary.nEntries = result.entries.size();
+        return summary;
+    }
+
+    void checkResult(std::string_view source, const ParseResult& result) {
+        check(result.end >= source.size(), "The whole source is consumed");
+        const char* previousEnd = source.data();
+        for (const Block& block : result.blocks) {
+            check(isWithin(source, block.text), "Blocks are views into the source");
+            check(block.text.empty() || block.text.data() >= previousEnd,
+                  "Blocks are in file order and do not overlap");
+            if (!block.text.empty()) {
+                previousEnd = block.text.data() + block.text.size();
+            }
+            check(block.entryIndex == Block::NoEntry ||
+                  block.entryIndex < result.entries.size(),
+                  "Blocks refer to existing entries");
+        }
+        for (const Diagnostic& diagnostic : result.diagnostics) {
+            check(diagnostic.entryOffset <= source.size(),
+                  "Diagnostics belong to entries in the source");
+            check(diagnostic.offset <= source.size(),
+                  "Diagnostics point into the source");
+        }
+    }
+
+    void run(std::string_view source) {
+        MacroTable macros;
+        macros.collect(source);
+        ParseOptions options;
+        options.macros = &macros;
+
+        const ScanImplementation original = scanImplementation();
+        ParseResult result;
+        parse(source, 0, source.size(), false, options, result);
+        checkResult(source, result);
+        const Summary summary = summarize(source, result);
+        for (ScanImplementation implementation : Implementations) {
+            if (implementation == original || !setScanImplementation(implementation)) {
+                continue;
+            }
+            ParseResult other;
+            parse(source, 0, source.size(), false, options, other);
+            check(summarize(source, other) == summary,
+                  "All scan implementations find the same blocks and diagnostics");
+        }
+        setScanImplementation(original);
+
+        const Document document = parseDocument(source);
+        const size_t nAts = std::count(source.begin(), source.end(), '@');
+        check(document.entries.size() <= nAts, "Every entry starts with an '@'");
+
+        std::FILE* file = std::fopen(NullDevice, "wb");
+        if (file) {
+            OutputBuffer output(file);
+            Formatter formatter(output);
+            for (const Block& block : result.blocks) {
+                const bool canFormat = block.entryIndex != Block::NoEntry &&
+                    result.entries[block.entryIndex].entryType != Type::Unknown;
+                if (canFormat) {
+                    formatter.write(result.entries[block.entryIndex]);
+                }
+                else {
+                    formatter.writeVerbatim(block.text);
+                }
+            }
+            std::vector<ParseResult> results;
+            results.push_back(std::move(result));
+            writeSorted(results, SortOrder::YearAuthor, true, 1, output);
+            output.flush();
+            std::fclose(file);
+        }
+    }
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    run(std::string_view(reinterpret_cast<const char*>(data), size));
+    return 0;
+}
+
+#ifndef BIBTEXFORMAT_LIBFUZZER
+namespace {
+    std::string readFile(const std::filesystem::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    }
+
+    // Applies a few random edits that are likely to break the structure of the source:
+    // removing or duplicating ranges, and inserting or overwriting structural characters
+    void mutate(std::string& source, std::mt19937_64& random) {
+        constexpr std::string_view Structural = "@{}()\"=,#\\%\n ";
+        const size_t nEdits = 1 + random() % 8;
+        for (size_t i = 0; i < nEdits; ++i) {
+            const size_t position = source.empty() ? 0 : random() % (source.size() + 1);
+            const size_t length =
+                std::min<size_t>(random() % 64, source.size() - position);
+            const char c = Structural[random() % Structural.size()];
+            switch (random() % 5) {
+                case 0:
+                    source.erase(position, length);
+                    break;
+                case 1:
+                    source.insert(position, source.substr(position, length));
+                    break;
+                case 2:
+                    source.insert(position, 1, c);
+                    break;
+                case 3:
+                    if (position < source.size()) {
+                        source[position] = c;
+                    }
+                    break;
+                case 4:
+                    source.resize(position);
+                    break;
+            }
+        }
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t nIterations = 0;
+    uint64_t seed = 1;
+    std::vector<std::filesystem::path> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) {
+            nIterations = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (!arg.empty() && arg[0] != '-') {
+            paths.emplace_back(arg);
+        }
+        else {
+            std::cerr << "Usage: bibtex_fuzz [--iterations n] [--seed n] [path]...\n";
+            return -1;
+        }
+    }
+
+    // Replays inputs, for example the crashes that libFuzzer has found
+    for (const std::filesystem::path& path : paths) {
+        if (std::filesystem::is_directory(path)) {
+            for (const auto& file : std::filesystem::recursive_directory_iterator(path)) {
+                if (file.is_regular_file()) {
+                    run(readFile(file.path()));
+                }
+            }
+        }
+        else {
+            run(readFile(path));
+        }
+    }
+
+    std::mt19937_64 random(seed);
+    std::vector<std::string> originals;
+    for (Corpus corpus : Corpora) {
+        originals.push_back(generateCorpus(corpus, 10, seed));
+    }
+    for (size_t i = 0; i < nIterations; ++i) {
+        std::string source = originals[i % originals.size()];
+        mutate(source, random);
+        run(source);
+    }
+    return 0;
+}
+#endif // BIBTEXFORMAT_LIBFUZZER
@@ -0,0 +1,87 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "corpus.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+// Writes one of the synthetic corpora into a file, so that it can be used outside of the
+// benchmark, for example to profile BibTexFormat itself
+int main(int argc, char** argv) {
+    Corpus corpus = Corpus::Realistic;
+    uint64_t seed = 1;
+    size_t nEntries = 0;
+    std::string path;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--corpus" && i + 1 < argc) {
+            if (!corpusFromName(argv[++i], corpus)) {
+                std::cerr << "Unknown corpus " << argv[i] << '\n';
+                return -1;
+            }
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (nEntries == 0) {
+            nEntries = std::strtoull(argv[i], nullptr, 10);
+        }
+        else if (path.empty()) {
+            path = arg;
+        }
+    }
+
+    if (nEntries == 0 || path.empty()) {
+        std::cerr << "Usage: bibtex_corpus [--corpus name] [--seed n] <entries> <file>\n";
+        return -1;
+    }
+
+    const std::string contents = generateCorpus(corpus, nEntries, seed);
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Could not create " << path << '\n';
+        return -1;
+    }
+    const bool success =
+        std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    if (std::fclose(file) != 0 || !success) {
+        std::cerr << "Could not write " << path << '\n';
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___HASH___H__
+#define __BIBTEXFORMAT___HASH___H__
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// 64 bit MurmurHash2 (MurmurHash64A by Austin Appleby, public domain). It consumes eight
+// bytes per step, which is plenty fast for hashing whole entries, and is only used for
+// lookups, never for anything security related
+inline uint64_t hash64(std::string_view data, uint64_t seed = 0) {
+    constexpr uint64_t m = 0xc6a4a7935bd1e995ull;
+    constexpr int r = 47;
+
+    uint64_t h = seed ^ (data.size() * m);
+
+    const char* p = data.data();
+    const char* end = p + (data.size() & ~size_t(7));
+    for (; p != end; p += 8) {
+        uint64_t k;
+        std::memcpy(&k, p, sizeof(k));
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    switch (data.size() & 7) {
+        case 7: h ^= uint64_t(static_cast<uint8_t>(p[6])) << 48; [[fallthrough]];
+        case 6: h ^= uint64_t(static_cast<uint8_t>(p[5])) << 40; [[fallthrough]];
+        case 5: h ^= uint64_t(static_cast<uint8_t>(p[4])) << 32; [[fallthrough]];
+        case 4: h ^= uint64_t(static_cast<uint8_t>(p[3])) << 24; [[fallthrough]];
+        case 3: h ^= uint64_t(static_cast<uint8_t>(p[2])) << 16; [[fallthrough]];
+        case 2: h ^= uint64_t(static_cast<uint8_t>(p[1])) << 8;  [[fallthrough]];
+        case 1: h ^= uint64_t(static_cast<uint8_t>(p[0]));
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+#endif // __BIBTEXFORMAT___HASH___H__
@@ -0,0 +1,580 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "index.h"
+
+#include "hash.h"
+#include "lexer.h"
+#include "macros.h"
+#include "mappedfile.h"
+#include "parser.h"
+#include "stringpool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+
+// File layout, all integers are stored in native byte order:
+//
+// Header:  char[4] "BTFI", uint32_t FormatVersion, uint64_t size, int64_t modification
+//          time, and uint64_t hash64 of the bibliography, uint32_t number of entries,
+//          fields, names, and buckets, uint32_t size of the string table
+// Entry:   uint64_t offset of the '@', uint32_t line, uint32_t index of the type in the
+//          names, uint32_t index of the first field, uint32_t number of fields, uint32_t
+//          offset and uint32_t length of the cite key in the string table. The values of
+//          the fields that are not interned directly follow the cite key in the string
+//          table. All macros are expanded
+// Field:   uint32_t index of the field name in the names, uint32_t length of the value.
+//          The values of the VenueKeywords are stored as names instead and have the
+//          InternedValue bit set in place of the length, with the index of the name in
+//          the remaining bits
+// Name:    uint32_t offset and uint32_t length in the string table. Types, field names,
+//          and venues repeat for many entries, so they are only stored once
+// Bucket:  uint32_t index of the entry plus one, or 0 for an empty bucket. The bucket
+//          of a cite key is the hash64 of its lower case version modulo the number of
+//          buckets, which is a power of two, followed by linear probing
+// Strings: All strings without any separators
+
+namespace {
+    constexpr char Magic[4] = { 'B', 'T', 'F', 'I' };
+    // Version 4 hashes the cite keys in lower case
+    constexpr uint32_t FormatVersion = 4;
+    constexpr uint32_t InternedValue = uint32_t(1) << 31;
+
+    constexpr size_t HeaderSize = 4 + 4 + 8 + 8 + 8 + 5 * 4;
+    constexpr size_t ModificationTimeOffset = 4 + 4 + 8;
+    constexpr size_t EntrySize = 8 + 6 * 4;
+    constexpr size_t FieldSize = 2 * 4;
+    constexpr size_t NameSize = 2 * 4;
+    constexpr size_t BucketSize = 4;
+
+    char toLower(char c) {
+        return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+
+    // Cite keys are case-insensitive, like in BibTeX, so they are hashed in lower case
+    uint64_t hashCiteKey(std::string_view citeKey) {
+        std::string folded(citeKey);
+        for (char& c : folded) {
+            c = toLower(c);
+        }
+        return hash64(folded);
+    }
+
+    bool equalsCiteKey(std::string_view lhs, std::string_view rhs) {
+        return std::equal(
+            lhs.begin(),
+            lhs.end(),
+            rhs.begin(),
+            rhs.end(),
+            [](char l, char r) { return toLower(l) == toLower(r); }
+        );
+    }
+
+    template <typename T>
+    void append(std::string& buffer, T value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    // Returns false if the file could not be found
+    bool readStamp(const std::string& path, SourceStamp& stamp) {
+        std::error_code error;
+        stamp.size = std::filesystem::file_size(path, error);
+        if (error) {
+            return false;
+        }
+        const std::filesystem::file_time_type time =
+            std::filesystem::last_write_time(path, error);
+        stamp.modificationTime = static_cast<int64_t>(time.time_since_epoch().count());
+        return !error;
+    }
+
+    // Parses the bibliography and builds its index into 'index'. Returns the reason for
+    // the failure or an empty string on success
+    std::string buildIndexForFile(const std::string& path, std::string& index) {
+        SourceStamp stamp;
+        MappedFile file(path);
+        if (!readStamp(path, stamp) || !file.isValid()) {
+            return "Could not open BibTex file " + path;
+        }
+        std::string_view contents = file.contents();
+        stamp.size = contents.size();
+        stamp.hash = hash64(contents);
+
+        MacroTable macros;
+        macros.collect(contents);
+        StringPool venues;
+        ParseOptions options;
+        options.venues = &venues;
+        std::vector<ParseResult> results = parseParallel(contents, 0, options);
+        index = buildIndex(contents, results, stamp, &macros, &venues);
+        if (index.empty()) {
+            return "The bibliography " + path + " is too large to be indexed";
+        }
+        return std::string();
+    }
+
+    // Writes into a temporary file first, so that a failed write does not destroy the
+    // previous index
+    bool saveIndex(const std::string& path, std::string_view index) {
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        std::FILE* file = std::fopen(temporary.string().c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        const bool isWritten = std::fwrite(index.data(), 1, index.size(), file) ==
+                               index.size();
+        const bool isClosed = std::fclose(file) == 0;
+
+        std::error_code error;
+        if (isWritten && isClosed) {
+            std::filesystem::rename(temporary, path, error);
+        }
+        if (!isWritten || !isClosed || error) {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+
+    void appendAnswer(std::string& output, const BibIndex& index,
+                      std::string_view citeKey, bool& isFound)
+    {
+        IndexedEntry entry;
+        isFound = index.find(citeKey, entry);
+        output += citeKey;
+        if (isFound) {
+            output += '\t';
+            output += entry.type;
+            output += '\t';
+            output += entry["year"];
+            output += '\t';
+            output += entry["title"];
+        }
+        output += '\n';
+    }
+} // namespace
+
+std::string_view IndexedEntry::operator[](std::string_view name) const {
+    auto isName = [name](const Field& field) {
+        return std::equal(
+            field.key.begin(),
+            field.key.end(),
+            name.begin(),
+            name.end(),
+            [](char lhs, char rhs) {
+                return std::tolower(static_cast<unsigned char>(lhs)) ==
+                       std::tolower(static_cast<unsigned char>(rhs));
+            }
+        );
+    };
+    auto it = std::find_if(fields.begin(), fields.end(), isName);
+    return it != fields.end() ? it->value : std::string_view();
+}
+
+std::string buildIndex(std::string_view source, const std::vector<ParseResult>& results,
+                       const SourceStamp& stamp, const MacroTable* macros,
+                       const StringPool* venues)
+{
+    static constexpr size_t MaxSize = std::numeric_limits<uint32_t>::max();
+
+    std::string strings;
+    std::string names;
+    std::unordered_map<std::string_view, uint32_t> nameIndices;
+    auto addString = [&strings](std::string_view string) -> uint32_t {
+        strings += string;
+        return static_cast<uint32_t>(std::min(string.size(), MaxSize));
+    };
+    auto addName = [&](std::string_view name) -> uint32_t {
+        auto it = nameIndices.find(name);
+        if (it == nameIndices.end()) {
+            const uint32_t index = static_cast<uint32_t>(nameIndices.size());
+            append(names, static_cast<uint32_t>(std::min(strings.size(), MaxSize)));
+            append(names, addString(name));
+            it = nameIndices.emplace(name, index).first;
+        }
+        return it->second;
+    };
+    // The name of every interned venue by its id, so that the thousands of entries with
+    // the same venue don't hash it again. Expressions are expanded first, so they are
+    // always added by their value
+    constexpr uint32_t NoName = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> venueNames(venues ? venues->idLimit() : 0, NoName);
+    auto addVenue = [&](const Field& field, std::string_view value) -> uint32_t {
+        if (field.isExpression || field.valueId >= venueNames.size()) {
+            return addName(value);
+        }
+        uint32_t& name = venueNames[field.valueId];
+        if (name == NoName) {
+            name = addName(value);
+        }
+        return name;
+    };
+
+    std::string entries;
+    std::string fields;
+    std::vector<std::string_view> citeKeys;
+    // Only concatenations have to be joined, everything else is a view
+    StringArena expansions;
+    // The value or the interned name of every field of the current entry
+    std::vector<uint32_t> values;
+    std::vector<std::string_view> valueViews;
+    size_t nFields = 0;
+    size_t line = 1;
+    size_t lineOffset = 0;
+    for (const ParseResult& result : results) {
+        for (const Block& block : result.blocks) {
+            if (block.entryIndex == Block::NoEntry) {
+                continue;
+            }
+            const Entry& entry = result.entries[block.entryIndex];
+            const size_t offset = static_cast<size_t>(block.text.data() - source.data());
+            line += std::count(
+                source.begin() + lineOffset,
+                source.begin() + offset,
+                '\n'
+            );
+            lineOffset = offset;
+
+            // Unknown types are stored as they were written
+            std::string_view type = typeName(entry.entryType);
+            if (entry.entryType == Type::Unknown) {
+                Lexer lexer(block.text);
+                RawEntry raw;
+                type = lexer.next(raw) ? raw.type : std::string_view();
+            }
+
+            // New names are added to the string table first, as nothing may come
+            // between the cite key and the values of the entry
+            values.clear();
+            valueViews.clear();
+            for (const Field& field : entry.fields()) {
+                addName(field.key);
+                std::string_view value =
+                    macros ? macros->expand(field, expansions) : field.value;
+                if (maskOf(keywordFromString(field.key)) & VenueKeywords) {
+                    values.push_back(InternedValue | addVenue(field, value));
+                }
+                else if (value.size() < InternedValue) {
+                    values.push_back(static_cast<uint32_t>(value.size()));
+                }
+                else {
+                    return std::string();
+                }
+                valueViews.push_back(value);
+            }
+
+            append(entries, static_cast<uint64_t>(offset));
+            append(entries, static_cast<uint32_t>(line));
+            append(entries, addName(type));
+            append(entries, static_cast<uint32_t>(nFields));
+            append(entries, static_cast<uint32_t>(entry.fields().size()));
+            append(entries, static_cast<uint32_t>(std::min(strings.size(), MaxSize)));
+            append(entries, addString(entry.citeKey));
+            for (size_t i = 0; i < entry.fields().size(); ++i) {
+                append(fields, addName(entry.fields()[i].key));
+                append(fields, values[i]);
+                if ((values[i] & InternedValue) == 0) {
+                    addString(valueViews[i]);
+                }
+            }
+            nFields += entry.fields().size();
+            citeKeys.push_back(entry.citeKey);
+        }
+    }
+    if (strings.size() > MaxSize || nFields > MaxSize || citeKeys.size() > MaxSize / 4 ||
+        nameIndices.size() > InternedValue)
+    {
+        return std::string();
+    }
+
+    // At most half of the buckets are used, so that probe sequences stay short
+    uint32_t nBuckets = 1;
+    while (nBuckets < citeKeys.size() * 2) {
+        nBuckets *= 2;
+    }
+    std::vector<uint32_t> buckets(nBuckets, 0);
+    for (size_t i = 0; i < citeKeys.size(); ++i) {
+        size_t bucket = hashCiteKey(citeKeys[i]) & (nBuckets - 1);
+        while (buckets[bucket] != 0 &&
+               !equalsCiteKey(citeKeys[buckets[bucket] - 1], citeKeys[i]))
+        {
+            bucket = (bucket + 1) & (nBuckets - 1);
+        }
+        if (buckets[bucket] == 0) {
+            buckets[bucket] = static_cast<uint32_t>(i + 1);
+        }
+    }
+
+    std::string index;
+    index.reserve(
+        HeaderSize + entries.size() + fields.size() + names.size() +
+        nBuckets * BucketSize + strings.size()
+    );
+    index.append(Magic, sizeof(Magic));
+    append(index, FormatVersion);
+    append(index, stamp.size);
+    append(index, stamp.modificationTime);
+    append(index, stamp.hash);
+    append(index, static_cast<uint32_t>(citeKeys.size()));
+    append(index, static_cast<uint32_t>(nFields));
+    append(index, static_cast<uint32_t>(nameIndices.size()));
+    append(index, nBuckets);
+    append(index, static_cast<uint32_t>(strings.size()));
+    index += entries;
+    index += fields;
+    index += names;
+    index.append(reinterpret_cast<const char*>(buckets.data()), nBuckets * BucketSize);
+    index += strings;
+    return index;
+}
+
+bool BibIndex::open(std::string_view data) {
+    _data = std::string_view();
+    if (data.size() < HeaderSize || data.substr(0, 4) != std::string_view(Magic, 4)) {
+        return false;
+    }
+
+    size_t offset = 4;
+    auto read = [data, &offset](auto& value) {
+        std::memcpy(&value, data.data() + offset, sizeof(value));
+        offset += sizeof(value);
+    };
+    uint32_t version;
+    read(version);
+    read(_stamp.size);
+    read(_stamp.modificationTime);
+    read(_stamp.hash);
+    read(_nEntries);
+    read(_nFields);
+    read(_nNames);
+    read(_nBuckets);
+    read(_stringsSize);
+
+    const uint64_t expectedSize = HeaderSize + uint64_t(_nEntries) * EntrySize +
+        uint64_t(_nFields) * FieldSize + uint64_t(_nNames) * NameSize +
+        uint64_t(_nBuckets) * BucketSize + _stringsSize;
+    const bool isPowerOfTwo = _nBuckets != 0 && (_nBuckets & (_nBuckets - 1)) == 0;
+    if (version != FormatVersion || expectedSize != data.size() || !isPowerOfTwo) {
+        return false;
+    }
+    _data = data;
+    return true;
+}
+
+const SourceStamp& BibIndex::stamp() const {
+    return _stamp;
+}
+
+size_t BibIndex::size() const {
+    return _nEntries;
+}
+
+bool BibIndex::find(std::string_view citeKey, IndexedEntry& entry) const {
+    if (_data.empty()) {
+        return false;
+    }
+
+    const size_t fieldsBegin = HeaderSize + size_t(_nEntries) * EntrySize;
+    const size_t namesBegin = fieldsBegin + size_t(_nFields) * FieldSize;
+    const size_t bucketsBegin = namesBegin + size_t(_nNames) * NameSize;
+    const size_t stringsBegin = bucketsBegin + size_t(_nBuckets) * BucketSize;
+    auto load = [this](size_t offset) {
+        uint32_t value;
+        std::memcpy(&value, _data.data() + offset, sizeof(value));
+        return value;
+    };
+    // A damaged index returns empty strings instead of reading out of bounds
+    auto string = [this, stringsBegin](uint64_t begin, uint64_t length) {
+        if (begin + length > _stringsSize) {
+            return std::string_view();
+        }
+        return _data.substr(stringsBegin + begin, length);
+    };
+    auto name = [&](uint32_t index) {
+        if (index >= _nNames) {
+            return std::string_view();
+        }
+        const size_t offset = namesBegin + size_t(index) * NameSize;
+        return string(load(offset), load(offset + 4));
+    };
+
+    // Every probe either hits an empty bucket or an entry, so this ends after at most
+    // as many steps as there are buckets
+    size_t bucket = hashCiteKey(citeKey) & (_nBuckets - 1);
+    for (uint32_t i = 0; i < _nBuckets; ++i) {
+        const uint32_t index = load(bucketsBegin + bucket * BucketSize);
+        if (index == 0 || index > _nEntries) {
+            return false;
+        }
+
+        const size_t record = HeaderSize + size_t(index - 1) * EntrySize;
+        uint64_t valueOffset = load(record + 24);
+        const std::string_view key = string(valueOffset, load(record + 28));
+        if (!equalsCiteKey(key, citeKey)) {
+            bucket = (bucket + 1) & (_nBuckets - 1);
+            continue;
+        }
+
+        std::memcpy(&entry.offset, _data.data() + record, sizeof(entry.offset));
+        entry.line = load(record + 8);
+        entry.type = name(load(record + 12));
+        entry.citeKey = key;
+        entry.fields.clear();
+        const uint32_t firstField = load(record + 16);
+        const uint32_t nFields = load(record + 20);
+        if (uint64_t(firstField) + nFields > _nFields) {
+            return true;
+        }
+        entry.fields.reserve(nFields);
+        valueOffset += key.size();
+        for (uint32_t j = 0; j < nFields; ++j) {
+            const size_t field = fieldsBegin + size_t(firstField + j) * FieldSize;
+            const uint32_t value = load(field + 4);
+            if (value & InternedValue) {
+                const std::string_view venue = name(value & ~InternedValue);
+                entry.fields.push_back({ name(load(field)), venue });
+            }
+            else {
+                entry.fields.push_back({ name(load(field)), string(valueOffset, value) });
+                valueOffset += value;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+std::string indexPath(const std::string& path) {
+    return path + ".idx";
+}
+
+std::string writeIndex(const std::string& path) {
+    std::string index;
+    std::string error = buildIndexForFile(path, index);
+    if (!error.empty()) {
+        return error;
+    }
+    if (!saveIndex(indexPath(path), index)) {
+        return "Could not write index file " + indexPath(path);
+    }
+    return std::string();
+}
+
+int lookupEntries(const std::string& path, const std::vector<std::string>& citeKeys) {
+    SourceStamp stamp;
+    if (!readStamp(path, stamp)) {
+        std::cerr << "Could not open BibTex file " << path << '\n';
+        return -1;
+    }
+
+    // Comparing the size and modification time doesn't require reading the
+    // bibliography, so the hash is only checked if the modification time differs
+    auto file = std::make_unique<MappedFile>(indexPath(path));
+    BibIndex index;
+    bool isCurrent = file->isValid() && index.open(file->contents()) &&
+                     index.stamp().size == stamp.size;
+    bool isTouched = false;
+    if (isCurrent && index.stamp().modificationTime != stamp.modificationTime) {
+        MappedFile source(path);
+        isCurrent = source.isValid() && hash64(source.contents()) == index.stamp().hash;
+        isTouched = isCurrent;
+    }
+
+    std::string rebuilt;
+    if (isTouched) {
+        // The bibliography was saved without being changed. Its new modification time is
+        // stored in the index, so that the next lookups don't have to hash it again
+        rebuilt = std::string(file->contents());
+        std::memcpy(&rebuilt[ModificationTimeOffset], &stamp.modificationTime,
+                    sizeof(stamp.modificationTime));
+        index = BibIndex();
+        file = nullptr;
+        saveIndex(indexPath(path), rebuilt);
+        index.open(rebuilt);
+    }
+    else if (!isCurrent) {
+        // The old index has to be unmapped before it can be replaced on some operating
+        // systems. Failing to save the index only makes the next lookup slower
+        index = BibIndex();
+        file = nullptr;
+        std::string error = buildIndexForFile(path, rebuilt);
+        if (!error.empty()) {
+            std::cerr << error << '\n';
+            return -1;
+        }
+        if (!saveIndex(indexPath(path), rebuilt)) {
+            std::cerr << "Could not write index file " << indexPath(path) << '\n';
+        }
+        index.open(rebuilt);
+    }
+
+    bool allFound = true;
+    std::string output;
+    for (const std::string& citeKey : citeKeys) {
+        bool isFound;
+        if (citeKey != "-") {
+            appendAnswer(output, index, citeKey, isFound);
+            allFound &= isFound;
+            continue;
+        }
+
+        // Every answer is written as soon as it is known, so that another process can
+        // send one key at a time and wait for the answer
+        std::fwrite(output.data(), 1, output.size(), stdout);
+        output.clear();
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            appendAnswer(output, index, line, isFound);
+            allFound &= isFound;
+            std::fwrite(output.data(), 1, output.size(), stdout);
+            std::fflush(stdout);
+            output.clear();
+        }
+    }
+    std::fwrite(output.data(), 1, output.size(), stdout);
+    std::fflush(stdout);
+    return allFound ? 0 : -1;
+}
@@ -0,0 +1,120 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#ifndef __BIBTEXFORMAT___INDEX___H__
+#define __BIBTEXFORMAT___INDEX___H__
+
+#include "entry.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class MacroTable;
+class StringPool;
+struct ParseResult;
+
+// Identifies the version of a bibliography that an index was built from
+struct SourceStamp {
+    uint64_t size = 0;
+    int64_t modificationTime = 0;
+    uint64_t hash = 0;
+};
+
+// One entry as it is stored in the index. All views point into the index data
+struct IndexedEntry {
+    std::string_view citeKey;
+    std::string_view type;
+    uint64_t offset = 0; // Offset of the '@' of the entry in the bibliography
+    uint32_t line = 0;
+    std::vector<Field> fields;
+
+    // Returns the value of the field with the case-insensitive name or an empty view
+    std::string_view operator[](std::string_view name) const;
+};
+
+// Serializes the entries of the parsed 'source' into an index that can be used without
+// parsing the source again. It consists of a string table, a table of the fields of
+// every entry, and a hash table from the cite keys to the entries. If 'macros' is set,
+// the values are stored with all macros expanded. If the results were parsed with
+// 'venues' as ParseOptions::venues, the venues are added to the names by their id instead
+// of by their value. Returns an empty string if the bibliography is too large for the 32
+// bit offsets of the index
+std::string buildIndex(std::string_view source, const std::vector<ParseResult>& results,
+                       const SourceStamp& stamp, const MacroTable* macros = nullptr,
+                       const StringPool* venues = nullptr);
+
+// A read-only view of an index, usually a mapped index file. Nothing is copied, so the
+// data has to outlive the view
+class BibIndex {
+public:
+    // Returns false if the data is not a valid index
+    bool open(std::string_view data);
+
+    const SourceStamp& stamp() const;
+    size_t size() const;
+
+    // Cite keys are compared case-insensitively. If there are several entries with the
+    // same cite key, the first one is found, just as BibTeX uses the first one
+    bool find(std::string_view citeKey, IndexedEntry& entry) const;
+
+private:
+    std::string_view _data;
+    SourceStamp _stamp;
+    uint32_t _nEntries = 0;
+    uint32_t _nFields = 0;
+    uint32_t _nNames = 0;
+    uint32_t _nBuckets = 0;
+    uint32_t _stringsSize = 0;
+};
+
+// The index of a bibliography is stored next to it with the '.idx' extension appended
+std::string indexPath(const std::string& path);
+
+// Parses the bibliography and replaces its index. Returns the reason for the failure or
+// an empty string on success
+std::string writeIndex(const std::string& path);
+
+// Looks up every cite key in the index of the bibliography and prints its type, year,
+// and title separated by tabs, or just the key if it does not exist. A key of '-' reads
+// one key per line from stdin and answers each one immediately. If the index is
+// missing or out of date, it is rebuilt first. The index is out of date if the size of
+// the bibliography changed or, if only its modification time changed, its hash. If the
+// hash still matches, the new modification time is written into the index. Returns the
+// exit code, which is not 0 if any key was not found
+int lookupEntries(const std::string& path, const std::vector<std::string>& citeKeys);
+
+#endif // __BIBTEXFORMAT___INDEX___H__
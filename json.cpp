@@ -0,0 +1,370 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "json.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+class JsonParser {
+public:
+    explicit JsonParser(std::string_view text)
+        : _cursor(text.data())
+        , _end(text.data() + text.size())
+    {}
+
+    bool parseDocument(JsonValue& value) {
+        if (!parseValue(value, 0)) {
+            return false;
+        }
+        skipWhitespace();
+        return _cursor == _end;
+    }
+
+private:
+    // Protects against stack overflows from maliciously nested input
+    static constexpr int MaxDepth = 256;
+
+    static bool isWhitespace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static bool isNumberCharacter(char c) {
+        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' ||
+               c == 'E';
+    }
+
+    void skipWhitespace() {
+        while (_cursor < _end && isWhitespace(*_cursor)) {
+            ++_cursor;
+        }
+    }
+
+    bool consume(std::string_view literal) {
+        if (static_cast<size_t>(_end - _cursor) < literal.size() ||
+            std::string_view(_cursor, literal.size()) != literal)
+        {
+            return false;
+        }
+        _cursor += literal.size();
+        return true;
+    }
+
+    bool parseValue(JsonValue& value, int depth) {
+        if (depth > MaxDepth) {
+            return false;
+        }
+
+        skipWhitespace();
+        if (_cursor == _end) {
+            return false;
+        }
+
+        switch (*_cursor) {
+            case '{':
+                return parseObject(value, depth);
+            case '[':
+                return parseArray(value, depth);
+            case '"':
+                value._type = JsonValue::Type::String;
+                return parseString(value._string);
+            case 't':
+                value._type = JsonValue::Type::Bool;
+                value._bool = true;
+                return consume("true");
+            case 'f':
+                value._type = JsonValue::Type::Bool;
+                value._bool = false;
+                return consume("false");
+            case 'n':
+                value._type = JsonValue::Type::Null;
+                return consume("null");
+            default:
+                return parseNumber(value);
+        }
+    }
+
+    bool parseObject(JsonValue& value, int depth) {
+        value._type = JsonValue::Type::Object;
+        ++_cursor; // {
+        skipWhitespace();
+        if (_cursor < _end && *_cursor == '}') {
+            ++_cursor;
+            return true;
+        }
+
+        while (true) {
+            skipWhitespace();
+            std::string key;
+            if (_cursor == _end || *_cursor != '"' || !parseString(key)) {
+                return false;
+            }
+            skipWhitespace();
+            if (_cursor == _end || *_cursor != ':') {
+                return false;
+            }
+            ++_cursor;
+
+            JsonValue member;
+            if (!parseValue(member, depth + 1)) {
+                return false;
+            }
+            value._object.emplace_back(std::move(key), std::move(member));
+
+            skipWhitespace();
+            if (_cursor == _end) {
+                return false;
+            }
+            if (*_cursor == '}') {
+                ++_cursor;
+                return true;
+            }
+            if (*_cursor != ',') {
+                return false;
+            }
+            ++_cursor;
+        }
+    }
+
+    bool parseArray(JsonValue& value, int depth) {
+        value._type = JsonValue::Type::Array;
+        ++_cursor; // [
+        skipWhitespace();
+        if (_cursor < _end && *_cursor == ']') {
+            ++_cursor;
+            return true;
+        }
+
+        while (true) {
+            JsonValue element;
+            if (!parseValue(element, depth + 1)) {
+                return false;
+            }
+            value._array.push_back(std::move(element));
+
+            skipWhitespace();
+            if (_cursor == _end) {
+                return false;
+            }
+            if (*_cursor == ']') {
+                ++_cursor;
+                return true;
+            }
+            if (*_cursor != ',') {
+                return false;
+            }
+            ++_cursor;
+        }
+    }
+
+    bool parseHex(uint32_t& codePoint) {
+        if (_end - _cursor < 4) {
+            return false;
+        }
+        codePoint = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char c = *_cursor++;
+            codePoint <<= 4;
+            if (c >= '0' && c <= '9') {
+                codePoint |= c - '0';
+            }
+            else if (c >= 'a' && c <= 'f') {
+                codePoint |= c - 'a' + 10;
+            }
+            else if (c >= 'A' && c <= 'F') {
+                codePoint |= c - 'A' + 10;
+            }
+            else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void appendUtf8(std::string& output, uint32_t codePoint) {
+        if (codePoint < 0x80) {
+            output.push_back(static_cast<char>(codePoint));
+        }
+        else if (codePoint < 0x800) {
+            output.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+            output.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else if (codePoint < 0x10000) {
+            output.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+            output.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            output.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else {
+            output.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+            output.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+            output.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            output.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+    }
+
+    bool parseString(std::string& string) {
+        ++_cursor; // "
+        while (_cursor < _end) {
+            const char c = *_cursor++;
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                string.push_back(c);
+                continue;
+            }
+
+            if (_cursor == _end) {
+                return false;
+            }
+            switch (*_cursor++) {
+                case '"':   string.push_back('"');   break;
+                case '\\':  string.push_back('\\');  break;
+                case '/':   string.push_back('/');   break;
+                case 'b':   string.push_back('\b');  break;
+                case 'f':   string.push_back('\f');  break;
+                case 'n':   string.push_back('\n');  break;
+                case 'r':   string.push_back('\r');  break;
+                case 't':   string.push_back('\t');  break;
+                case 'u': {
+                    uint32_t codePoint;
+                    if (!parseHex(codePoint)) {
+                        return false;
+                    }
+                    const bool isHighSurrogate =
+                        codePoint >= 0xD800 && codePoint < 0xDC00;
+                    if (isHighSurrogate && consume("\\u")) {
+                        uint32_t low;
+                        if (!parseHex(low) || low < 0xDC00 || low >= 0xE000) {
+                            return false;
+                        }
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) +
+                                    (low - 0xDC00);
+                    }
+                    appendUtf8(string, codePoint);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool parseNumber(JsonValue& value) {
+        const char* begin = _cursor;
+        while (_cursor < _end && isNumberCharacter(*_cursor)) {
+            ++_cursor;
+        }
+        if (begin == _cursor) {
+            return false;
+        }
+        const std::string number(begin, _cursor);
+        char* numberEnd = nullptr;
+        value._type = JsonValue::Type::Number;
+        value._number = std::strtod(number.c_str(), &numberEnd);
+        return numberEnd == number.c_str() + number.size();
+    }
+
+    const char* _cursor;
+    const char* _end;
+};
+
+JsonValue::Type JsonValue::type() const {
+    return _type;
+}
+
+bool JsonValue::isNull() const {
+    return _type == Type::Null;
+}
+
+bool JsonValue::asBool() const {
+    return _type == Type::Bool && _bool;
+}
+
+double JsonValue::asNumber() const {
+    return _type == Type::Number ? _number : 0.0;
+}
+
+const std::string& JsonValue::asString() const {
+    return _string;
+}
+
+const std::vector<JsonValue>& JsonValue::asArray() const {
+    return _array;
+}
+
+const JsonValue* JsonValue::find(std::string_view key) const {
+    for (const std::pair<std::string, JsonValue>& member : _object) {
+        if (member.first == key) {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+bool JsonValue::parse(std::string_view text, JsonValue& value) {
+    value = JsonValue();
+    return JsonParser(text).parseDocument(value);
+}
+
+void appendJsonString(std::string& output, std::string_view string) {
+    constexpr char Hex[] = "0123456789abcdef";
+
+    output.push_back('"');
+    size_t runBegin = 0;
+    for (size_t i = 0; i < string.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(string[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        // Copy everything that did not need escaping in one go
+        output.append(string.data() + runBegin, i - runBegin);
+        runBegin = i + 1;
+        switch (c) {
+            case '"':   output.append("\\\"");  break;
+            case '\\':  output.append("\\\\");  break;
+            case '\n':  output.append("\\n");   break;
+            case '\r':  output.append("\\r");   break;
+            case '\t':  output.append("\\t");   break;
+            default:
+                output.append("\\u00");
+                output.push_back(Hex[c >> 4]);
+                output.push_back(Hex[c & 0xF]);
+        }
+    }
+    output.append(string.data() + runBegin, string.size() - runBegin);
+    output.push_back('"');
+}
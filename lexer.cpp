@@ -0,0 +1,534 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "lexer.h"
+
+#include "structural.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    bool isWhitespace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    // Characters that can be part of entry types, field names, and macro names
+    bool isIdentifierCharacter(char c) {
+        switch (c) {
+            case '"':
+            case '#':
+            case '%':
+            case '\'':
+            case '(':
+            case ')':
+            case ',':
+            case '=':
+            case '{':
+            case '}':
+            case '@':
+                return false;
+            default:
+                return !isWhitespace(c) && static_cast<unsigned char>(c) > 31;
+        }
+    }
+
+    bool equalsIgnoreCase(std::string_view lhs, const char* rhs) {
+        size_t size = std::strlen(rhs);
+        if (lhs.size() != size) {
+            return false;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            char c = lhs[i];
+            if (c >= 'A' && c <= 'Z') {
+                c = c - 'A' + 'a';
+            }
+            if (c != rhs[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    EntryKind kindFromType(std::string_view type) {
+        if (equalsIgnoreCase(type, "string")) {     return EntryKind::String;   }
+        if (equalsIgnoreCase(type, "preamble")) {   return EntryKind::Preamble; }
+        if (equalsIgnoreCase(type, "comment")) {    return EntryKind::Comment;  }
+        return EntryKind::Regular;
+    }
+
+    // Checks whether the '@' at 'at' is only preceded by whitespace on its line
+    bool isAtLineStart(const char* begin, const char* at) {
+        while (at > begin) {
+            --at;
+            if (*at == '\n') {
+                return true;
+            }
+            if (*at != ' ' && *at != '\t' && *at != '\r') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Checks whether the '@' at 'at' is followed by an entry type and an opening
+    // delimiter. On success, 'typeBegin' and 'typeEnd' enclose the type and 'delimiter'
+    // points to the opening delimiter
+    bool looksLikeEntry(const char* at, const char* end, const char*& typeBegin,
+                        const char*& typeEnd, const char*& delimiter)
+    {
+        const char* p = at + 1;
+        while (p < end && isWhitespace(*p)) {
+            ++p;
+        }
+        typeBegin = p;
+        while (p < end && isIdentifierCharacter(*p)) {
+            ++p;
+        }
+        typeEnd = p;
+        while (p < end && isWhitespace(*p)) {
+            ++p;
+        }
+        delimiter = p;
+        return typeBegin != typeEnd && p < end && (*p == '{' || *p == '(');
+    }
+
+    bool isEntryStart(const char* begin, const char* at, const char* end) {
+        const char* typeBegin;
+        const char* typeEnd;
+        const char* delimiter;
+        return isAtLineStart(begin, at) &&
+               looksLikeEntry(at, end, typeBegin, typeEnd, delimiter);
+    }
+} // namespace
+
+const char* errorMessage(LexError error) {
+    switch (error) {
+        case LexError::None:                return "";
+        case LexError::UnterminatedEntry:   return "Unterminated entry";
+        case LexError::MissingFieldName:    return "Expected field name";
+        case LexError::MissingEquals:       return "Expected '=' after field name";
+        case LexError::MissingValue:        return "Expected value";
+        case LexError::UnterminatedValue:   return "Unterminated value";
+        case LexError::MissingComma:        return "Expected ',' between fields";
+        default:                            return "Unknown error";
+    }
+}
+
+Lexer::Lexer(std::string_view source)
+    : _source(source)
+    , _limit(source.size())
+{}
+
+Lexer::Lexer(std::string_view source, size_t begin, size_t limit, bool isRecovering)
+    : _source(source)
+    , _cursor(begin)
+    , _limit(std::min(limit, source.size()))
+    , _isRecovering(isRecovering)
+{}
+
+bool Lexer::next(RawEntry& entry) {
+    const char* begin = _source.data();
+    const char* end = begin + _source.size();
+
+    while (_cursor < _limit) {
+        const char* at = static_cast<const char*>(
+            std::memchr(begin + _cursor, '@', _limit - _cursor)
+        );
+        if (!at) {
+            _cursor = _limit;
+            return false;
+        }
+
+        const char* typeBegin;
+        const char* typeEnd;
+        const char* delimiter;
+        if (!looksLikeEntry(at, end, typeBegin, typeEnd, delimiter)) {
+            // A lonely '@' in the text between entries, for example in an email address
+            _cursor = at - begin + 1;
+            continue;
+        }
+
+        entry.type = std::string_view(typeBegin, typeEnd - typeBegin);
+        entry.kind = kindFromType(entry.type);
+        entry.begin = at - begin;
+        entry.error = LexError::None;
+
+        const bool isParenthesized = *delimiter == '(';
+        // The contents of comments are not BibTeX, for example commented out entries
+        const bool hasFields = entry.kind != EntryKind::Comment;
+        const char* bodyBegin = delimiter + 1;
+
+        // Brace depth relative to the entry delimiters; quotes are only tracked on the
+        // outermost level as they can't be nested and only matter for () entries
+        int depth = 0;
+        bool isInQuote = false;
+        // The first line starting with an '@' that was encountered inside a value. If the
+        // entry turns out to be unterminated, this is where we resume
+        const char* recoveryPoint = nullptr;
+        // Only the structural characters can change any of this state, so everything in
+        // between is skipped
+        StructuralScanner scanner(bodyBegin, end);
+        const char* p = scanner.next();
+        for (; p < end; p = scanner.next()) {
+            const char c = *p;
+            if (c == '{') {
+                ++depth;
+                // Deeply nested groups are skipped a block at a time
+                depth = scanner.skipBraces(depth);
+            }
+            else if (c == '}') {
+                if (depth == 0) {
+                    if (!isParenthesized) {
+                        break;
+                    }
+                }
+                else {
+                    --depth;
+                }
+            }
+            else if (c == ')') {
+                if (isParenthesized && depth == 0 && !isInQuote) {
+                    break;
+                }
+            }
+            else if (c == '"') {
+                if (depth == 0 && hasFields) {
+                    isInQuote = !isInQuote;
+                }
+            }
+            else if (c == '@') {
+                const bool isOutsideValue = depth == 0 && !isInQuote && hasFields;
+                if ((isOutsideValue || _isRecovering) && isEntryStart(begin, p, end)) {
+                    // A new entry starts where we expected a field name, so the closing
+                    // delimiter of this entry must be missing
+                    break;
+                }
+                if (!recoveryPoint && isEntryStart(begin, p, end)) {
+                    recoveryPoint = p;
+                }
+            }
+        }
+
+        if (p < end && *p != '@') {
+            // Found the closing delimiter
+            entry.body = std::string_view(bodyBegin, p - bodyBegin);
+            entry.end = p - begin + 1;
+        }
+        else {
+            if (p == end && recoveryPoint) {
+                p = recoveryPoint;
+                _isRecovering = true;
+            }
+            entry.body = std::string_view(bodyBegin, p - bodyBegin);
+            entry.end = p - begin;
+            entry.error = LexError::UnterminatedEntry;
+        }
+        _cursor = entry.end;
+        return true;
+    }
+    return false;
+}
+
+size_t Lexer::cursor() const {
+    return _cursor;
+}
+
+bool Lexer::isRecovering() const {
+    return _isRecovering;
+}
+
+size_t findEntryStart(std::string_view source, size_t from) {
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    while (from < source.size()) {
+        const char* at = static_cast<const char*>(
+            std::memchr(begin + from, '@', source.size() - from)
+        );
+        if (!at) {
+            return source.size();
+        }
+        if (isEntryStart(begin, at, end)) {
+            return at - begin;
+        }
+        from = at - begin + 1;
+    }
+    return source.size();
+}
+
+FieldParser::FieldParser(std::string_view body, EntryKind kind)
+    : _cursor(body.data())
+    , _end(body.data() + body.size())
+    , _tokens(_cursor, _end)
+    , _kind(kind)
+{
+    if (_kind == EntryKind::Regular) {
+        skipWhitespace();
+        const char* keyBegin = _cursor;
+        _cursor = _tokens.skipCiteKey(_cursor);
+        _citeKey = std::string_view(keyBegin, _cursor - keyBegin);
+
+        skipWhitespace();
+        if (_cursor < _end) {
+            if (*_cursor == ',') {
+                ++_cursor;
+            }
+            else {
+                setError(LexError::MissingComma, _cursor);
+            }
+        }
+    }
+    else if (_kind == EntryKind::Comment) {
+        // The contents of a comment are never interpreted
+        _cursor = _end;
+    }
+}
+
+std::string_view FieldParser::citeKey() const {
+    return _citeKey;
+}
+
+bool FieldParser::next(RawField& field) {
+    if (_error != LexError::None) {
+        return false;
+    }
+
+    skipWhitespace();
+    if (_cursor == _end) {
+        return false;
+    }
+
+    if (_kind == EntryKind::Preamble) {
+        field.key = std::string_view();
+        if (!parseValue(field)) {
+            return false;
+        }
+        skipWhitespace();
+        if (_cursor < _end) {
+            setError(LexError::UnterminatedValue, _cursor);
+        }
+        return true;
+    }
+
+    const char* keyBegin = _cursor;
+    _cursor = _tokens.skipIdentifier(_cursor);
+    if (keyBegin == _cursor) {
+        setError(LexError::MissingFieldName, _cursor);
+        return false;
+    }
+    field.key = std::string_view(keyBegin, _cursor - keyBegin);
+
+    skipWhitespace();
+    if (_cursor == _end || *_cursor != '=') {
+        setError(LexError::MissingEquals, _cursor);
+        return false;
+    }
+    ++_cursor;
+    skipWhitespace();
+
+    if (!parseValue(field)) {
+        return false;
+    }
+
+    skipWhitespace();
+    if (_cursor < _end) {
+        if (*_cursor == ',') {
+            ++_cursor;
+        }
+        else {
+            // The field itself is fine, so we still return it but stop afterwards
+            setError(LexError::MissingComma, _cursor);
+        }
+    }
+    return true;
+}
+
+LexError FieldParser::error() const {
+    return _error;
+}
+
+const char* FieldParser::errorPosition() const {
+    return _errorPosition;
+}
+
+void FieldParser::skipWhitespace() {
+    _cursor = _tokens.skipWhitespace(_cursor);
+}
+
+bool FieldParser::nextPart(std::string_view& expression, RawField& part) {
+    FieldParser parser(expression, EntryKind::Preamble);
+    parser.skipWhitespace();
+    const char* partBegin = parser._cursor;
+    if (!parser.parsePart(part)) {
+        return false;
+    }
+    part.value = std::string_view(partBegin, parser._cursor - partBegin);
+
+    parser.skipWhitespace();
+    if (parser._cursor < parser._end && *parser._cursor == '#') {
+        ++parser._cursor;
+    }
+    expression = std::string_view(parser._cursor, parser._end - parser._cursor);
+    return true;
+}
+
+bool FieldParser::parseValue(RawField& field) {
+    const char* valueBegin = _cursor;
+    const char* partEnd = _cursor;
+    int nParts = 0;
+    while (true) {
+        if (!parsePart(field)) {
+            return false;
+        }
+
+        ++nParts;
+        partEnd = _cursor;
+
+        skipWhitespace();
+        if (_cursor < _end && *_cursor == '#') {
+            ++_cursor;
+            skipWhitespace();
+            continue;
+        }
+        break;
+    }
+
+    field.value = std::string_view(valueBegin, partEnd - valueBegin);
+    if (nParts > 1) {
+        field.kind = ValueKind::Concatenation;
+        field.contents = field.value;
+    }
+    return true;
+}
+
+bool FieldParser::parsePart(RawField& field) {
+    if (_cursor == _end) {
+        setError(LexError::MissingValue, _cursor);
+        return false;
+    }
+
+    const char* partBegin = _cursor;
+    const char c = *_cursor;
+    if (c == '{') {
+        const char* p = _tokens.closingBrace(_cursor);
+        if (p == nullptr) {
+            setError(LexError::UnterminatedValue, partBegin);
+            return false;
+        }
+        _cursor = p + 1;
+        field.kind = ValueKind::Braced;
+        field.contents = std::string_view(partBegin + 1, _cursor - partBegin - 2);
+    }
+    else if (c == '"') {
+        // Braces inside of quotes have to be balanced and a quote inside braces does
+        // not end the value
+        const char* p = _tokens.closingQuote(_cursor);
+        if (p == nullptr) {
+            setError(LexError::UnterminatedValue, partBegin);
+            return false;
+        }
+        _cursor = p + 1;
+        field.kind = ValueKind::Quoted;
+        field.contents = std::string_view(partBegin + 1, _cursor - partBegin - 2);
+    }
+    else if (isDigit(c)) {
+        while (_cursor < _end && isDigit(*_cursor)) {
+            ++_cursor;
+        }
+        field.kind = ValueKind::Number;
+        field.contents = std::string_view(partBegin, _cursor - partBegin);
+    }
+    else if (isIdentifierCharacter(c)) {
+        _cursor = _tokens.skipIdentifier(_cursor);
+        field.kind = ValueKind::Macro;
+        field.contents = std::string_view(partBegin, _cursor - partBegin);
+    }
+    else {
+        setError(LexError::MissingValue, _cursor);
+        return false;
+    }
+    return true;
+}
+
+void FieldParser::setError(LexError error, const char* position) {
+    _error = error;
+    _errorPosition = position;
+}
+
+bool hasRedundantWhitespace(std::string_view value) {
+    if (value.empty()) {
+        return false;
+    }
+    if (isWhitespace(value.front()) || isWhitespace(value.back())) {
+        return true;
+    }
+    bool previousWasSpace = false;
+    for (char c : value) {
+        if (c == ' ') {
+            if (previousWasSpace) {
+                return true;
+            }
+            previousWasSpace = true;
+        }
+        else if (isWhitespace(c)) {
+            return true;
+        }
+        else {
+            previousWasSpace = false;
+        }
+    }
+    return false;
+}
+
+size_t normalizeWhitespace(std::string_view value, char* buffer) {
+    size_t size = 0;
+    bool pendingSpace = false;
+    for (char c : value) {
+        if (isWhitespace(c)) {
+            pendingSpace = size > 0;
+        }
+        else {
+            if (pendingSpace) {
+                buffer[size++] = ' ';
+                pendingSpace = false;
+            }
+            buffer[size++] = c;
+        }
+    }
+    return size;
+}
@@ -0,0 +1,175 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___LEXER___H__
+#define __BIBTEXFORMAT___LEXER___H__
+
+#include "structural.h"
+
+#include <string_view>
+
+// The kind of a top-level '@' block in a BibTeX file
+enum class EntryKind {
+    Regular,  // @article{key, ...}, @book{key, ...}, etc
+    String,   // @string{name = value}
+    Preamble, // @preamble{value}
+    Comment   // @comment{...}
+};
+
+enum class LexError {
+    None = 0,
+    UnterminatedEntry,
+    MissingFieldName,
+    MissingEquals,
+    MissingValue,
+    UnterminatedValue,
+    MissingComma
+};
+
+const char* errorMessage(LexError error);
+
+// One '@' block of the input. All views point into the source that was passed to the
+// Lexer, so offsets can be recovered by pointer arithmetic
+struct RawEntry {
+    EntryKind kind = EntryKind::Regular;
+    std::string_view type; // The identifier after the '@'
+    std::string_view body; // Everything between the opening and closing delimiter
+
+    size_t begin = 0; // Byte offset of the '@'
+    size_t end = 0;   // Byte offset one past the closing delimiter
+
+    LexError error = LexError::None;
+};
+
+// Walks the source exactly once and returns the top-level blocks one by one. Text
+// outside of blocks is ignored, just like BibTeX does. Entries may be delimited by {} or
+// by (), values inside may span multiple lines and contain arbitrarily nested braces
+class Lexer {
+public:
+    explicit Lexer(std::string_view source);
+
+    // Only returns the entries that start in [begin, limit). The last entry may extend
+    // past 'limit' and all offsets are relative to the beginning of 'source'
+    Lexer(std::string_view source, size_t begin, size_t limit, bool isRecovering);
+
+    // Returns false once the end of the source is reached. Unterminated blocks are
+    // returned with the 'error' member set and the lexer recovers at the next line that
+    // starts with something that looks like an entry
+    bool next(RawEntry& entry);
+
+    // The offset up to which the source has been consumed
+    size_t cursor() const;
+
+    bool isRecovering() const;
+
+private:
+    std::string_view _source;
+    size_t _cursor = 0;
+    size_t _limit = 0;
+
+    // After an unterminated entry was found, every line that starts with '@type{' is
+    // considered to start a new entry, regardless of the current brace depth. This keeps
+    // the recovery linear as no part of the file has to be scanned more than twice
+    bool _isRecovering = false;
+};
+
+// Returns the offset of the first '@' at or after 'from' that is at the beginning of a
+// line and followed by an entry type and an opening delimiter, or the size of the source.
+// This does not track any state, so it can be used to cheaply split a file into chunks
+// that can be lexed independently
+size_t findEntryStart(std::string_view source, size_t from);
+
+enum class ValueKind {
+    Braced,       // {...}
+    Quoted,       // "..."
+    Number,       // 2018
+    Macro,        // jan, tvcg
+    Concatenation // "IEEE " # tvcg
+};
+
+struct RawField {
+    std::string_view key;      // Empty for the value of a @preamble
+    std::string_view value;    // The full value as written, including delimiters
+    std::string_view contents; // The value without the surrounding "" or {}
+    ValueKind kind = ValueKind::Braced;
+};
+
+// Splits the body of a RawEntry into the cite key and the 'key = value' fields
+class FieldParser {
+public:
+    FieldParser(std::string_view body, EntryKind kind);
+
+    std::string_view citeKey() const;
+
+    // Returns false when there are no more fields or an error occurred
+    bool next(RawField& field);
+
+    LexError error() const;
+    // Pointer into the body at which the error occurred
+    const char* errorPosition() const;
+
+    // Removes the first part of a value from 'expression', which is a single macro name
+    // or a '#' concatenation, for example the 'value' of a RawField of those kinds. The
+    // part has the kind and contents it would have as a value on its own. Returns false
+    // once 'expression' is empty or if the next part is not a valid value
+    static bool nextPart(std::string_view& expression, RawField& part);
+
+private:
+    void skipWhitespace();
+    bool parseValue(RawField& field);
+    // Parses a single value without following '#' concatenations
+    bool parsePart(RawField& field);
+    void setError(LexError error, const char* position);
+
+    const char* _cursor;
+    const char* _end;
+    // Finds whitespace, identifiers, and the ends of values in the body
+    TokenScanner _tokens;
+    EntryKind _kind;
+    std::string_view _citeKey;
+
+    LexError _error = LexError::None;
+    const char* _errorPosition = nullptr;
+};
+
+// Returns true if the value contains line breaks, tabs, or runs of spaces that have to be
+// collapsed before the value can be used
+bool hasRedundantWhitespace(std::string_view value);
+
+// Collapses all runs of whitespace into a single space and removes leading and trailing
+// whitespace. 'buffer' must be at least as large as 'value'. Returns the number of bytes
+// that were written
+size_t normalizeWhitespace(std::string_view value, char* buffer);
+
+#endif // __BIBTEXFORMAT___LEXER___H__
@@ -0,0 +1,226 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "macros.h"
+
+#include "entry.h"
+#include "events.h"
+#include "hash.h"
+#include "lexer.h"
+
+#include <array>
+#include <string>
+#include <utility>
+
+namespace {
+    char toLower(char c) {
+        return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+
+    constexpr std::array<std::pair<std::string_view, std::string_view>, 12> Months = {{
+        { "jan", "January" },   { "feb", "February" }, { "mar", "March" },
+        { "apr", "April" },     { "may", "May" },      { "jun", "June" },
+        { "jul", "July" },      { "aug", "August" },   { "sep", "September" },
+        { "oct", "October" },   { "nov", "November" }, { "dec", "December" }
+    }};
+
+    // Defines the first field of every @string block and skips all other blocks
+    class MacroCollector : public ParseHandler {
+    public:
+        explicit MacroCollector(MacroTable& macros)
+            : _macros(macros)
+        {}
+
+        bool beginEntry(const EntryEvent& entry) override {
+            return entry.kind == EntryKind::String && entry.error == LexError::None;
+        }
+
+        bool field(const EntryEvent&, const FieldEvent& field) override {
+            const bool isExpression = field.kind == ValueKind::Macro ||
+                                      field.kind == ValueKind::Concatenation;
+            std::string_view value = field.value;
+            if (hasRedundantWhitespace(value)) {
+                _normalized.resize(value.size());
+                _normalized.resize(normalizeWhitespace(value, _normalized.data()));
+                value = _normalized;
+            }
+            _macros.define(field.key, value, isExpression);
+            return false;
+        }
+
+    private:
+        MacroTable& _macros;
+        std::string _normalized;
+    };
+} // namespace
+
+MacroTable::MacroTable() {
+    for (const auto& [name, expansion] : Months) {
+        define(name, expansion, false);
+    }
+}
+
+void MacroTable::collect(std::string_view source) {
+    collect(source, 0, source.size(), false);
+}
+
+void MacroTable::collect(std::string_view source, size_t begin, size_t limit,
+                         bool isRecovering)
+{
+    MacroCollector collector(*this);
+    parseEvents(source, begin, limit, isRecovering, collector);
+}
+
+void MacroTable::define(std::string_view name, std::string_view value,
+                        bool isExpression)
+{
+    // The expansion refers to the definitions before this one, even for a redefinition
+    // of a macro in terms of itself
+    const std::string_view expansion = isExpression ?
+        expand(value, true, _arena, nullptr) :
+        _arena.store(value);
+
+    const auto it = _symbols.find(name);
+    if (it != _symbols.end()) {
+        _table[it->second].expansion = expansion;
+        return;
+    }
+    const std::string_view storedName = _arena.store(name);
+    _symbols.emplace(storedName, static_cast<uint32_t>(_table.size()));
+    _table.push_back({ storedName, expansion });
+}
+
+uint32_t MacroTable::find(std::string_view name) const {
+    const auto it = _symbols.find(name);
+    return it == _symbols.end() ? NoSymbol : it->second;
+}
+
+std::string_view MacroTable::name(uint32_t symbol) const {
+    return _table[symbol].name;
+}
+
+std::string_view MacroTable::expansion(uint32_t symbol) const {
+    return _table[symbol].expansion;
+}
+
+size_t MacroTable::size() const {
+    return _table.size();
+}
+
+std::string_view MacroTable::expand(const Field& field, StringArena& arena,
+                                    std::string_view* undefined) const
+{
+    return expand(field.value, field.isExpression, arena, undefined);
+}
+
+uint64_t MacroTable::fingerprint() const {
+    uint64_t hash = _table.size();
+    for (const Symbol& symbol : _table) {
+        hash = hash64(symbol.name, hash);
+        hash = hash64(symbol.expansion, hash);
+    }
+    return hash;
+}
+
+std::string_view MacroTable::expand(std::string_view value, bool isExpression,
+                                    StringArena& arena,
+                                    std::string_view* undefined) const
+{
+    if (!isExpression) {
+        return value;
+    }
+
+    // Concatenations are joined in a temporary first, as their size is not known
+    std::string joined;
+    std::string_view single;
+    size_t nParts = 0;
+    RawField part;
+    while (FieldParser::nextPart(value, part)) {
+        std::string_view expansion = part.contents;
+        if (part.kind == ValueKind::Macro) {
+            const uint32_t symbol = find(part.contents);
+            if (symbol == NoSymbol) {
+                if (undefined && undefined->empty()) {
+                    *undefined = part.contents;
+                }
+                expansion = std::string_view();
+            }
+            else {
+                expansion = _table[symbol].expansion;
+            }
+        }
+
+        if (nParts == 0) {
+            single = expansion;
+        }
+        else {
+            if (nParts == 1) {
+                joined = single;
+            }
+            joined += expansion;
+        }
+        ++nParts;
+    }
+    return nParts > 1 ? arena.store(joined) : single;
+}
+
+size_t MacroTable::NameHash::operator()(std::string_view name) const {
+    // Names are short, so they are folded in a small buffer before they are hashed
+    char folded[64];
+    if (name.size() > sizeof(folded)) {
+        std::string copy(name);
+        for (char& c : copy) {
+            c = toLower(c);
+        }
+        return static_cast<size_t>(hash64(copy));
+    }
+    for (size_t i = 0; i < name.size(); ++i) {
+        folded[i] = toLower(name[i]);
+    }
+    return static_cast<size_t>(hash64(std::string_view(folded, name.size())));
+}
+
+bool MacroTable::NameEquals::operator()(std::string_view lhs,
+                                        std::string_view rhs) const {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        if (toLower(lhs[i]) != toLower(rhs[i])) {
+            return false;
+        }
+    }
+    return true;
+}
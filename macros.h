@@ -0,0 +1,119 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#ifndef __BIBTEXFORMAT___MACROS___H__
+#define __BIBTEXFORMAT___MACROS___H__
+
+#include "stringarena.h"
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct Field;
+
+// The @string macros of a bibliography. Every name is interned once into a symbol and
+// every expansion is stored once in the table, so that the thousands of fields that use
+// the same journal macro all share a view of one string instead of holding copies.
+// Names are case-insensitive, like in BibTeX
+class MacroTable {
+public:
+    static constexpr uint32_t NoSymbol = UINT32_MAX;
+
+    // Starts out with the month macros 'jan' to 'dec' that every BibTeX style defines
+    MacroTable();
+
+    MacroTable(MacroTable&&) = default;
+    MacroTable& operator=(MacroTable&&) = default;
+
+    // Defines the macros of all @string blocks of the source in file order, so a macro
+    // that is defined more than once has its last value. The blocks are found by the
+    // same lexer that parse() uses, so both always agree on what is a @string, but only
+    // the @string blocks are split into fields
+    void collect(std::string_view source);
+
+    // Only collects the @string blocks that start in [begin, limit), see parseEvents
+    void collect(std::string_view source, size_t begin, size_t limit, bool isRecovering);
+
+    // Defines or redefines a macro. The value is stored like in a Field: the contents of
+    // a literal, or the macro name or '#' concatenation if 'isExpression' is true, which
+    // is expanded with the macros that are defined at this point
+    void define(std::string_view name, std::string_view value, bool isExpression);
+
+    // Returns NoSymbol if no macro with that name has been defined
+    uint32_t find(std::string_view name) const;
+
+    std::string_view name(uint32_t symbol) const;
+    std::string_view expansion(uint32_t symbol) const;
+
+    // Number of symbols, including the months
+    size_t size() const;
+
+    // Returns the value of the field with all macros expanded. Literal values are
+    // returned as they are and a single macro as the view of its expansion in the table.
+    // Only concatenations are joined into a new string in the arena. Undefined macros
+    // expand to nothing, like in BibTeX; the first of them is stored in 'undefined'
+    std::string_view expand(const Field& field, StringArena& arena,
+                            std::string_view* undefined = nullptr) const;
+
+    // Changes whenever any name or expansion changes, so that results that depend on
+    // the macros can be cached
+    uint64_t fingerprint() const;
+
+private:
+    struct Symbol {
+        std::string_view name;
+        std::string_view expansion;
+    };
+
+    struct NameHash {
+        size_t operator()(std::string_view name) const;
+    };
+
+    struct NameEquals {
+        bool operator()(std::string_view lhs, std::string_view rhs) const;
+    };
+
+    std::string_view expand(std::string_view value, bool isExpression,
+                            StringArena& arena, std::string_view* undefined) const;
+
+    // The keys are the names in '_arena'
+    std::unordered_map<std::string_view, uint32_t, NameHash, NameEquals> _symbols;
+    std::vector<Symbol> _table;
+    StringArena _arena;
+};
+
+#endif // __BIBTEXFORMAT___MACROS___H__
@@ -32,595 +32,786 @@
  *                                                                                       *
 *****************************************************************************************/
 
+
+#include "cache.h"
+#include "diagnostic.h"
+#include "duplicates.h"
+#include "entry.h"
+#include "extract.h"
+#include "formatter.h"
+#include "index.h"
+#include "macros.h"
+#include "mappedfile.h"
+#include "outputbuffer.h"
+#include "parser.h"
+#include "server.h"
+#include "sorting.h"
+#include "stats.h"
+#include "stream.h"
+#include "stringpool.h"
+#include "threadpool.h"
+#include "validation.h"
+
 #include <algorithm>
-#include <assert.h>
-#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <map>
-#include <regex>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
-// Used in the operator[] to dump keywords without a member variable
-std::string DummyString;
-
-enum class Type {
-    Unknown = -1,
-    Article = 0,
-    Book,
-    Booklet,
-    InBook,
-    InCollection,
-    InProceedings,
-    Manual,
-    MastersThesis,
-    Misc,
-    PhDThesis,
-    Proceedings,
-    TechReport,
-    Unpublished
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif // _WIN32
+
+struct Options {
+    bool shouldFormat = false;
+    bool isInPlace = false;
+    bool findsDuplicates = false;
+    bool findsNearDuplicates = false;
+    double nearDuplicateThreshold = 0.8;
+    DiagnosticFormat diagnosticFormat = DiagnosticFormat::Text;
+    const ValidationCache* cache = nullptr;
+    const RuleSet* rules = nullptr;
+    Statistics* stats = nullptr;
 };
 
-Type typeFromString(const std::string& type) {
-    if (type == "article") {        return Type::Article;       }
-    if (type == "book") {           return Type::Book;          }
-    if (type == "booklet") {        return Type::Booklet;       }
-    if (type == "conference") {     return Type::InProceedings; }
-    if (type == "inbook") {         return Type::InBook;        }
-    if (type == "incollection") {   return Type::InCollection;  }
-    if (type == "inproceedings") {  return Type::InProceedings; }
-    if (type == "manual") {         return Type::Manual;        }
-    if (type == "mastersthesis") {  return Type::MastersThesis; }
-    if (type == "misc") {           return Type::Misc;          }
-    if (type == "phdthesis") {      return Type::PhDThesis;     }
-    if (type == "proceedings") {    return Type::Proceedings;   }
-    if (type == "techreport") {     return Type::TechReport;    }
-    if (type == "unpublished") {    return Type::Unpublished;   }
-    return Type::Unknown;
-}
+// Everything that is reported about one file after it has been processed
+struct FileReport {
+    // In the format of Options::diagnosticFormat
+    std::string diagnostics;
+    size_t nDiagnostics = 0;
 
-enum class Keyword {
-    Unknown = -1,
-    Address = 0,
-    Author,
-    BookTitle,
-    Chapter,
-    Doi,
-    Edition,
-    Editor,
-    Institution,
-    Journal,
-    HowPublished,
-    Key,
-    Month,
-    Note,
-    Number,
-    Organization,
-    Pages,
-    Publisher,
-    School,
-    Series,
-    Title,
-    Type,
-    Url,
-    Volume,
-    Year
+    // The reason why the file could not be processed or an empty string on success
+    std::string error;
+
+    // Only collected when looking for duplicates or near-duplicates
+    std::vector<EntryKeys> keys;
+
+    // Only the diagnostics and cache records are kept, as the file itself has already
+    // been closed. They are used to write the cache file at the end of the run
+    std::vector<ParseResult> cacheResults;
 };
 
-Keyword keywordFromString(const std::string& keyword) {
-    if (keyword == "address") {         return Keyword::Address;        }
-    if (keyword == "author") {          return Keyword::Author;         }
-    if (keyword == "booktitle") {       return Keyword::BookTitle;      }
-    if (keyword == "chapter") {         return Keyword::Chapter;        }
-    if (keyword == "doi") {             return Keyword::Doi;            }
-    if (keyword == "edition") {         return Keyword::Edition;        }
-    if (keyword == "editor") {          return Keyword::Editor;         }
-    if (keyword == "institution") {     return Keyword::Institution;    }
-    if (keyword == "journal") {         return Keyword::Journal;        }
-    if (keyword == "howpublished") {    return Keyword::HowPublished;   }
-    if (keyword == "key") {             return Keyword::Key;            }
-    if (keyword == "month") {           return Keyword::Month;          }
-    if (keyword == "note") {            return Keyword::Note;           }
-    if (keyword == "number") {          return Keyword::Number;         }
-    if (keyword == "organization") {    return Keyword::Organization;   }
-    if (keyword == "pages") {           return Keyword::Pages;          }
-    if (keyword == "publisher") {       return Keyword::Publisher;      }
-    if (keyword == "school") {          return Keyword::School;         }
-    if (keyword == "series") {          return Keyword::Series;         }
-    if (keyword == "title") {           return Keyword::Title;          }
-    if (keyword == "type") {            return Keyword::Type;           }
-    if (keyword == "url") {             return Keyword::Url;            }
-    if (keyword == "volume") {          return Keyword::Volume;         }
-    if (keyword == "year") {            return Keyword::Year;           }
-    return Keyword::Unknown;
+// Writes the formatted bibliography into the file. Returns false if writing failed
+bool writeFormatted(std::FILE* file, const std::vector<ParseResult>& results) {
+    OutputBuffer output(file);
+    Formatter formatter(output);
+    for (const ParseResult& result : results) {
+        for (const Block& block : result.blocks) {
+            const bool canFormat = block.entryIndex != Block::NoEntry &&
+                result.entries[block.entryIndex].entryType != Type::Unknown;
+            if (canFormat) {
+                formatter.write(result.entries[block.entryIndex]);
+            }
+            else {
+                formatter.writeVerbatim(block.text);
+            }
+        }
+    }
+    return output.flush();
 }
 
-const std::map<Type, std::vector<Keyword>> AcceptedKeywords = {
-    {
-        Type::Article,
-        {   
-            Keyword::Author, Keyword::Title,  Keyword::Journal, Keyword::Year, 
-            Keyword::Volume, Keyword::Number, Keyword::Pages,   Keyword::Month,
-            Keyword::Note,   Keyword::Key,    Keyword::Doi
-        }
-    },
-    {
-        Type::Book,
-        {
-            Keyword::Title,   Keyword::Publisher, Keyword::Year,   Keyword::Author,
-            Keyword::Editor,  Keyword::Volume,    Keyword::Number, Keyword::Series,
-            Keyword::Address, Keyword::Edition,   Keyword::Month,  Keyword::Note,
-            Keyword::Key,     Keyword::Url,       Keyword::Doi
-        }
-    },
-    {
-        Type::Booklet,
-        {
-            Keyword::Title, Keyword::Author, Keyword::HowPublished, Keyword::Address, 
-            Keyword::Month, Keyword::Year,   Keyword::Note,         Keyword::Key,
-            Keyword::Doi
-        }
-    },
-    {
-        Type::InBook,
-        {
-            Keyword::Title,     Keyword::Publisher, Keyword::Year,  Keyword::Author,
-            Keyword::Editor,    Keyword::Chapter,   Keyword::Pages, Keyword::Volume,   
-            Keyword::Number,    Keyword::Series,    Keyword::Type,  Keyword::Address,
-            Keyword::Edition,   Keyword::Month,     Keyword::Note,  Keyword::Key,
-            Keyword::Doi
-        }
-    },
-    {
-        Type::InCollection,
-        {
-            Keyword::Author,  Keyword::Title,   Keyword::BookTitle, Keyword::Publisher,
-            Keyword::Year,    Keyword::Editor,  Keyword::Volume,    Keyword::Number,   
-            Keyword::Series,  Keyword::Type,    Keyword::Chapter,   Keyword::Pages,
-            Keyword::Address, Keyword::Edition, Keyword::Month,     Keyword::Note,
-            Keyword::Key,     Keyword::Doi
-        }
-    },
-    {
-        Type::InProceedings,
-        {
-            Keyword::Author,    Keyword::Title,   Keyword::BookTitle, Keyword::Year,
-            Keyword::Editor,    Keyword::Volume,  Keyword::Number,    Keyword::Series,
-            Keyword::Pages,     Keyword::Address, Keyword::Month,   Keyword::Organization,
-            Keyword::Publisher, Keyword::Note,    Keyword::Key,       Keyword::Doi
-        }
-    },
-    {
-        Type::Manual,
-        {
-            Keyword::Title,   Keyword::Author, Keyword::Organization, Keyword::Address,
-            Keyword::Edition, Keyword::Month,  Keyword::Year,         Keyword::Note,
-            Keyword::Key,     Keyword::Doi
-        }
-    },
-    {
-        Type::MastersThesis,
-        {
-            Keyword::Author, Keyword::Title,   Keyword::School, Keyword::Year,
-            Keyword::Type,   Keyword::Address, Keyword::Month,  Keyword::Note,
-            Keyword::Key,    Keyword::Doi
-        }
-    },
-    {
-        Type::Misc,
-        {
-            Keyword::Author, Keyword::Title, Keyword::HowPublished, Keyword::Month,
-            Keyword::Year,   Keyword::Note,  Keyword::Key,          Keyword::Doi
-        }
-    },
-    {
-        Type::PhDThesis,
-        {
-            Keyword::Author, Keyword::Title, Keyword::School, Keyword::Year,
-            Keyword::Type,   Keyword::Address, Keyword::Month,  Keyword::Note,
-            Keyword::Key,    Keyword::Doi
-        }
-    },
-    {
-        Type::Proceedings,
-        {
-            Keyword::Title,    Keyword::Year,          Keyword::Editor,  Keyword::Volume,
-            Keyword::Number,    Keyword::Series,       Keyword::Address, Keyword::Month,
-            Keyword::Publisher, Keyword::Organization, Keyword::Note,    Keyword::Key,
-            Keyword::Doi
-        }
-    },
-    {
-        Type::TechReport,
-        {
-            Keyword::Author, Keyword::Title,  Keyword::Institution, Keyword::Year,
-            Keyword::Type,   Keyword::Number, Keyword::Address,     Keyword::Month,
-            Keyword::Note,   Keyword::Key,    Keyword::Doi
-        }
-    },
-    {
-        Type::Unpublished,
-        {
-            Keyword::Author, Keyword::Title, Keyword::Note, Keyword::Month,
-            Keyword::Year,   Keyword::Key,   Keyword::Doi
-        }
+// Write into a temporary file next to the original, which is then moved over the
+// original. This way the original is either fully replaced or left untouched. Returns
+// the reason for the failure or an empty string on success
+std::string replaceFormatted(const std::string& path, std::unique_ptr<MappedFile>& file,
+                             std::vector<ParseResult>& results)
+{
+    std::filesystem::path target = path;
+    std::filesystem::path temporary = target;
+    temporary += ".bibtexformat.tmp";
+
+    std::FILE* output = std::fopen(temporary.string().c_str(), "wb");
+    if (!output) {
+        return "Could not create temporary file " + temporary.string();
+    }
+    const bool success = writeFormatted(output, results);
+    const bool closed = std::fclose(output) == 0;
+    if (!success || !closed) {
+        std::filesystem::remove(temporary);
+        return "Could not write formatted output to " + temporary.string();
     }
-};
 
-struct Entry {
-    std::string& operator[](Keyword keyword) {
-        switch (keyword) {
-            case Keyword::Address:      return address;
-            case Keyword::Author:       return author;
-            case Keyword::BookTitle:    return bookTitle;
-            case Keyword::Chapter:      return chapter;
-            case Keyword::Doi:          return doi;
-            case Keyword::Edition:      return edition;
-            case Keyword::Editor:       return editor;
-            case Keyword::Institution:  return institution;
-            case Keyword::Journal:      return journal;
-            case Keyword::HowPublished: return howPublished;
-            case Keyword::Key:          return key;
-            case Keyword::Month:        return month;
-            case Keyword::Note:         return note;
-            case Keyword::Number:       return number;
-            case Keyword::Organization: return organization;
-            case Keyword::Pages:        return pages;
-            case Keyword::Publisher:    return publisher;
-            case Keyword::School:       return school;
-            case Keyword::Series:       return series;
-            case Keyword::Title:        return title;
-            case Keyword::Type:         return type;
-            case Keyword::Url:          return url;
-            case Keyword::Volume:       return volume;
-            case Keyword::Year:         return year;
-            default:                    return DummyString;
-        }
-    }
-
-    const std::string& operator[](Keyword keyword) const {
-        switch (keyword) {
-            case Keyword::Address:      return address;
-            case Keyword::Author:       return author;
-            case Keyword::BookTitle:    return bookTitle;
-            case Keyword::Chapter:      return chapter;
-            case Keyword::Doi:          return doi;
-            case Keyword::Edition:      return edition;
-            case Keyword::Editor:       return editor;
-            case Keyword::Institution:  return institution;
-            case Keyword::Journal:      return journal;
-            case Keyword::HowPublished: return howPublished;
-            case Keyword::Key:          return key;
-            case Keyword::Month:        return month;
-            case Keyword::Note:         return note;
-            case Keyword::Number:       return number;
-            case Keyword::Organization: return organization;
-            case Keyword::Pages:        return pages;
-            case Keyword::Publisher:    return publisher;
-            case Keyword::School:       return school;
-            case Keyword::Series:       return series;
-            case Keyword::Title:        return title;
-            case Keyword::Type:         return type;
-            case Keyword::Url:          return url;
-            case Keyword::Volume:       return volume;
-            case Keyword::Year:         return year;
-            default:                    return DummyString;
-        }
-    }
-
-    std::string citeKey;
-    Type entryType;
-
-    std::string address;
-    std::string author;
-    std::string bookTitle;
-    std::string chapter;
-    std::string doi;
-    std::string edition;
-    std::string editor;
-    std::string institution;
-    std::string journal;
-    std::string howPublished;
-    std::string key;
-    std::string month;
-    std::string note;
-    std::string number;
-    std::string organization;
-    std::string pages;
-    std::string publisher;
-    std::string school;
-    std::string series;
-    std::string title;
-    std::string type;
-    std::string url;
-    std::string volume;
-    std::string year;
-};
+    // The file has to be unmapped before it can be replaced on some operating systems
+    results.clear();
+    file = nullptr;
 
-std::vector<std::string> checkCompleteness(const Entry& entry) {
-    auto checkRequired = [](const Entry& entry,
-                            std::vector<Keyword> keywords,
-                            std::vector<std::pair<Keyword, Keyword>> keywordPairs = {})
-        -> std::vector<std::string>
-    {
-        auto keywordToString = [](Keyword keyword) -> std::string {
-            switch (keyword) {
-                case Keyword::Address:      return "address";
-                case Keyword::Author:       return "author";
-                case Keyword::BookTitle:    return "booktitle";
-                case Keyword::Chapter:      return "chapter";
-                case Keyword::Doi:          return "doi";
-                case Keyword::Edition:      return "edition";
-                case Keyword::Editor:       return "editor";
-                case Keyword::Institution:  return "institution";
-                case Keyword::Journal:      return "journal";
-                case Keyword::HowPublished: return "howPublished";
-                case Keyword::Key:          return "key";
-                case Keyword::Month:        return "month";
-                case Keyword::Note:         return "note";
-                case Keyword::Number:       return "number";
-                case Keyword::Organization: return "organization";
-                case Keyword::Pages:        return "pages";
-                case Keyword::Publisher:    return "publisher";
-                case Keyword::School:       return "school";
-                case Keyword::Series:       return "series";
-                case Keyword::Title:        return "title";
-                case Keyword::Type:         return "type";
-                case Keyword::Url:          return "url";
-                case Keyword::Volume:       return "volume";
-                case Keyword::Year:         return "year";
-                default:                    return "";
-            }
-        };
-        
-        bool failed = std::any_of(
-            keywords.begin(),
-            keywords.end(),
-            [entry](Keyword k) { return entry[k].empty(); }
-        );
+    std::error_code error;
+    std::filesystem::permissions(
+        temporary,
+        std::filesystem::status(target).permissions(),
+        error
+    );
+    std::filesystem::rename(temporary, target, error);
+    if (error) {
+        std::filesystem::remove(temporary);
+        return "Could not replace " + path + ": " + error.message();
+    }
+    return std::string();
+}
 
-        if (!keywordPairs.empty()) {
-            failed &= std::any_of(
-                keywordPairs.begin(),
-                keywordPairs.end(),
-                [entry](const std::pair<Keyword, Keyword>& p) {
-                return entry[p.first].empty() || entry[p.second].empty();
-            }
-            );
+// Checks and formats one file. Parsing is split across 'nThreads' threads, which is only
+// worth it for large files when no other files are processed at the same time
+FileReport processFile(const std::string& path, const Options& options,
+                       unsigned int nThreads)
+{
+    Stopwatch stopwatch;
+    auto endPhase = [&options, &stopwatch](Phase phase) {
+        const uint64_t nanoseconds = stopwatch.lap();
+        if (options.stats) {
+            options.stats->addPhase(phase, nanoseconds);
         }
+    };
 
-        if (failed) {
-            std::vector<std::string> result;
-            std::for_each(
-                keywords.begin(),
-                keywords.end(),
-                [&result, entry, keywordToString](Keyword k) { 
-                    if (entry[k].empty()) {
-                        result.push_back(keywordToString(k));
-                    }
-                }
-            );
+    FileReport report;
+    auto file = std::make_unique<MappedFile>(path);
+    if (!file->isValid()) {
+        report.error = "Could not open BibTex file " + path;
+        return report;
+    }
+    std::string_view contents = file->contents();
+    // As the file is mapped, most of the reading happens while lexing
+    endPhase(Phase::Read);
+
+    // The macros are needed before any entry can be checked, but the chunks are parsed
+    // in parallel, so the definitions are collected up front
+    MacroTable macros;
+    macros.collect(contents);
+    endPhase(Phase::Lex);
+
+    ParseOptions parseOptions;
+    parseOptions.needsEntries = options.shouldFormat || options.findsDuplicates ||
+        options.findsNearDuplicates;
+    parseOptions.cache = options.cache;
+    parseOptions.macros = &macros;
+    parseOptions.rules = options.rules;
+    parseOptions.collectCacheRecords = options.cache != nullptr;
+    if (options.stats) {
+        parseOptions.measuresTime = true;
+        parseOptions.nSlowestEntries = options.stats->nSlowestEntries();
+    }
 
-            std::for_each(
-                keywordPairs.begin(),
-                keywordPairs.end(),
-                [&result, entry, keywordToString](const std::pair<Keyword, Keyword>& p) {
-                    if (entry[p.first].empty() || entry[p.second].empty()) {
-                        result.push_back(
-                            keywordToString(p.first) + " or " + keywordToString(p.second)
-                        );
-                    }
-                }
+    std::vector<ParseResult> results;
+    if (nThreads == 1) {
+        results.resize(1);
+        parse(contents, 0, contents.size(), false, parseOptions, results[0]);
+    }
+    else {
+        results = parseParallel(contents, nThreads, parseOptions);
+    }
+    if (options.stats) {
+        options.stats->addFile(contents.size());
+        for (const ParseResult& result : results) {
+            options.stats->addTimings(path, contents, result.timings);
+        }
+    }
+    // The parse itself is already recorded as the lex and validate phases
+    stopwatch.lap();
+
+    // The diagnostics are still needed for the cache records if there is a cache
+    std::vector<Diagnostic> diagnostics;
+    for (ParseResult& result : results) {
+        if (options.cache) {
+            diagnostics.insert(
+                diagnostics.end(),
+                result.diagnostics.begin(),
+                result.diagnostics.end()
             );
-            return result;
         }
         else {
-            return {};
-        }
-    };
-    switch (entry.entryType) {
-        case Type::Article:
-            return checkRequired(
-                entry,
-                { Keyword::Author, Keyword::Title, Keyword::Journal, Keyword::Year,
-                  Keyword::Volume }
-            );
-        case Type::Book:
-            return checkRequired(
-                entry,
-                { Keyword::Title, Keyword::Publisher, Keyword::Year },
-                { { Keyword::Author, Keyword::Editor } }
-            );
-        case Type::Booklet:
-            return checkRequired(entry, { Keyword::Title });
-        case Type::InBook:
-            return checkRequired(
-                entry,
-                { Keyword::Title, Keyword::Publisher, Keyword::Year },
-                { { Keyword::Author, Keyword::Editor },
-                  { Keyword::Chapter, Keyword::Pages } }
-            );
-        case Type::InCollection:
-            return checkRequired(
-                entry,
-                { Keyword::Author, Keyword::Title, Keyword::BookTitle, Keyword::Publisher,
-                  Keyword::Year }
-            );
-        case Type::InProceedings:
-            return checkRequired(
-                entry,
-                { Keyword::Author, Keyword::Title, Keyword::BookTitle, Keyword::Year }
-            );
-        case Type::Manual:
-            return checkRequired(entry, { Keyword::Title });
-        case Type::MastersThesis:
-            return checkRequired(
-                entry,
-                { Keyword::Author, Keyword::Title, Keyword::School, Keyword::Year }
-            ); 
-        case Type::Misc:
-            return {};
-        case Type::PhDThesis:
-            return checkRequired(
-                entry,
-                { Keyword::Author, Keyword::Title, Keyword::School, Keyword::Year }
+            diagnostics.insert(
+                diagnostics.end(),
+                std::make_move_iterator(result.diagnostics.begin()),
+                std::make_move_iterator(result.diagnostics.end())
             );
-        case Type::Proceedings:
-            return checkRequired(
-                entry,
-                { Keyword::Title, Keyword::Year }
-            );
-        case Type::TechReport:
-            return checkRequired(
-                entry,
-                { Keyword::Author, Keyword::Title, Keyword::Institution, Keyword::Year }
-            );
-        case Type::Unpublished:
-            return checkRequired(
-                entry,
-                { Keyword::Author, Keyword::Title, Keyword::Note}
-            );
-        default:
-            return {};
+        }
     }
-}
+    appendDiagnostics(
+        report.diagnostics,
+        options.diagnosticFormat,
+        path,
+        contents,
+        diagnostics
+    );
+    report.nDiagnostics = diagnostics.size();
+    endPhase(Phase::Diagnostics);
 
-int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cerr << "Missing argument for BibTex file\n";
-        return -1;
+    if (options.findsDuplicates || options.findsNearDuplicates) {
+        report.keys = collectKeys(contents, results, options.findsNearDuplicates);
+        endPhase(Phase::Duplicates);
     }
 
-    std::string contents(
-        (std::istreambuf_iterator<char>(std::ifstream(argv[1]))),
-        std::istreambuf_iterator<char>()
-    );
+    if (options.cache) {
+        for (ParseResult& result : results) {
+            ParseResult& cacheResult = report.cacheResults.emplace_back();
+            cacheResult.diagnostics = std::move(result.diagnostics);
+            cacheResult.cacheRecords = std::move(result.cacheRecords);
+        }
+    }
+
+    if (options.shouldFormat && !options.isInPlace) {
+        if (!writeFormatted(stdout, results)) {
+            report.error = "Could not write formatted output";
+        }
+    }
+    else if (options.isInPlace) {
+        report.error = replaceFormatted(path, file, results);
+    }
+    if (options.shouldFormat) {
+        endPhase(Phase::Format);
+    }
+    return report;
+}
 
-    // Match:
-    // @.... {
-    //  .....\n
-    //  .....\n
-    //  .....
-    // }
-    std::regex regex(
-        "@(.*)\\{((.*)(\\n)*)*?\\}",
-        std::regex_constants::ECMAScript | std::regex_constants::icase
+// Adds the path or, for a directory, all .bib files below it in a stable order. Paths
+// that don't exist are added as well, so that they are reported as files that could not
+// be opened
+void collectFiles(const std::string& path, std::vector<std::string>& files) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(path, error)) {
+        files.push_back(path);
+        return;
+    }
+
+    std::vector<std::string> found;
+    std::filesystem::recursive_directory_iterator it(
+        path,
+        std::filesystem::directory_options::skip_permission_denied,
+        error
     );
+    while (!error && it != std::filesystem::recursive_directory_iterator()) {
+        if (it->is_regular_file(error) && it->path().extension() == ".bib") {
+            found.push_back(it->path().string());
+        }
+        it.increment(error);
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
 
-    std::vector<Entry> entries;
-    std::smatch match;
-    while (std::regex_search(contents, match, regex)) {
-        std::string reference = match.str();
+// Reads the argument of -j, which has to be a whole positive number. Returns false for
+// anything else, including trailing characters, signs, and values that don't fit
+bool parseThreadCount(const char* text, unsigned int& nThreads) {
+    if (*text < '0' || *text > '9') {
+        return false;
+    }
+    errno = 0;
+    char* end = nullptr;
+    const unsigned long value = std::strtoul(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE || value == 0 || value > UINT_MAX) {
+        return false;
+    }
+    nThreads = static_cast<unsigned int>(value);
+    return true;
+}
 
-        Entry entry;
-        std::vector<std::string> extraFields;
+int main(int argc, char** argv) {
+    Stopwatch runTime;
+    unsigned int nThreads = 1;
+    bool hasThreadCount = false;
+    bool isStreaming = false;
+    size_t nSlowestEntries = 0;
+    bool hasStats = false;
+    bool buildsIndex = false;
+    bool sorts = false;
+    bool merges = false;
+    SortOrder sortOrder = SortOrder::CiteKey;
+    CollisionPolicy collisionPolicy = CollisionPolicy::KeepFirst;
+    std::string lookupPath;
+    std::vector<std::string> auxPaths;
+    Options options;
+    std::string cachePath;
+    std::string rulesPath;
+    bool runsServer = false;
+    std::string filesFrom;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--lsp") {
+            runsServer = true;
+        }
+        else if ((arg == "-j" && i + 1 < argc) ||
+                 (arg.substr(0, 2) == "-j" && arg.size() > 2))
+        {
+            // Both -j 4 and -j4
+            const char* count = arg.size() > 2 ? argv[i] + 2 : argv[++i];
+            if (!parseThreadCount(count, nThreads)) {
+                std::cerr << "The number of threads has to be a positive integer, not ";
+                std::cerr << count << '\n';
+                return -1;
+            }
+            hasThreadCount = true;
+        }
+        else if (arg == "--format") {
+            options.shouldFormat = true;
+        }
+        else if (arg == "-i" || arg == "--in-place") {
+            options.shouldFormat = true;
+            options.isInPlace = true;
+        }
+        else if (arg == "--cache" && i + 1 < argc) {
+            cachePath = argv[++i];
+        }
+        else if (arg == "--rules" && i + 1 < argc) {
+            rulesPath = argv[++i];
+        }
+        else if (arg == "--duplicates") {
+            options.findsDuplicates = true;
+        }
+        else if (arg == "--near-duplicates") {
+            options.findsNearDuplicates = true;
+        }
+        else if (arg.substr(0, 18) == "--near-duplicates=") {
+            options.findsNearDuplicates = true;
+            options.nearDuplicateThreshold = std::strtod(argv[i] + 18, nullptr);
+            if (!(options.nearDuplicateThreshold > 0.0) ||
+                options.nearDuplicateThreshold > 1.0)
+            {
+                std::cerr << "The near-duplicate threshold has to be in (0, 1]\n";
+                return -1;
+            }
+        }
+        else if (arg == "--files-from" && i + 1 < argc) {
+            filesFrom = argv[++i];
+        }
+        else if (arg == "--stream") {
+            isStreaming = true;
+        }
+        else if (arg == "--index") {
+            buildsIndex = true;
+        }
+        else if (arg == "--lookup" && i + 1 < argc) {
+            lookupPath = argv[++i];
+        }
+        else if (arg == "--aux" && i + 1 < argc) {
+            auxPaths.emplace_back(argv[++i]);
+        }
+        else if (arg == "--sort" || arg == "--merge") {
+            sorts = arg == "--sort";
+            merges = arg == "--merge";
+        }
+        else if (arg.substr(0, 7) == "--sort=" || arg.substr(0, 8) == "--merge=") {
+            sorts = arg.substr(0, 7) == "--sort=";
+            merges = !sorts;
+            std::string_view name = arg.substr(arg.find('=') + 1);
+            if (!sortOrderFromName(name, sortOrder)) {
+                std::cerr << "Unknown sort order " << name << '\n';
+                return -1;
+            }
+        }
+        else if (arg.substr(0, 15) == "--on-collision=") {
+            std::string_view name = arg.substr(15);
+            if (!collisionPolicyFromName(name, collisionPolicy)) {
+                std::cerr << "Unknown collision policy " << name << '\n';
+                return -1;
+            }
+        }
+        else if (arg == "--stats") {
+            hasStats = true;
+            nSlowestEntries = 10;
+        }
+        else if (arg.substr(0, 8) == "--stats=") {
+            hasStats = true;
+            nSlowestEntries = std::strtoull(argv[i] + 8, nullptr, 10);
+        }
+        else if (arg.substr(0, 14) == "--diagnostics=") {
+            std::string_view format = arg.substr(14);
+            if (format == "text") {
+                options.diagnosticFormat = DiagnosticFormat::Text;
+            }
+            else if (format == "json") {
+                options.diagnosticFormat = DiagnosticFormat::Json;
+            }
+            else if (format == "sarif") {
+                options.diagnosticFormat = DiagnosticFormat::Sarif;
+            }
+            else {
+                std::cerr << "Unknown diagnostics format " << format << '\n';
+                return -1;
+            }
+        }
+        else {
+            paths.emplace_back(arg);
+        }
+    }
 
-        size_t firstBracket = reference.find_first_of('{');
+    // The custom rules are compiled once and shared by all files and threads
+    RuleSet rules;
+    if (!rulesPath.empty()) {
+        const std::string error = rules.load(rulesPath);
+        if (!error.empty()) {
+            std::cerr << error << '\n';
+            return -1;
+        }
+        options.rules = &rules;
+    }
 
-        std::string typeInfo = reference.substr(1, firstBracket - 1);
-        entry.entryType = typeFromString(typeInfo);
+    // The documents come from the editor, but are checked like files
+    if (runsServer) {
+        return runLanguageServer(options.rules);
+    }
 
-        size_t firstComma = reference.find_first_of(',', firstBracket);
-        entry.citeKey = reference.substr(firstBracket + 1, firstComma - firstBracket - 1);
+    // The remaining arguments are the cite keys to look up
+    if (!lookupPath.empty()) {
+        return lookupEntries(lookupPath, paths);
+    }
 
-        if (entry.entryType == Type::Unknown) {
-            std::cerr << "Error in: " << entry.citeKey << '\n';
-            std::cerr << "Unknown type: " << typeInfo << "\n";
+    if (paths.empty() && filesFrom.empty()) {
+        std::cerr << "Missing argument for BibTex file\n";
+        std::cerr << "Usage: BibTexFormat [-j threads] [--format | --in-place] ";
+        std::cerr << "[--diagnostics=text|json|sarif] [--duplicates] ";
+        std::cerr << "[--near-duplicates[=threshold]] [--rules file] [--cache file] ";
+        std::cerr << "[--stats[=n]] [--files-from list] <file or directory>...\n";
+        std::cerr << "       BibTexFormat [--format] [--stream] [--stats[=n]] ";
+        std::cerr << "<file or - for stdin>\n";
+        std::cerr << "       BibTexFormat [--format] --aux <file.aux>... <file>\n";
+        std::cerr << "       BibTexFormat [--format] [-j threads] ";
+        std::cerr << "--sort[=key|year|venue] <file>\n";
+        std::cerr << "       BibTexFormat [--format] --merge[=key|year|venue] ";
+        std::cerr << "[--on-collision=first|last|all|error] <sorted file>...\n";
+        std::cerr << "       BibTexFormat --index <file>...\n";
+        std::cerr << "       BibTexFormat --lookup <file> <cite key or - for stdin>...\n";
+        std::cerr << "       BibTexFormat --lsp [--rules file]\n";
+        return -1;
+    }
 
+    // Extracting the cited entries writes them to stdout instead of checking the file
+    if (!auxPaths.empty()) {
+        if (paths.size() != 1 || !filesFrom.empty() || options.isInPlace) {
+            std::cerr << "--aux extracts from a single file to stdout and can't be ";
+            std::cerr << "combined with --in-place or --files-from\n";
+            return -1;
+        }
+        CitationSet citations;
+        for (const std::string& auxPath : auxPaths) {
+            if (!citations.readAux(auxPath)) {
+                std::cerr << "Could not open aux file " << auxPath << '\n';
+                return -1;
+            }
+        }
+        MappedFile file(paths[0]);
+        if (!file.isValid()) {
+            std::cerr << "Could not open BibTex file " << paths[0] << '\n';
+            return -1;
         }
 
-        reference = reference.substr(firstComma + 1 + 1); // ,\n
-        while (!reference.empty()) {
-            // Removes whitespaces from the front and the end of the string
-            auto trim = [](std::string& string) {
-                string.erase(
-                    string.begin(),
-                    std::find_if(
-                        string.begin(),
-                        string.end(),
-                        [](int ch) { return !std::isspace(ch); }
-                    )
-                );
-                string.erase(
-                    std::find_if(
-                        string.rbegin(),
-                        string.rend(),
-                        [](int ch) { return !std::isspace(ch); }
-                    ).base(),
-                    string.end()
-                );
-            };
-
-            trim(reference);
+        OutputBuffer output(stdout);
+        const std::vector<std::string> missing =
+            extractCitations(file.contents(), citations, options.shouldFormat, output);
+        if (!output.flush()) {
+            std::cerr << "Could not write the extracted entries\n";
+            return -1;
+        }
+        for (const std::string& citeKey : missing) {
+            std::cerr << "Cite key not found: " << citeKey << '\n';
+        }
+        return missing.empty() ? 0 : -1;
+    }
 
-            size_t endLine = reference.find_first_of('\n');
+    // Sorting and merging write the reordered bibliography to stdout instead of checking
+    // the files
+    if (sorts || merges) {
+        if ((sorts && paths.size() != 1) || !filesFrom.empty() || options.isInPlace) {
+            std::cerr << "--sort works on a single file and --merge on several, both ";
+            std::cerr << "write to stdout and can't be combined with --in-place or ";
+            std::cerr << "--files-from\n";
+            return -1;
+        }
+        OutputBuffer output(stdout);
+        if (merges) {
+            const MergeReport report = mergeSorted(
+                paths,
+                sortOrder,
+                collisionPolicy,
+                options.shouldFormat,
+                output
+            );
+            for (const std::string& citeKey : report.collisions) {
+                std::cerr << "Cite key used by more than one entry: " << citeKey << '\n';
+            }
+            if (!report.error.empty()) {
+                std::cerr << report.error << '\n';
+                return -1;
+            }
+            return 0;
+        }
 
-            std::string line = reference.substr(0, endLine);
+        MappedFile file(paths[0]);
+        if (!file.isValid()) {
+            std::cerr << "Could not open BibTex file " << paths[0] << '\n';
+            return -1;
+        }
+        // Sorting by venue compares the interned venues as integers
+        StringPool venues;
+        ParseOptions sortOptions;
+        if (sortOrder == SortOrder::Venue) {
+            sortOptions.venues = &venues;
+        }
+        const std::vector<ParseResult> results =
+            parseParallel(file.contents(), nThreads, sortOptions);
+        const bool isWritten = writeSorted(
+            results,
+            sortOrder,
+            options.shouldFormat,
+            nThreads,
+            output,
+            sortOptions.venues
+        );
+        if (!isWritten) {
+            std::cerr << "Could not write the sorted bibliography\n";
+            return -1;
+        }
+        return 0;
+    }
 
-            if (line.back() == ',') {
-                line = line.substr(0, line.size() - 1);
+    // Building an index only parses the files, they are neither checked nor formatted
+    if (buildsIndex) {
+        int result = 0;
+        for (const std::string& path : paths) {
+            const std::string error = writeIndex(path);
+            if (!error.empty()) {
+                std::cerr << error << '\n';
+                result = -1;
             }
+        }
+        return result;
+    }
 
-            // There might not need to be a space between the keyword and the =
-            size_t endKeywordSpace = line.find_first_of(' ');
-            size_t endKeywordEquals = line.find_first_of('=');
-            size_t endKeyword = std::min(endKeywordSpace, endKeywordEquals);
-            std::string keyword = line.substr(0, endKeyword);
-
-            std::string value = line.substr(endKeywordEquals + 1);
+    // The machine readable formats are written to stdout, which is not possible if the
+    // formatted bibliography goes there
+    const bool isMachineReadable = options.diagnosticFormat != DiagnosticFormat::Text;
+    if (isMachineReadable && options.shouldFormat && !options.isInPlace) {
+        std::cerr << "--diagnostics=json and --diagnostics=sarif write to stdout and ";
+        std::cerr << "can't be combined with --format\n";
+        return -1;
+    }
+    std::FILE* diagnosticsFile = isMachineReadable ? stdout : stderr;
+
+    // The statistics go to stderr after everything else has been written. Allocations
+    // are only counted from here on, so that they describe the processing of the files
+    std::unique_ptr<Statistics> stats;
+    if (hasStats) {
+        stats = std::make_unique<Statistics>(nSlowestEntries);
+        options.stats = stats.get();
+        setAllocationCounting(true);
+    }
+    auto writeStats = [&stats, &runTime]() {
+        if (stats) {
+            setAllocationCounting(false);
+            std::cerr << stats->report(runTime.lap(), allocationCounts());
+        }
+    };
 
-            trim(value);
+    // Streaming never holds more than a few chunks of the input in memory, which is the
+    // only way to handle stdin as its size is not known in advance
+    const bool readsStdin = paths.size() == 1 && paths[0] == "-";
+    if (isStreaming || readsStdin) {
+        const bool canStream = paths.size() == 1 && filesFrom.empty() &&
+            !options.isInPlace && !options.findsDuplicates &&
+            !options.findsNearDuplicates && cachePath.empty();
+        if (!canStream) {
+            std::cerr << "Streaming works on a single file or stdin and can't be ";
+            std::cerr << "combined with --in-place, --duplicates, --near-duplicates, ";
+            std::cerr << "--cache, or --files-from\n";
+            return -1;
+        }
 
-            // Remove the "" or {} pair around the value
-            value = value.substr(1, value.size() - 2);
+        std::FILE* input = stdin;
+        if (readsStdin) {
+#ifdef _WIN32
+            // The input is taken as is, like a mapped file
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif // _WIN32
+        }
+        else {
+            input = std::fopen(paths[0].c_str(), "rb");
+            if (!input) {
+                std::cerr << "Could not open BibTex file " << paths[0] << '\n';
+                return -1;
+            }
+        }
 
-            Keyword kw = keywordFromString(keyword);
-            // No need to check for keywords as they will be added to the 'extraFields'
-            // vector either way
-            
-            std::vector<Keyword> accepted = AcceptedKeywords.at(entry.entryType);
-            bool keywordAllowed = std::find(
-                accepted.begin(),
-                accepted.end(),
-                kw
-            ) != accepted.end();
+        std::FILE* output = options.shouldFormat ? stdout : nullptr;
+        const bool success = processStream(
+            input,
+            output,
+            options.diagnosticFormat,
+            readsStdin ? "<stdin>" : paths[0],
+            diagnosticsFile,
+            stats.get(),
+            options.rules
+        );
+        if (input != stdin) {
+            std::fclose(input);
+        }
+        if (!success) {
+            std::cerr << "Could not read or write the bibliography\n";
+            return -1;
+        }
+        writeStats();
+        return 0;
+    }
 
-            if (keywordAllowed) {
-                entry[keywordFromString(keyword)] = value;
+    // A list of files with one path per line, where '-' reads the list from stdin
+    if (!filesFrom.empty()) {
+        std::ifstream listFile;
+        if (filesFrom != "-") {
+            listFile.open(filesFrom);
+            if (!listFile) {
+                std::cerr << "Could not open file list " << filesFrom << '\n';
+                return -1;
             }
-            else {
-                extraFields.push_back(keyword);
+        }
+        std::istream& list = filesFrom == "-" ? std::cin : listFile;
+        std::string line;
+        while (std::getline(list, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
             }
-
-
-            if (endLine == std::string::npos) {
-                break;
+            if (!line.empty()) {
+                paths.push_back(line);
             }
-            reference = reference.substr(endLine + 1 + 1); // ,\n  or \n}
         }
+    }
 
+    std::vector<std::string> files;
+    for (const std::string& path : paths) {
+        collectFiles(path, files);
+    }
+    std::error_code error;
+    const bool isBatch = paths.size() != 1 || !filesFrom.empty() ||
+                         std::filesystem::is_directory(paths[0], error);
 
-        std::vector<std::string> errors = checkCompleteness(entry);
+    if (isBatch && options.shouldFormat && !options.isInPlace) {
+        std::cerr << "--format writes to stdout and only works with a single file, ";
+        std::cerr << "use --in-place to format several files\n";
+        return -1;
+    }
 
-        if (!extraFields.empty() || !errors.empty()) {
-            std::cerr << "Error in: " << entry.citeKey << '\n';
+    ValidationCache cache;
+    if (!cachePath.empty()) {
+        // A missing or outdated cache is not an error, it is just rebuilt
+        cache.load(cachePath, options.rules);
+        options.cache = &cache;
+    }
 
-            for (const std::string& missing : errors) {
-                std::cerr << "Missing: " << missing << '\n';
-            }
+    std::vector<FileReport> reports(files.size());
+    if (!isBatch) {
+        reports[0] = processFile(files[0], options, nThreads);
+    }
+    else {
+        // Each file is parsed on a single thread, the parallelism comes from processing
+        // many files at the same time. Without -j, all hardware threads are used
+        ThreadPool pool(hasThreadCount ? nThreads : 0);
+        for (size_t i = 0; i < files.size(); ++i) {
+            pool.enqueue([&files, &reports, &options, i]() {
+                reports[i] = processFile(files[i], options, 1);
+            });
+        }
+        pool.wait();
+    }
 
-            for (const std::string& extra : extraFields) {
-                std::cerr << "Extra:   " << extra << '\n';
-            }
+    if (!cachePath.empty()) {
+        std::vector<ParseResult> cacheResults;
+        for (FileReport& report : reports) {
+            std::move(
+                report.cacheResults.begin(),
+                report.cacheResults.end(),
+                std::back_inserter(cacheResults)
+            );
+        }
+        if (!ValidationCache::save(cachePath, cacheResults, options.rules)) {
+            std::cerr << "Could not write cache file " << cachePath << '\n';
+        }
+    }
 
-            std::cerr << '\n' << '\n';
+    // The reports are written in the order of the files, independent of which file
+    // finished first, so that the output is the same for every run. All of them are
+    // collected in one buffer that is written at once
+    Stopwatch stopwatch;
+    const DiagnosticFormat format = options.diagnosticFormat;
+    std::string output(reportBegin(format));
+    size_t nDiagnostics = 0;
+    size_t nFilesWithDiagnostics = 0;
+    size_t nFailures = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        const FileReport& report = reports[i];
+        if (format == DiagnosticFormat::Text) {
+            if (isBatch && !report.diagnostics.empty()) {
+                output += "File: " + files[i] + "\n\n";
+            }
+            output += report.diagnostics;
+            if (!report.error.empty()) {
+                output += report.error + '\n';
+            }
+        }
+        else {
+            if (!report.diagnostics.empty()) {
+                output += nFilesWithDiagnostics > 0 ? ",\n" : "";
+                output += report.diagnostics;
+            }
+            if (!report.error.empty()) {
+                std::cerr << report.error << '\n';
+            }
         }
 
-        entries.push_back(std::move(entry));
+        nDiagnostics += report.nDiagnostics;
+        nFilesWithDiagnostics += report.nDiagnostics > 0;
+        nFailures += !report.error.empty();
+    }
+    output += reportEnd(format);
+    std::fwrite(output.data(), 1, output.size(), diagnosticsFile);
+    std::fflush(diagnosticsFile);
+    if (stats) {
+        stats->addPhase(Phase::Write, stopwatch.lap());
+    }
 
-        contents = match.suffix();
+    // Duplicates are searched across all files, so they are reported after all files
+    std::vector<DuplicateGroup> duplicates;
+    std::vector<NearDuplicateGroup> nearDuplicates;
+    if (options.findsDuplicates || options.findsNearDuplicates) {
+        std::vector<std::vector<EntryKeys>> keys;
+        keys.reserve(reports.size());
+        for (FileReport& report : reports) {
+            keys.push_back(std::move(report.keys));
+        }
+        if (options.findsDuplicates) {
+            duplicates = findDuplicates(keys);
+        }
+        if (options.findsNearDuplicates) {
+            nearDuplicates = findNearDuplicates(keys, options.nearDuplicateThreshold);
+        }
+        if (stats) {
+            stats->addPhase(Phase::Duplicates, stopwatch.lap());
+        }
+        writeDuplicates(std::cerr, duplicates, keys, files);
+        writeNearDuplicates(std::cerr, nearDuplicates, keys, files);
+        if (stats) {
+            stats->addPhase(Phase::Write, stopwatch.lap());
+        }
     }
 
-    return 0;
+    if (isBatch) {
+        std::cerr << "Checked " << files.size() << " files: " << nDiagnostics
+                  << " problems in " << nFilesWithDiagnostics << " files";
+        if (options.findsDuplicates) {
+            std::cerr << ", " << duplicates.size() << " duplicates";
+        }
+        if (options.findsNearDuplicates) {
+            std::cerr << ", " << nearDuplicates.size() << " near-duplicates";
+        }
+        if (nFailures > 0) {
+            std::cerr << ", " << nFailures << " files could not be processed";
+        }
+        std::cerr << '\n';
+    }
+    writeStats();
+    return nFailures == 0 ? 0 : -1;
 }
@@ -0,0 +1,145 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else // ^^^^ _WIN32 // !_WIN32 vvvv
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+    HANDLE file = CreateFileA(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    _file = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        return;
+    }
+    _size = static_cast<size_t>(size.QuadPart);
+    if (_size == 0) {
+        // Empty files can't be mapped, but they are perfectly valid
+        _isValid = true;
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        return;
+    }
+    _mapping = mapping;
+
+    _data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    _isValid = _data != nullptr;
+}
+
+MappedFile::~MappedFile() {
+    if (_data) {
+        UnmapViewOfFile(_data);
+    }
+    if (_mapping) {
+        CloseHandle(_mapping);
+    }
+    if (_file) {
+        CloseHandle(_file);
+    }
+}
+
+#else // ^^^^ _WIN32 // !_WIN32 vvvv
+
+MappedFile::MappedFile(const std::string& path) {
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(file);
+        return;
+    }
+    _size = static_cast<size_t>(info.st_size);
+    if (_size == 0) {
+        // Empty files can't be mapped, but they are perfectly valid
+        close(file);
+        _isValid = true;
+        return;
+    }
+
+    void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping keeps its own reference to the file
+    close(file);
+    if (data == MAP_FAILED) {
+        return;
+    }
+    // The file is read from front to back exactly once
+    madvise(data, _size, MADV_SEQUENTIAL);
+
+    _data = static_cast<const char*>(data);
+    _isValid = true;
+}
+
+MappedFile::~MappedFile() {
+    if (_data) {
+        munmap(const_cast<char*>(_data), _size);
+    }
+}
+
+#endif // _WIN32
+
+bool MappedFile::isValid() const {
+    return _isValid;
+}
+
+std::string_view MappedFile::contents() const {
+    return _data ? std::string_view(_data, _size) : std::string_view();
+}
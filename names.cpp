@@ -0,0 +1,304 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "names.h"
+
+#include "hash.h"
+#include "normalize.h"
+
+#include <cstdint>
+
+namespace {
+    // The words of a name are separated by whitespace and ties
+    bool isSeparator(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '~';
+    }
+
+    bool isAsciiLetter(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    // The commands that stand for a letter on their own, like \o for 'ø', have the case
+    // of their name. Returns false for all other commands
+    bool letterCommandCase(std::string_view name, bool& isLower) {
+        constexpr std::string_view Lower[] = {
+            "aa", "ae", "i", "j", "l", "o", "oe", "ss"
+        };
+        constexpr std::string_view Upper[] = { "AA", "AE", "L", "O", "OE", "SS" };
+        for (std::string_view command : Lower) {
+            if (command == name) {
+                isLower = true;
+                return true;
+            }
+        }
+        for (std::string_view command : Upper) {
+            if (command == name) {
+                isLower = false;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Returns false for characters without a case, otherwise 'isLower' is set. Only the
+    // Latin-1 and Latin Extended-A letters are known, all other characters are caseless
+    bool codePointCase(uint32_t codePoint, bool& isLower) {
+        if (codePoint >= 0xC0 && codePoint < 0x100) {
+            if (codePoint == 0xD7 || codePoint == 0xF7) {
+                return false;
+            }
+            isLower = codePoint >= 0xDF;
+            return true;
+        }
+        if (codePoint >= 0x100 && codePoint < 0x180) {
+            // Upper and lower case alternate, but the pairs are shifted by one between
+            // U+0138 and U+0149 and between U+0178 and U+017F
+            const bool isShifted = (codePoint > 0x138 && codePoint < 0x149) ||
+                                   (codePoint > 0x178 && codePoint < 0x17F);
+            isLower = codePoint == 0x138 || codePoint == 0x149 || codePoint == 0x17F ||
+                      ((codePoint % 2 == 0) == isShifted);
+            return true;
+        }
+        return false;
+    }
+
+    // Whether the first letter of the word is a lower case letter, which makes it a
+    // word of the von part. Groups like {\"o} are special characters that have the case
+    // of their letter, while all other groups are skipped. Words without a letter are
+    // treated as upper case
+    bool isLowerCase(std::string_view word) {
+        size_t i = 0;
+        while (i < word.size()) {
+            const char c = word[i];
+            const unsigned char byte = static_cast<unsigned char>(c);
+            bool isLower = false;
+            if (isAsciiLetter(c)) {
+                return c >= 'a';
+            }
+            else if (c == '{') {
+                size_t end = i + 1;
+                for (int depth = 1; end < word.size() && depth > 0; ++end) {
+                    depth += word[end] == '{' ? 1 : word[end] == '}' ? -1 : 0;
+                }
+                if (i + 1 < word.size() && word[i + 1] == '\\') {
+                    size_t name = i + 2;
+                    size_t nameEnd = name;
+                    while (nameEnd < end && isAsciiLetter(word[nameEnd])) {
+                        ++nameEnd;
+                    }
+                    const std::string_view command = word.substr(name, nameEnd - name);
+                    if (letterCommandCase(command, isLower)) {
+                        return isLower;
+                    }
+                    // The case of an accented letter is that of the letter itself
+                    size_t letter = nameEnd == name ? name + 1 : nameEnd;
+                    while (letter < end && !isAsciiLetter(word[letter])) {
+                        ++letter;
+                    }
+                    if (letter < end) {
+                        return word[letter] >= 'a';
+                    }
+                }
+                i = end;
+            }
+            else if ((byte & 0xE0) == 0xC0 && i + 1 < word.size()) {
+                const uint32_t codePoint =
+                    ((byte & 0x1F) << 6) |
+                    (static_cast<unsigned char>(word[i + 1]) & 0x3F);
+                if (codePointCase(codePoint, isLower)) {
+                    return isLower;
+                }
+                i += 2;
+            }
+            else {
+                ++i;
+            }
+        }
+        return false;
+    }
+
+    struct Word {
+        size_t begin;
+        size_t end;
+    };
+
+    // Splits the words of one name into its parts. 'commas' holds the index of the first
+    // word after each of the first two commas
+    PersonName decompose(std::string_view list, const std::vector<Word>& words,
+                         const size_t* commas, int nCommas)
+    {
+        auto span = [&list, &words](size_t first, size_t last) {
+            if (first >= last) {
+                return std::string_view();
+            }
+            const size_t begin = words[first].begin;
+            return list.substr(begin, words[last - 1].end - begin);
+        };
+        auto isLowerCaseWord = [&list, &words](size_t index) {
+            return isLowerCase(list.substr(words[index].begin,
+                                           words[index].end - words[index].begin));
+        };
+
+        PersonName name;
+        if (nCommas == 0) {
+            // First von Last, where the last word always belongs to the last part
+            const size_t n = words.size();
+            size_t vonBegin = 0;
+            while (vonBegin + 1 < n && !isLowerCaseWord(vonBegin)) {
+                ++vonBegin;
+            }
+            size_t vonEnd = vonBegin;
+            for (size_t i = vonBegin; i + 1 < n; ++i) {
+                if (isLowerCaseWord(i)) {
+                    vonEnd = i + 1;
+                }
+            }
+            name.first = span(0, vonBegin);
+            name.von = span(vonBegin, vonEnd);
+            name.last = span(vonEnd, n);
+        }
+        else {
+            // von Last, First or von Last, Jr, First
+            const size_t n = commas[0];
+            size_t vonEnd = 0;
+            if (n > 1 && isLowerCaseWord(0)) {
+                for (size_t i = 0; i + 1 < n; ++i) {
+                    if (isLowerCaseWord(i)) {
+                        vonEnd = i + 1;
+                    }
+                }
+            }
+            name.von = span(0, vonEnd);
+            name.last = span(vonEnd, n);
+            if (nCommas == 1) {
+                name.first = span(n, words.size());
+            }
+            else {
+                name.jr = span(n, commas[1]);
+                name.first = span(commas[1], words.size());
+            }
+        }
+        return name;
+    }
+} // namespace
+
+NameList parseNames(std::string_view list, StringArena& arena) {
+    NameList result;
+    std::vector<Word> words;
+    size_t commas[2] = { 0, 0 };
+    int nCommas = 0;
+
+    auto finishName = [&]() {
+        const bool isOthers = nCommas == 0 && words.size() == 1 &&
+            list.substr(words[0].begin, words[0].end - words[0].begin) == "others";
+        if (isOthers) {
+            result.hasOthers = true;
+        }
+        else if (!words.empty()) {
+            PersonName name = decompose(list, words, commas, nCommas);
+            // The von part is directly followed by the last part in all three forms
+            const char* begin = name.von.empty() ? name.last.data() : name.von.data();
+            const std::string folded = foldText(
+                std::string_view(begin, name.last.data() + name.last.size() - begin)
+            );
+            name.folded = arena.store(folded);
+            result.names.push_back(name);
+        }
+        words.clear();
+        nCommas = 0;
+    };
+
+    int depth = 0;
+    size_t begin = std::string_view::npos;
+    for (size_t i = 0; i <= list.size(); ++i) {
+        const bool isEnd = i == list.size();
+        const char c = isEnd ? ' ' : list[i];
+        if (!isEnd && (depth > 0 || c == '{' || c == '}')) {
+            // Separators inside of braces don't count, so '{Barnes and Noble}' is a
+            // single word
+            depth += c == '{' ? 1 : (c == '}' && depth > 0) ? -1 : 0;
+            if (begin == std::string_view::npos) {
+                begin = i;
+            }
+            continue;
+        }
+
+        if (isSeparator(c) || c == ',') {
+            if (begin != std::string_view::npos) {
+                const std::string_view word = list.substr(begin, i - begin);
+                if (word == "and" || word == "AND") {
+                    finishName();
+                }
+                else {
+                    words.push_back({ begin, i });
+                }
+                begin = std::string_view::npos;
+            }
+            // Commas after the second one are ignored like BibTeX does after warning
+            if (c == ',' && nCommas < 2) {
+                commas[nCommas++] = words.size();
+            }
+        }
+        else if (begin == std::string_view::npos) {
+            begin = i;
+        }
+    }
+    finishName();
+    return result;
+}
+
+const NameList& NameCache::names(std::string_view list) {
+    const uint64_t hash = hash64(list);
+    static_assert(NumShards == 16, "The shard is taken from the top four bits");
+    Shard& shard = _shards[static_cast<int>(hash >> 60)];
+
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.lists.find(list);
+    if (it != shard.lists.end()) {
+        return *it->second;
+    }
+    const std::string_view stored = shard.arena.store(list);
+    auto names = std::make_unique<NameList>(parseNames(stored, shard.arena));
+    return *shard.lists.emplace(stored, std::move(names)).first->second;
+}
+
+size_t NameCache::size() const {
+    size_t size = 0;
+    for (const Shard& shard : _shards) {
+        std::lock_guard lock(shard.mutex);
+        size += shard.lists.size();
+    }
+    return size;
+}
@@ -0,0 +1,103 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#ifndef __BIBTEXFORMAT___NAMES___H__
+#define __BIBTEXFORMAT___NAMES___H__
+
+#include "stringarena.h"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// One name of an author or editor list, split into the four parts that BibTeX knows. The
+// parts are views into the list and are empty if the name does not have them
+struct PersonName {
+    std::string_view first;
+    std::string_view von;
+    std::string_view last;
+    std::string_view jr;
+
+    // The von and last parts reduced by foldText, so that 'M{\"u}ller' and 'Müller' are
+    // the same name when names are sorted or compared
+    std::string_view folded;
+};
+
+struct NameList {
+    std::vector<PersonName> names;
+    // The list ends with 'and others', which the styles print as 'et al.'
+    bool hasOthers = false;
+};
+
+// Splits an author or editor list at the 'and's that are not inside of braces and every
+// name into its parts, which can be written as 'First von Last', 'von Last, First', or
+// 'von Last, Jr, First'. As in BibTeX, the von part consists of the words that start with
+// a lower case letter, where the case of a word like {\"o}rsted is that of the accented
+// letter. The folded names are stored in the arena
+NameList parseNames(std::string_view list, StringArena& arena);
+
+// Decomposes author and editor lists on demand and keeps the result for every distinct
+// list, as the same lists recur in many entries. Several threads can use the cache at
+// the same time: the lists are distributed over shards by their hash and only the shard
+// of a list is locked. The lists are copied, so the views of a NameList stay valid as
+// long as the cache
+class NameCache {
+public:
+    NameCache() = default;
+    NameCache(const NameCache&) = delete;
+    NameCache& operator=(const NameCache&) = delete;
+
+    // The names of the list, which is only parsed the first time it is requested
+    const NameList& names(std::string_view list);
+
+    // Number of distinct lists in the cache
+    size_t size() const;
+
+private:
+    static constexpr int NumShards = 16;
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string_view, std::unique_ptr<NameList>> lists;
+        StringArena arena;
+    };
+
+    std::array<Shard, NumShards> _shards;
+};
+
+#endif // __BIBTEXFORMAT___NAMES___H__
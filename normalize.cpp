@@ -0,0 +1,218 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "normalize.h"
+
+#include <array>
+
+namespace {
+    // The base letters of U+00C0 to U+017F. A space marks a character that is not a
+    // letter and a '*' one that is spelled with more than one letter
+    constexpr std::string_view Latin1 =
+        "aaaaaa*ceeeeiiiidnooooo ouuuuy**"
+        "aaaaaa*ceeeeiiiidnooooo ouuuuy*y";
+    constexpr std::string_view LatinExtendedA =
+        "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiii**jjkkkllllllllllnnnnnnn"
+        "nnoooooo**rrrrrrssssssssttttttuuuuuuuuuuuuwwyyyzzzzzzs";
+    static_assert(Latin1.size() == 0x100 - 0xC0);
+    static_assert(LatinExtendedA.size() == 0x180 - 0x100);
+
+    std::string_view spelledOut(uint32_t codePoint) {
+        switch (codePoint) {
+            case 0xC6: case 0xE6:   return "ae";
+            case 0xDE: case 0xFE:   return "th";
+            case 0xDF:              return "ss";
+            case 0x132: case 0x133: return "ij";
+            case 0x152: case 0x153: return "oe";
+            default:                return "";
+        }
+    }
+
+    // The commands that stand for a letter on their own, like \o for 'ø'
+    std::string_view letterCommand(std::string_view name) {
+        constexpr std::array<std::pair<std::string_view, std::string_view>, 14> Letters =
+        {{
+            { "aa", "a" }, { "AA", "a" }, { "ae", "ae" }, { "AE", "ae" }, { "i", "i" },
+            { "j", "j" }, { "l", "l" }, { "L", "l" }, { "o", "o" }, { "O", "o" },
+            { "oe", "oe" }, { "OE", "oe" }, { "ss", "ss" }, { "SS", "ss" }
+        }};
+        for (const auto& [command, letters] : Letters) {
+            if (command == name) {
+                return letters;
+            }
+        }
+        return std::string_view();
+    }
+
+    // The lower case form of every ASCII letter and digit and 0 for all other bytes, so
+    // that runs of plain words can be found and copied with one lookup per byte
+    constexpr std::array<char, 256> makeWordCharacters() {
+        std::array<char, 256> table = {};
+        for (char c = '0'; c <= '9'; ++c) {
+            table[static_cast<unsigned char>(c)] = c;
+        }
+        for (char c = 'a'; c <= 'z'; ++c) {
+            table[static_cast<unsigned char>(c)] = c;
+            table[static_cast<unsigned char>(c - 'a' + 'A')] = c;
+        }
+        return table;
+    }
+    constexpr std::array<char, 256> WordCharacters = makeWordCharacters();
+
+    bool isAsciiLetter(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+} // namespace
+
+std::string foldText(std::string_view text) {
+    std::string result;
+    result.reserve(text.size());
+
+    // Separators are only written once the next word begins, so that there are never
+    // leading, trailing, or repeated spaces
+    bool needsSeparator = false;
+    auto appendLetters = [&result, &needsSeparator](std::string_view letters) {
+        if (needsSeparator && !result.empty()) {
+            result.push_back(' ');
+        }
+        needsSeparator = false;
+        result += letters;
+    };
+
+    size_t i = 0;
+    while (i < text.size()) {
+        const char c = text[i];
+        const unsigned char byte = static_cast<unsigned char>(c);
+        if (WordCharacters[byte] != 0) {
+            // Most of the text is plain ASCII, whose words are copied as a whole
+            size_t end = i + 1;
+            while (end < text.size() &&
+                   WordCharacters[static_cast<unsigned char>(text[end])] != 0)
+            {
+                ++end;
+            }
+            // Writes the separator, if there is one, in front of the word
+            appendLetters(std::string_view());
+            const size_t offset = result.size();
+            result.resize(offset + end - i);
+            for (size_t j = i; j < end; ++j) {
+                result[offset + j - i] =
+                    WordCharacters[static_cast<unsigned char>(text[j])];
+            }
+            i = end;
+        }
+        else if (c == '{' || c == '}' || c == '$') {
+            // {V}olume is a single word
+            ++i;
+        }
+        else if (c == '\\') {
+            size_t end = i + 1;
+            while (end < text.size() && isAsciiLetter(text[end])) {
+                ++end;
+            }
+            if (end == i + 1) {
+                // A control symbol like \" or \&, which is either an accent on the next
+                // letter or a character that separates words anyway
+                if (end < text.size() && text[end] != '{' && text[end] != '}') {
+                    needsSeparator |= text[end] == '&' || text[end] == '\\';
+                    ++end;
+                }
+                i = end;
+                continue;
+            }
+
+            // Accents with letter names like \v{s} and formatting like \emph are
+            // removed, while \o and friends are letters themselves
+            const std::string_view name = text.substr(i + 1, end - i - 1);
+            const std::string_view letters = letterCommand(name);
+            if (!letters.empty()) {
+                appendLetters(letters);
+            }
+            // Spaces after a command name only end the name
+            while (end < text.size() && (text[end] == ' ' || text[end] == '\t')) {
+                ++end;
+            }
+            i = end;
+        }
+        else if (byte >= 0x80) {
+            // Two byte UTF-8 sequences cover the accented latin letters
+            uint32_t codePoint = 0;
+            size_t length = 1;
+            if ((byte & 0xE0) == 0xC0 && i + 1 < text.size()) {
+                codePoint = ((byte & 0x1F) << 6) |
+                            (static_cast<unsigned char>(text[i + 1]) & 0x3F);
+                length = 2;
+            }
+            else {
+                while (i + length < text.size() &&
+                       (static_cast<unsigned char>(text[i + length]) & 0xC0) == 0x80)
+                {
+                    ++length;
+                }
+            }
+
+            char base = 0;
+            if (codePoint >= 0xC0 && codePoint < 0x100) {
+                base = Latin1[codePoint - 0xC0];
+            }
+            else if (codePoint >= 0x100 && codePoint < 0x180) {
+                base = LatinExtendedA[codePoint - 0x100];
+            }
+
+            if (base == '*') {
+                appendLetters(spelledOut(codePoint));
+            }
+            else if (base == ' ') {
+                needsSeparator = true;
+            }
+            else if (base != 0) {
+                appendLetters(std::string_view(&base, 1));
+            }
+            else if (codePoint >= 0x80 && codePoint < 0xC0) {
+                // Non-breaking spaces, quotation marks, and other punctuation
+                needsSeparator = true;
+            }
+            else {
+                appendLetters(text.substr(i, length));
+            }
+            i += length;
+        }
+        else {
+            needsSeparator = true;
+            ++i;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,86 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "outputbuffer.h"
+
+#include <algorithm>
+
+OutputBuffer::OutputBuffer(std::FILE* file, size_t capacity)
+    : _file(file)
+    , _buffer(new char[capacity])
+    , _capacity(capacity)
+{}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+void OutputBuffer::writeSpaces(size_t count) {
+    while (count > 0) {
+        if (_size == _capacity) {
+            flush();
+        }
+        const size_t n = std::min(count, _capacity - _size);
+        std::memset(_buffer.get() + _size, ' ', n);
+        _size += n;
+        count -= n;
+    }
+}
+
+bool OutputBuffer::flush() {
+    if (_size > 0) {
+        if (std::fwrite(_buffer.get(), 1, _size, _file) != _size) {
+            _hasError = true;
+        }
+        _size = 0;
+    }
+    if (std::fflush(_file) != 0) {
+        _hasError = true;
+    }
+    return !_hasError;
+}
+
+void OutputBuffer::writeSlow(std::string_view text) {
+    flush();
+    if (text.size() <= _capacity) {
+        std::memcpy(_buffer.get(), text.data(), text.size());
+        _size = text.size();
+    }
+    else {
+        // Larger than the whole buffer, so there is no point in copying it
+        if (std::fwrite(text.data(), 1, text.size(), _file) != text.size()) {
+            _hasError = true;
+        }
+    }
+}
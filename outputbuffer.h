@@ -0,0 +1,91 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___OUTPUTBUFFER___H__
+#define __BIBTEXFORMAT___OUTPUTBUFFER___H__
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+// Collects all output in one large, preallocated buffer that is handed to the operating
+// system in a single call whenever it is full. This avoids the per-call overhead of
+// streams for the many tiny pieces that make up a formatted entry
+class OutputBuffer {
+public:
+    static constexpr size_t DefaultCapacity = 4 * 1024 * 1024;
+
+    explicit OutputBuffer(std::FILE* file, size_t capacity = DefaultCapacity);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void write(std::string_view text);
+    void write(char c);
+    void writeSpaces(size_t count);
+
+    // Writes the buffered bytes to the file. Returns false if this or any previous write
+    // to the file failed
+    bool flush();
+
+private:
+    void writeSlow(std::string_view text);
+
+    std::FILE* _file;
+    std::unique_ptr<char[]> _buffer;
+    size_t _capacity;
+    size_t _size = 0;
+    bool _hasError = false;
+};
+
+inline void OutputBuffer::write(std::string_view text) {
+    if (_size + text.size() <= _capacity) {
+        std::memcpy(_buffer.get() + _size, text.data(), text.size());
+        _size += text.size();
+    }
+    else {
+        writeSlow(text);
+    }
+}
+
+inline void OutputBuffer::write(char c) {
+    if (_size == _capacity) {
+        flush();
+    }
+    _buffer[_size++] = c;
+}
+
+#endif // __BIBTEXFORMAT___OUTPUTBUFFER___H__
@@ -0,0 +1,439 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "parser.h"
+
+#include "events.h"
+#include "hash.h"
+#include "lexer.h"
+#include "threadpool.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <utility>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t nanosecondsSince(Clock::time_point start, Clock::time_point end) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+
+    // Measures the entries one at a time. Everything between two entries was spent in
+    // the lexer
+    class EntryTimer {
+    public:
+        EntryTimer(const ParseOptions& options, ParseTimings& timings)
+            : _timings(options.measuresTime ? &timings : nullptr)
+            , _nSlowestEntries(options.nSlowestEntries)
+        {
+            if (_timings) {
+                _lexStart = Clock::now();
+            }
+        }
+
+        // Has to be called right after the lexer found the entry at 'offset'
+        void begin(size_t offset) {
+            if (!_timings) {
+                return;
+            }
+            _offset = offset;
+            _start = Clock::now();
+            _timings->lexNanoseconds += nanosecondsSince(_lexStart, _start);
+        }
+
+        // Has to be called at the end of the entry, where the lexer continues
+        void end() {
+            if (!_timings) {
+                return;
+            }
+            _lexStart = Clock::now();
+            const uint64_t nanoseconds = nanosecondsSince(_start, _lexStart);
+            _timings->validateNanoseconds += nanoseconds;
+            _timings->nEntries += 1;
+
+            std::vector<EntryTime>& slowest = _timings->slowestEntries;
+            auto isSlower = [](const EntryTime& lhs, const EntryTime& rhs) {
+                return lhs.nanoseconds > rhs.nanoseconds;
+            };
+            if (slowest.size() < _nSlowestEntries) {
+                slowest.push_back({ _offset, nanoseconds });
+                std::push_heap(slowest.begin(), slowest.end(), isSlower);
+            }
+            else if (!slowest.empty() && nanoseconds > slowest.front().nanoseconds) {
+                std::pop_heap(slowest.begin(), slowest.end(), isSlower);
+                slowest.back() = { _offset, nanoseconds };
+                std::push_heap(slowest.begin(), slowest.end(), isSlower);
+            }
+        }
+
+        // Has to be called once the lexer is done
+        void finish() {
+            if (_timings) {
+                _timings->lexNanoseconds += nanosecondsSince(_lexStart, Clock::now());
+            }
+        }
+
+    private:
+        ParseTimings* _timings;
+        size_t _nSlowestEntries;
+        size_t _offset = 0;
+        Clock::time_point _lexStart;
+        Clock::time_point _start;
+    };
+
+    // Turns the events of one part of the source into a ParseResult
+    class ResultBuilder : public ParseHandler {
+    public:
+        ResultBuilder(std::string_view source, size_t begin, const ParseOptions& options,
+                      ParseResult& result)
+            : _source(source)
+            , _options(options)
+            , _result(result)
+            , _timer(options, result.timings)
+            , _previousEnd(begin)
+            , _usesCache(options.cache || options.collectCacheRecords)
+            , _hashSeed(options.macros ? options.macros->fingerprint() : 0)
+        {}
+
+        bool beginEntry(const EntryEvent& entry) override {
+            _timer.begin(entry.begin);
+            addText(entry.begin);
+            _previousEnd = entry.end;
+            _rawText = _source.substr(entry.begin, entry.end - entry.begin);
+            _isReplayed = false;
+
+            // @string, @preamble, and @comment don't describe a reference
+            if (entry.error != LexError::None || entry.kind != EntryKind::Regular) {
+                return false;
+            }
+
+            // The diagnostics of an entry only depend on its own text, so they can be
+            // cached
+            _hash = _usesCache ? hash64(_rawText, _hashSeed) : 0;
+            _firstDiagnostic = _result.diagnostics.size();
+            if (_options.cache && !_options.needsEntries) {
+                _isReplayed = _options.cache->replay(
+                    _source,
+                    entry.begin,
+                    _rawText,
+                    _hash,
+                    _result.diagnostics
+                );
+                if (_isReplayed) {
+                    return false;
+                }
+            }
+
+            // Collect the fields first so that the entry can allocate its storage once
+            _fields.clear();
+            return true;
+        }
+
+        bool field(const EntryEvent&, const FieldEvent& field) override {
+            _fields.push_back(field);
+            return true;
+        }
+
+        void endEntry(const EntryEvent& entry, LexError error,
+                      size_t errorOffset) override
+        {
+            if (entry.error != LexError::None) {
+                _result.diagnostics.push_back({
+                    Diagnostic::Kind::ParseError,
+                    entry.begin,
+                    entry.begin,
+                    std::string_view(),
+                    errorMessage(entry.error)
+                });
+                _result.blocks.push_back({ _rawText });
+            }
+            else if (entry.kind != EntryKind::Regular) {
+                _result.blocks.push_back({ _rawText });
+            }
+            else if (_isReplayed) {
+                _result.blocks.push_back({ _rawText });
+                const bool hasDiagnostics = _result.diagnostics.size() > _firstDiagnostic;
+                addCacheRecord(
+                    entry.begin,
+                    hasDiagnostics ? _result.diagnostics[_firstDiagnostic].citeKey :
+                                     std::string_view()
+                );
+            }
+            else {
+                addEntry(entry, error, errorOffset);
+            }
+            _timer.end();
+        }
+
+        // Has to be called with the offset at which the lexer stopped
+        void finish(size_t end) {
+            _timer.finish();
+            if (end > _previousEnd) {
+                addText(end);
+            }
+        }
+
+    private:
+        // Text between entries is ignored by BibTeX, but it usually contains comments
+        void addText(size_t end) {
+            std::string_view text = _source.substr(_previousEnd, end - _previousEnd);
+            if (text.find_first_not_of(" \t\r\n") != std::string_view::npos) {
+                _result.blocks.push_back({ text });
+            }
+        }
+
+        void addCacheRecord(size_t begin, std::string_view citeKey) {
+            if (!_options.collectCacheRecords) {
+                return;
+            }
+            const size_t keyOffset = citeKey.empty() ?
+                0 :
+                static_cast<size_t>(citeKey.data() - _rawText.data());
+            _result.cacheRecords.push_back({
+                _hash,
+                begin,
+                _rawText.size(),
+                keyOffset,
+                citeKey.size(),
+                _firstDiagnostic,
+                _result.diagnostics.size() - _firstDiagnostic
+            });
+        }
+
+        void checkMacro(std::string_view name) {
+            if (_options.macros->find(name) == MacroTable::NoSymbol) {
+                _undefinedMacros.push_back(name);
+            }
+        }
+
+        void addEntry(const EntryEvent& event, LexError error, size_t errorOffset) {
+            Entry entry;
+            // Extra and repeated fields, both reported at the key of the field
+            std::vector<std::pair<std::string_view, Diagnostic::Kind>> fieldProblems;
+            _undefinedMacros.clear();
+
+            entry.entryType = event.entryType;
+            entry.citeKey = event.citeKey;
+
+            if (entry.entryType == Type::Unknown) {
+                _result.diagnostics.push_back({
+                    Diagnostic::Kind::UnknownType,
+                    event.begin,
+                    event.begin,
+                    entry.citeKey,
+                    std::string(event.type)
+                });
+            }
+
+            entry.reserve(_fields.size());
+            const KeywordMask accepted = acceptedKeywordMask(entry.entryType);
+            for (const FieldEvent& f : _fields) {
+                // Values spanning multiple lines are joined into a single line
+                std::string_view value = f.value;
+                uint32_t valueId = NoStringId;
+                if (_options.venues && (maskOf(f.keyword) & VenueKeywords)) {
+                    // The joined value goes into the pool, so it is stored only once
+                    if (hasRedundantWhitespace(value)) {
+                        _venue.resize(value.size());
+                        _venue.resize(normalizeWhitespace(value, _venue.data()));
+                        value = _venue;
+                    }
+                    valueId = _options.venues->intern(value);
+                    value = _options.venues->view(valueId);
+                }
+                else {
+                    value = joinedValue(value, _result.arena);
+                }
+                // Fields that are not accepted are still stored so that they don't get
+                // lost
+                const bool isExpression =
+                    f.kind == ValueKind::Macro || f.kind == ValueKind::Concatenation;
+                const bool isFirst =
+                    entry.set(f.keyword, f.key, value, isExpression, valueId);
+
+                if (_options.macros && f.kind == ValueKind::Macro) {
+                    checkMacro(f.value);
+                }
+                else if (_options.macros && f.kind == ValueKind::Concatenation) {
+                    // The value of a concatenation is the whole expression
+                    std::string_view expression = f.value;
+                    RawField part;
+                    while (FieldParser::nextPart(expression, part)) {
+                        if (part.kind == ValueKind::Macro) {
+                            checkMacro(part.contents);
+                        }
+                    }
+                }
+
+                // Checking membership is a single AND as unknown keywords have an empty
+                // mask
+                const bool keywordAllowed = (accepted & maskOf(f.keyword)) != 0;
+                if (!isFirst) {
+                    fieldProblems.emplace_back(f.key, Diagnostic::Kind::DuplicateField);
+                }
+                else if (!keywordAllowed && entry.entryType != Type::Unknown) {
+                    // We already complained about the unknown type
+                    fieldProblems.emplace_back(f.key, Diagnostic::Kind::ExtraField);
+                }
+            }
+
+            if (error != LexError::None) {
+                _result.diagnostics.push_back({
+                    Diagnostic::Kind::ParseError,
+                    event.begin,
+                    errorOffset,
+                    entry.citeKey,
+                    errorMessage(error)
+                });
+                _result.blocks.push_back({ _rawText });
+                addCacheRecord(event.begin, entry.citeKey);
+                return;
+            }
+
+            std::vector<std::string> errors = checkCompleteness(entry, _options.rules);
+            for (std::string& missing : errors) {
+                _result.diagnostics.push_back({
+                    Diagnostic::Kind::MissingField,
+                    event.begin,
+                    event.begin,
+                    entry.citeKey,
+                    std::move(missing)
+                });
+            }
+            // Both point into the fields, so they are reported in the order of the fields
+            auto field = fieldProblems.begin();
+            auto macro = _undefinedMacros.begin();
+            while (field != fieldProblems.end() || macro != _undefinedMacros.end()) {
+                const bool isField = macro == _undefinedMacros.end() ||
+                    (field != fieldProblems.end() && field->first.data() < macro->data());
+                const Diagnostic::Kind kind =
+                    isField ? field->second : Diagnostic::Kind::UndefinedMacro;
+                const std::string_view name = isField ? (field++)->first : *macro++;
+                _result.diagnostics.push_back({
+                    kind,
+                    event.begin,
+                    static_cast<size_t>(name.data() - _source.data()),
+                    entry.citeKey,
+                    std::string(name)
+                });
+            }
+
+            addCacheRecord(event.begin, entry.citeKey);
+            _result.blocks.push_back({ _rawText, _result.entries.size() });
+            _result.entries.push_back(std::move(entry));
+        }
+
+        std::string_view _source;
+        const ParseOptions& _options;
+        ParseResult& _result;
+        EntryTimer _timer;
+        size_t _previousEnd;
+        const bool _usesCache;
+        const uint64_t _hashSeed;
+
+        // The state of the current entry
+        std::string_view _rawText;
+        uint64_t _hash = 0;
+        size_t _firstDiagnostic = 0;
+        bool _isReplayed = false;
+        std::vector<FieldEvent> _fields;
+
+        // Scratch space for joining a venue before it is interned
+        std::string _venue;
+        std::vector<std::string_view> _undefinedMacros;
+    };
+} // namespace
+
+// Parses and validates all entries that start in [begin, limit) of the source
+void parse(std::string_view source, size_t begin, size_t limit, bool isRecovering,
+           const ParseOptions& options, ParseResult& result)
+{
+    ResultBuilder builder(source, begin, options, result);
+    const EventRange range = parseEvents(source, begin, limit, isRecovering, builder);
+    builder.finish(range.end);
+    result.end = range.end;
+    result.isRecovering = range.isRecovering;
+}
+
+// Splits the source into chunks at the beginning of entries and parses them in parallel
+std::vector<ParseResult> parseParallel(std::string_view source, unsigned int nThreads,
+                                       const ParseOptions& options)
+{
+    ThreadPool pool(nThreads);
+
+    // Use more chunks than threads so that the workers can balance chunks that take
+    // longer, but not so many that small files are split into tiny pieces
+    constexpr size_t MinChunkSize = 256 * 1024;
+    const size_t nChunks = std::clamp<size_t>(
+        source.size() / MinChunkSize,
+        1,
+        static_cast<size_t>(pool.size()) * 8
+    );
+
+    std::vector<size_t> boundaries = { 0 };
+    for (size_t i = 1; i < nChunks; ++i) {
+        size_t target = std::max(source.size() / nChunks * i, boundaries.back());
+        size_t boundary = findEntryStart(source, target);
+        if (boundary > boundaries.back() && boundary < source.size()) {
+            boundaries.push_back(boundary);
+        }
+    }
+    boundaries.push_back(source.size());
+
+    std::vector<ParseResult> results(boundaries.size() - 1);
+    for (size_t i = 0; i < results.size(); ++i) {
+        pool.enqueue([&source, &boundaries, &options, &results, i]() {
+            parse(source, boundaries[i], boundaries[i + 1], false, options, results[i]);
+        });
+    }
+    pool.wait();
+
+    // A chunk boundary is only a guess, as it might be inside of a value or follow an
+    // unterminated entry. In those cases the previous chunk knows better where the
+    // next chunk has to start and we redo the chunk. This is rare for valid files
+    for (size_t i = 1; i < results.size(); ++i) {
+        const ParseResult& previous = results[i - 1];
+        const bool startsLater = previous.end > boundaries[i];
+        if (startsLater || previous.isRecovering) {
+            const size_t begin = std::max(previous.end, boundaries[i]);
+            const bool isRecovering = previous.isRecovering;
+            results[i] = ParseResult();
+            parse(source, begin, boundaries[i + 1], isRecovering, options, results[i]);
+        }
+    }
+    return results;
+}
@@ -0,0 +1,135 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___PARSER___H__
+#define __BIBTEXFORMAT___PARSER___H__
+
+#include "cache.h"
+#include "diagnostic.h"
+#include "entry.h"
+#include "macros.h"
+#include "stringarena.h"
+#include "stringpool.h"
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+class RuleSet;
+
+struct ParseOptions {
+    // Entries whose raw text is found in the cache are neither split into fields nor
+    // validated, their diagnostics are taken from the cache instead. This only happens
+    // if 'needsEntries' is false, as no Entry is created for them
+    const ValidationCache* cache = nullptr;
+    bool needsEntries = true;
+
+    // Fill ParseResult::cacheRecords so that a new cache can be written
+    bool collectCacheRecords = false;
+
+    // The macros of the source, see MacroTable::collect. If they are set, every use of a
+    // macro that is not in the table is reported. As this makes the diagnostics of an
+    // entry depend on the macros, the cache hashes are seeded with their fingerprint
+    const MacroTable* macros = nullptr;
+
+    // If set, the values of the VenueKeywords are interned into the pool, so that each
+    // distinct venue is stored once and Field::valueId can be compared instead of the
+    // values. All threads of parseParallel share the pool
+    StringPool* venues = nullptr;
+
+    // The rules that the entries are checked against. Without them, only the required
+    // fields of the types are checked. A cache has to be loaded with the same rules
+    const RuleSet* rules = nullptr;
+
+    // Fill ParseResult::timings. This reads the clock twice per entry, which is cheap
+    // compared to parsing the entry, but not free, so it is only done when asked for
+    bool measuresTime = false;
+    size_t nSlowestEntries = 0;
+};
+
+// The time that was spent on the entry that starts at 'offset'
+struct EntryTime {
+    size_t offset = 0;
+    uint64_t nanoseconds = 0;
+};
+
+struct ParseTimings {
+    // Finding the entries in the source
+    uint64_t lexNanoseconds = 0;
+    // Splitting the entries into fields, validating them, and recording the diagnostics
+    uint64_t validateNanoseconds = 0;
+    size_t nEntries = 0;
+
+    // At most ParseOptions::nSlowestEntries entries as a heap with the fastest of them
+    // at the front
+    std::vector<EntryTime> slowestEntries;
+};
+
+// A piece of the source in file order, which is either one of the parsed entries or text
+// that has to be reproduced as written, such as comments or entries with errors
+struct Block {
+    static constexpr size_t NoEntry = std::numeric_limits<size_t>::max();
+
+    std::string_view text;
+    size_t entryIndex = NoEntry;
+};
+
+// Everything that was found in one contiguous part of the file
+struct ParseResult {
+    std::vector<Entry> entries;
+    std::vector<Diagnostic> diagnostics;
+    std::vector<Block> blocks;
+    std::vector<CacheRecord> cacheRecords;
+    ParseTimings timings;
+
+    // All fields of the entries are views into the source, except for the ones that had
+    // to be modified, which are stored in here
+    StringArena arena;
+
+    // Offset up to which the source has been consumed. This can be past the requested
+    // limit if the last entry extends beyond it
+    size_t end = 0;
+    bool isRecovering = false;
+};
+
+// Parses and validates all entries that start in [begin, limit) of the source
+void parse(std::string_view source, size_t begin, size_t limit, bool isRecovering,
+           const ParseOptions& options, ParseResult& result);
+
+// Splits the source into chunks at the beginning of entries and parses them in parallel
+std::vector<ParseResult> parseParallel(std::string_view source, unsigned int nThreads,
+                                       const ParseOptions& options);
+
+#endif // __BIBTEXFORMAT___PARSER___H__
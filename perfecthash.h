@@ -0,0 +1,123 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___PERFECTHASH___H__
+#define __BIBTEXFORMAT___PERFECTHASH___H__
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// A collision-free hash table over a fixed set of lowercase names that is constructed at
+// compile time. Lookups are case-insensitive: the hash folds the case of every byte and
+// the single candidate slot is verified with a case-insensitive comparison
+template <size_t NumNames, size_t TableSize>
+class PerfectHash {
+public:
+    static_assert((TableSize & (TableSize - 1)) == 0, "TableSize must be a power of 2");
+    static_assert(NumNames < TableSize, "TableSize must be larger than NumNames");
+    static_assert(NumNames < 128, "Slot indices must fit into an int8_t");
+
+    constexpr explicit PerfectHash(const std::array<std::string_view, NumNames>& names)
+        : _names(names)
+    {
+        // Try seeds until one maps every name into its own slot. For the sizes used here
+        // this needs at most a few hundred attempts, so it is cheap even at compile time
+        for (uint32_t seed = 0; ; ++seed) {
+            _seed = seed;
+            for (int8_t& slot : _slots) {
+                slot = -1;
+            }
+
+            bool hasCollision = false;
+            for (size_t i = 0; i < NumNames && !hasCollision; ++i) {
+                const size_t slot = hash(names[i], seed) & (TableSize - 1);
+                if (_slots[slot] != -1) {
+                    hasCollision = true;
+                }
+                else {
+                    _slots[slot] = static_cast<int8_t>(i);
+                }
+            }
+
+            if (!hasCollision) {
+                break;
+            }
+        }
+    }
+
+    // Returns the index of the name in the array that was passed to the constructor or
+    // -1 if the name is not part of the table
+    constexpr int find(std::string_view name) const {
+        const int index = _slots[hash(name, _seed) & (TableSize - 1)];
+        if (index == -1 || !equalsIgnoreCase(name, _names[index])) {
+            return -1;
+        }
+        return index;
+    }
+
+private:
+    static constexpr uint32_t hash(std::string_view name, uint32_t seed) {
+        // FNV-1a over the bytes with the 0x20 bit set, which maps upper case ASCII
+        // letters onto their lower case counterparts
+        uint32_t result = 2166136261u ^ (seed * 0x9E3779B9u);
+        for (char c : name) {
+            result ^= static_cast<uint8_t>(c | 0x20);
+            result *= 16777619u;
+        }
+        return result ^ (result >> 15);
+    }
+
+    static constexpr bool equalsIgnoreCase(std::string_view name,
+                                           std::string_view lowercase)
+    {
+        if (name.size() != lowercase.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < name.size(); ++i) {
+            const char c = name[i];
+            const char lower = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+            if (lower != lowercase[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::array<std::string_view, NumNames> _names;
+    std::array<int8_t, TableSize> _slots = {};
+    uint32_t _seed = 0;
+};
+
+#endif // __BIBTEXFORMAT___PERFECTHASH___H__
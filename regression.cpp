@@ -0,0 +1,244 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "corpus.h"
+#include "document.h"
+#include "formatter.h"
+#include "macros.h"
+#include "outputbuffer.h"
+#include "parser.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Guards against complexity regressions on the adversarial corpora. Every case runs the
+// stages that look at every byte of the input: collecting the macros, parsing and
+// validating, formatting, and building a Document from the events. It fails if
+//
+// - the time per megabyte of input exceeds the budget of the corpus,
+// - the bytes allocated per byte of input exceed the budget of the corpus, or
+// - the time per megabyte grows by more than MaxGrowth when the input is four times as
+//   large, which catches super-linear behavior independent of the speed of the machine
+//   and of the build type
+//
+// The time budgets are loose enough for unoptimized builds, so they only catch changes
+// in complexity, not small slowdowns. Each case is a separate test in ctest
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+#ifdef _WIN32
+    constexpr const char* NullDevice = "NUL";
+#else // ^^^^ _WIN32 // !_WIN32 vvvv
+    constexpr const char* NullDevice = "/dev/null";
+#endif // _WIN32
+
+    constexpr double MaxGrowth = 2.0;
+    // Timer noise and cache effects on the smaller input are not a regression
+    constexpr double GrowthSlackMilliseconds = 20.0;
+
+    struct Budget {
+        Corpus corpus;
+        // The size of the smaller input in realistic entries, see generateCorpus
+        size_t nEntries;
+        double millisecondsPerMegabyte;
+        double allocatedBytesPerByte;
+    };
+
+    constexpr Budget Budgets[] = {
+        { Corpus::Realistic,      5000,  400.0,  8.0 },
+        { Corpus::DeepNesting,    5000,  200.0,  2.0 },
+        { Corpus::LongValues,     5000,  150.0,  5.0 },
+        { Corpus::ManyAts,        5000,  200.0,  5.0 },
+        { Corpus::Unterminated,   5000,  400.0,  8.0 },
+        { Corpus::Quotes,         5000,  200.0,  5.0 },
+        { Corpus::NearDuplicates, 5000,  400.0,  8.0 },
+        { Corpus::HugeValue,      5000,  200.0,  5.0 },
+        { Corpus::TinyEntries,    5000, 1000.0, 40.0 }
+    };
+
+    struct Measurement {
+        double megabytes = 0.0;
+        double milliseconds = 0.0;
+        uint64_t allocatedBytes = 0;
+    };
+
+    // Keeps the compiler from removing the computations whose results are not used
+    volatile size_t Sink = 0;
+
+    Measurement measure(const std::string& source) {
+        std::FILE* file = std::fopen(NullDevice, "wb");
+        if (!file) {
+            std::cerr << "Could not open " << NullDevice << '\n';
+            std::exit(-1);
+        }
+
+        setAllocationCounting(true);
+        const AllocationCounts before = allocationCounts();
+        const Clock::time_point start = Clock::now();
+        {
+            MacroTable macros;
+            macros.collect(source);
+            ParseOptions options;
+            options.macros = &macros;
+            ParseResult result;
+            parse(source, 0, source.size(), false, options, result);
+
+            OutputBuffer output(file);
+            Formatter formatter(output);
+            for (const Block& block : result.blocks) {
+                const bool canFormat = block.entryIndex != Block::NoEntry &&
+                    result.entries[block.entryIndex].entryType != Type::Unknown;
+                if (canFormat) {
+                    formatter.write(result.entries[block.entryIndex]);
+                }
+                else {
+                    formatter.writeVerbatim(block.text);
+                }
+            }
+            output.flush();
+
+            const Document document = parseDocument(source);
+            Sink = result.diagnostics.size() + document.entries.size();
+        }
+        const Clock::time_point end = Clock::now();
+        const AllocationCounts after = allocationCounts();
+        setAllocationCounting(false);
+        std::fclose(file);
+
+        Measurement measurement;
+        measurement.megabytes = source.size() / (1024.0 * 1024.0);
+        measurement.milliseconds =
+            std::chrono::duration<double, std::milli>(end - start).count();
+        measurement.allocatedBytes = after.nBytes - before.nBytes;
+        return measurement;
+    }
+
+    // Returns false if any of the budgets is exceeded
+    bool run(const Budget& budget, uint64_t seed) {
+        const std::string_view name = corpusName(budget.corpus);
+        Measurement measurements[2];
+        for (int i = 0; i < 2; ++i) {
+            const size_t nEntries = budget.nEntries * (i == 0 ? 1 : 4);
+            const std::string source = generateCorpus(budget.corpus, nEntries, seed);
+            // The first run warms up the allocator and the caches, the best of the two
+            // is less disturbed by the rest of the system
+            const Measurement first = measure(source);
+            const Measurement second = measure(source);
+            measurements[i] =
+                first.milliseconds < second.milliseconds ? first : second;
+        }
+
+        bool isWithinBudget = true;
+        for (const Measurement& m : measurements) {
+            const double millisecondsPerMegabyte = m.milliseconds / m.megabytes;
+            const double allocatedBytesPerByte =
+                m.allocatedBytes / (m.megabytes * 1024.0 * 1024.0);
+            std::printf("%-16.*s %8.1f MB %10.1f ms %8.1f ms/MB %8.2f B/B\n",
+                        static_cast<int>(name.size()), name.data(), m.megabytes,
+                        m.milliseconds, millisecondsPerMegabyte, allocatedBytesPerByte);
+            if (millisecondsPerMegabyte > budget.millisecondsPerMegabyte) {
+                std::printf("  Exceeds the budget of %.1f ms/MB\n",
+                            budget.millisecondsPerMegabyte);
+                isWithinBudget = false;
+            }
+            if (allocatedBytesPerByte > budget.allocatedBytesPerByte) {
+                std::printf("  Exceeds the budget of %.2f allocated bytes per byte\n",
+                            budget.allocatedBytesPerByte);
+                isWithinBudget = false;
+            }
+        }
+
+        const Measurement& small = measurements[0];
+        const Measurement& large = measurements[1];
+        const double expected = large.megabytes / small.megabytes *
+                                (small.milliseconds + GrowthSlackMilliseconds);
+        if (large.milliseconds > expected * MaxGrowth) {
+            std::printf("  Grows super-linearly: %.1f ms for %.1f MB but %.1f ms for "
+                        "%.1f MB\n", small.milliseconds, small.megabytes,
+                        large.milliseconds, large.megabytes);
+            isWithinBudget = false;
+        }
+        return isWithinBudget;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<Corpus> corpora;
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--corpus" && i + 1 < argc) {
+            Corpus corpus;
+            if (!corpusFromName(argv[++i], corpus)) {
+                std::cerr << "Unknown corpus " << argv[i] << '\n';
+                return -1;
+            }
+            corpora.push_back(corpus);
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else {
+            std::cerr << "Usage: bibtex_regression [--corpus name]... [--seed n]\n";
+            return -1;
+        }
+    }
+    if (corpora.empty()) {
+        corpora.assign(std::begin(Corpora), std::end(Corpora));
+    }
+
+    bool isWithinBudget = true;
+    for (Corpus corpus : corpora) {
+        auto it = std::find_if(
+            std::begin(Budgets),
+            std::end(Budgets),
+            [corpus](const Budget& budget) { return budget.corpus == corpus; }
+        );
+        if (it == std::end(Budgets)) {
+            std::cerr << "No budget for the corpus " << corpusName(corpus) << '\n';
+            return -1;
+        }
+        isWithinBudget &= run(*it, seed);
+    }
+    return isWithinBudget ? 0 : -1;
+}
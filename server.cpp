@@ -0,0 +1,542 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "server.h"
+
+#include "diagnostic.h"
+#include "json.h"
+#include "lexer.h"
+#include "macros.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif // _WIN32
+
+namespace {
+    // One '@' block of a document. Every segment owns a copy of its text, so that the
+    // parsed entry remains valid when other parts of the document are edited
+    struct Segment {
+        size_t begin = 0;
+        size_t end = 0;
+        // Unterminated entries end wherever the lexer gave up, which can change with any
+        // edit directly behind them. If the lexer had to search until the end of the
+        // document, any later edit can change them
+        bool isUnterminated = false;
+        bool isSearchedToEnd = false;
+        // Whether the lexer was recovering from an unterminated entry after this segment
+        bool isRecovering = false;
+        std::string text;
+        ParseResult result;
+    };
+
+    // Number of UTF-16 code units that the UTF-8 text occupies, which is how the Language
+    // Server Protocol measures columns
+    size_t utf16Length(std::string_view text) {
+        size_t length = 0;
+        for (char c : text) {
+            const unsigned char byte = static_cast<unsigned char>(c);
+            if ((byte & 0xC0) != 0x80) {
+                // Code points outside of the basic plane need a surrogate pair
+                length += byte >= 0xF0 ? 2 : 1;
+            }
+        }
+        return length;
+    }
+
+    // Turns byte offsets into positions of the Language Server Protocol. The code units
+    // are counted from the previous offset if it is on the same line, so that converting
+    // the offsets of all diagnostics is linear even if the document is a single line
+    class PositionCounter {
+    public:
+        PositionCounter(std::string_view text, const std::vector<size_t>& lineStarts)
+            : _text(text)
+            , _lineStarts(lineStarts)
+        {}
+
+        void append(std::string& output, size_t offset) {
+            auto it = std::upper_bound(_lineStarts.begin(), _lineStarts.end(), offset);
+            const size_t line = (it - _lineStarts.begin()) - 1;
+            if (line != _line) {
+                _line = line;
+                _offset = _lineStarts[line];
+                _character = 0;
+            }
+            if (offset >= _offset) {
+                _character += utf16Length(_text.substr(_offset, offset - _offset));
+            }
+            else {
+                _character -= utf16Length(_text.substr(offset, _offset - offset));
+            }
+            _offset = offset;
+
+            output += "{\"line\":" + std::to_string(line) + ",\"character\":" +
+                      std::to_string(_character) + "}";
+        }
+
+    private:
+        std::string_view _text;
+        const std::vector<size_t>& _lineStarts;
+        size_t _line = std::string_view::npos;
+        size_t _offset = 0;
+        size_t _character = 0;
+    };
+
+    class Document {
+    public:
+        Document(std::string text, const RuleSet* rules)
+            : _rules(rules)
+        {
+            setText(std::move(text));
+        }
+
+        void setText(std::string text) {
+            _text = std::move(text);
+            _segments.clear();
+            updateLineStarts();
+            _macros = MacroTable();
+            _macros.collect(_text);
+            reparse(0, false, _text.size(), 0, {});
+        }
+
+        // Replaces [begin, end) with the new text and reparses the affected entries
+        void applyChange(size_t begin, size_t end, std::string_view newText) {
+            begin = std::min(begin, _text.size());
+            end = std::clamp(end, begin, _text.size());
+            _text.replace(begin, end - begin, newText);
+            updateLineStarts();
+
+            // The macros are collected from the whole document, like for a file. If the
+            // edit changed any of them, every entry that uses them could change as well
+            MacroTable macros;
+            macros.collect(_text);
+            if (macros.fingerprint() != _macros.fingerprint()) {
+                _segments.clear();
+                _macros = std::move(macros);
+                reparse(0, false, _text.size(), 0, {});
+                return;
+            }
+
+            // Everything starting from the end of the last segment that ends before the
+            // change has to be looked at again. Lexing starts in between entries there,
+            // which is needed as the change could turn a stray '@' into an entry
+            auto first = std::find_if(
+                _segments.begin(),
+                _segments.end(),
+                [begin](const std::unique_ptr<Segment>& s) { return s->end > begin; }
+            );
+            if (first != _segments.begin() && (*(first - 1))->isUnterminated) {
+                --first;
+            }
+            first = std::find_if(
+                _segments.begin(),
+                first,
+                [](const std::unique_ptr<Segment>& s) { return s->isSearchedToEnd; }
+            );
+            const bool hasPrevious = first != _segments.begin();
+            const size_t regionBegin = hasPrevious ? (*(first - 1))->end : 0;
+            const bool isRecovering = hasPrevious && (*(first - 1))->isRecovering;
+
+            std::vector<std::unique_ptr<Segment>> oldSegments(
+                std::make_move_iterator(first),
+                std::make_move_iterator(_segments.end())
+            );
+            _segments.erase(first, _segments.end());
+
+            const ptrdiff_t delta = static_cast<ptrdiff_t>(newText.size()) -
+                                    static_cast<ptrdiff_t>(end - begin);
+            reparse(
+                regionBegin,
+                isRecovering,
+                begin + newText.size(),
+                delta,
+                std::move(oldSegments)
+            );
+        }
+
+        size_t offsetOf(size_t line, size_t character) const {
+            if (line >= _lineStarts.size()) {
+                return _text.size();
+            }
+            size_t offset = _lineStarts[line];
+            while (offset < _text.size() && character > 0 && _text[offset] != '\n') {
+                const unsigned char byte = static_cast<unsigned char>(_text[offset]);
+                size_t units = byte >= 0xF0 ? 2 : 1;
+                character -= std::min(character, units);
+                ++offset;
+                while (offset < _text.size() && (_text[offset] & 0xC0) == 0x80) {
+                    ++offset;
+                }
+            }
+            return offset;
+        }
+
+        void appendDiagnostics(std::string& output) const {
+            PositionCounter positions(_text, _lineStarts);
+            output.push_back('[');
+            bool isFirst = true;
+            for (const std::unique_ptr<Segment>& segment : _segments) {
+                for (const Diagnostic& d : segment->result.diagnostics) {
+                    if (!isFirst) {
+                        output.push_back(',');
+                    }
+                    isFirst = false;
+                    appendDiagnostic(output, positions, *segment, d);
+                }
+            }
+            output.push_back(']');
+        }
+
+    private:
+        void appendDiagnostic(std::string& output, PositionCounter& positions,
+                              const Segment& segment, const Diagnostic& d) const
+        {
+            // Missing fields and unknown types are shown on the '@type{key' part
+            size_t length = 1;
+            int severity = 1;
+            switch (d.kind) {
+                case Diagnostic::Kind::ParseError:
+                    break;
+                case Diagnostic::Kind::UnknownType:
+                case Diagnostic::Kind::MissingField:
+                    // An entry without fields ends with its cite key
+                    length = std::min(segment.text.find_first_of(",})\n"),
+                                      segment.text.size());
+                    break;
+                case Diagnostic::Kind::ExtraField:
+                case Diagnostic::Kind::UndefinedMacro:
+                case Diagnostic::Kind::DuplicateField:
+                    length = d.message.size();
+                    severity = 2;
+                    break;
+            }
+            const size_t begin = segment.begin + d.offset;
+            const size_t end = std::min(begin + std::max<size_t>(length, 1), segment.end);
+
+            output += "{\"range\":{\"start\":";
+            positions.append(output, begin);
+            output += ",\"end\":";
+            positions.append(output, end);
+            output += "},\"severity\":" + std::to_string(severity);
+            output += ",\"source\":\"bibtexformat\",\"message\":";
+            appendJsonString(output, diagnosticMessage(d));
+            output.push_back('}');
+        }
+
+        void updateLineStarts() {
+            _lineStarts.clear();
+            _lineStarts.push_back(0);
+            const char* begin = _text.data();
+            const char* end = begin + _text.size();
+            for (const char* p = begin; p < end; ++p) {
+                p = static_cast<const char*>(std::memchr(p, '\n', end - p));
+                if (!p) {
+                    break;
+                }
+                _lineStarts.push_back(p - begin + 1);
+            }
+        }
+
+        // Lexes from 'begin' until the segmentation is in sync with the old segments
+        // again. The old segments are in the coordinates from before the change, which
+        // ended at 'changeEnd' in the new coordinates and moved everything after it by
+        // 'delta' bytes
+        void reparse(size_t begin, bool isRecovering, size_t changeEnd, ptrdiff_t delta,
+                     std::vector<std::unique_ptr<Segment>> oldSegments)
+        {
+            ParseOptions options;
+            options.macros = &_macros;
+            options.rules = _rules;
+            Lexer lexer(_text, begin, _text.size(), isRecovering);
+            RawEntry raw;
+            size_t position = begin;
+            while (true) {
+                // If the lexer is in between entries behind the change at a position that
+                // was in between entries in the same state before the change as well, it
+                // would produce the same segments as before from here on
+                if (position >= changeEnd) {
+                    const size_t oldPosition = position - delta;
+                    auto next = std::find_if(
+                        oldSegments.begin(),
+                        oldSegments.end(),
+                        [oldPosition](const std::unique_ptr<Segment>& s) {
+                            return s->end > oldPosition;
+                        }
+                    );
+                    const bool wasRecovering = next == oldSegments.begin() ?
+                        isRecovering :
+                        (*(next - 1))->isRecovering;
+                    const bool isBetweenEntries =
+                        next == oldSegments.end() || (*next)->begin >= oldPosition;
+                    if (isBetweenEntries && wasRecovering == lexer.isRecovering()) {
+                        for (auto it = next; it != oldSegments.end(); ++it) {
+                            (*it)->begin += delta;
+                            (*it)->end += delta;
+                            _segments.push_back(std::move(*it));
+                        }
+                        return;
+                    }
+                }
+
+                const bool wasLexerRecovering = lexer.isRecovering();
+                if (!lexer.next(raw)) {
+                    return;
+                }
+                position = raw.end;
+
+                auto segment = std::make_unique<Segment>();
+                segment->begin = raw.begin;
+                segment->end = raw.end;
+                segment->isUnterminated = raw.error == LexError::UnterminatedEntry;
+                // Either the entry runs until the end of the document or the lexer went
+                // back to the first possible entry start after reaching the end
+                const bool hasStartedRecovering =
+                    wasLexerRecovering != lexer.isRecovering();
+                segment->isSearchedToEnd = segment->isUnterminated &&
+                    (raw.end == _text.size() || hasStartedRecovering);
+                segment->isRecovering = lexer.isRecovering();
+                segment->text = _text.substr(raw.begin, raw.end - raw.begin);
+                // Only the entry at the start of the segment is parsed. Lexed on its own,
+                // an unterminated entry can recover at a line in it that the lexer of the
+                // whole document did not stop at, which would split it into more entries
+                parse(segment->text, 0, 1, false, options, segment->result);
+                _segments.push_back(std::move(segment));
+            }
+        }
+
+        std::string _text;
+        std::vector<std::unique_ptr<Segment>> _segments;
+        std::vector<size_t> _lineStarts;
+        const RuleSet* _rules;
+        MacroTable _macros;
+    };
+
+    bool readMessage(std::string& body) {
+        size_t contentLength = 0;
+        bool hasContentLength = false;
+        std::string line;
+        while (true) {
+            line.clear();
+            int c;
+            while ((c = std::getchar()) != EOF && c != '\n') {
+                line.push_back(static_cast<char>(c));
+            }
+            if (c == EOF) {
+                return false;
+            }
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                break;
+            }
+
+            constexpr std::string_view Header = "Content-Length:";
+            if (line.compare(0, Header.size(), Header) == 0) {
+                contentLength = std::strtoull(line.c_str() + Header.size(), nullptr, 10);
+                hasContentLength = true;
+            }
+        }
+        if (!hasContentLength) {
+            return false;
+        }
+
+        body.resize(contentLength);
+        return std::fread(body.data(), 1, contentLength, stdin) == contentLength;
+    }
+
+    void writeMessage(const std::string& body) {
+        const std::string header =
+            "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+        std::fwrite(header.data(), 1, header.size(), stdout);
+        std::fwrite(body.data(), 1, body.size(), stdout);
+        std::fflush(stdout);
+    }
+
+    void appendId(std::string& output, const JsonValue* id) {
+        if (id && id->type() == JsonValue::Type::String) {
+            appendJsonString(output, id->asString());
+        }
+        else if (id && id->type() == JsonValue::Type::Number) {
+            output += std::to_string(static_cast<long long>(id->asNumber()));
+        }
+        else {
+            output += "null";
+        }
+    }
+
+    void respond(const JsonValue* id, std::string_view result) {
+        std::string body = "{\"jsonrpc\":\"2.0\",\"id\":";
+        appendId(body, id);
+        body += ",\"result\":";
+        body += result;
+        body += "}";
+        writeMessage(body);
+    }
+
+    void respondError(const JsonValue* id, int code, std::string_view message) {
+        std::string body = "{\"jsonrpc\":\"2.0\",\"id\":";
+        appendId(body, id);
+        body += ",\"error\":{\"code\":" + std::to_string(code) + ",\"message\":";
+        appendJsonString(body, message);
+        body += "}}";
+        writeMessage(body);
+    }
+
+    void publishDiagnostics(const std::string& uri, const Document* document) {
+        std::string body =
+            "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\","
+            "\"params\":{\"uri\":";
+        appendJsonString(body, uri);
+        body += ",\"diagnostics\":";
+        if (document) {
+            document->appendDiagnostics(body);
+        }
+        else {
+            body += "[]";
+        }
+        body += "}}";
+        writeMessage(body);
+    }
+
+    const std::string& stringMember(const JsonValue* object, std::string_view key) {
+        static const std::string Empty;
+        const JsonValue* value = object ? object->find(key) : nullptr;
+        return value ? value->asString() : Empty;
+    }
+
+    size_t numberMember(const JsonValue* object, std::string_view key) {
+        const JsonValue* value = object ? object->find(key) : nullptr;
+        return value ? static_cast<size_t>(std::max(value->asNumber(), 0.0)) : 0;
+    }
+} // namespace
+
+int runLanguageServer(const RuleSet* rules) {
+#ifdef _WIN32
+    // Content-Length counts bytes, so no line ending translation must take place
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif // _WIN32
+
+    std::map<std::string, std::unique_ptr<Document>> documents;
+    bool isShutdown = false;
+
+    std::string body;
+    while (readMessage(body)) {
+        JsonValue message;
+        if (!JsonValue::parse(body, message)) {
+            respondError(nullptr, -32700, "Parse error");
+            continue;
+        }
+
+        const std::string& method = stringMember(&message, "method");
+        const JsonValue* id = message.find("id");
+        const JsonValue* params = message.find("params");
+        const JsonValue* textDocument = params ? params->find("textDocument") : nullptr;
+        const std::string& uri = stringMember(textDocument, "uri");
+
+        if (method == "initialize") {
+            respond(
+                id,
+                "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,"
+                "\"change\":2}},\"serverInfo\":{\"name\":\"BibTexFormat\"}}"
+            );
+        }
+        else if (method == "shutdown") {
+            isShutdown = true;
+            respond(id, "null");
+        }
+        else if (method == "exit") {
+            return isShutdown ? 0 : 1;
+        }
+        else if (method == "textDocument/didOpen") {
+            const std::string& text = stringMember(textDocument, "text");
+            auto document = std::make_unique<Document>(text, rules);
+            publishDiagnostics(uri, document.get());
+            documents[uri] = std::move(document);
+        }
+        else if (method == "textDocument/didChange") {
+            auto it = documents.find(uri);
+            const JsonValue* changes = params ? params->find("contentChanges") : nullptr;
+            const bool isValid = it != documents.end() && changes &&
+                                 changes->type() == JsonValue::Type::Array;
+            if (!isValid) {
+                continue;
+            }
+
+            Document& document = *it->second;
+            for (const JsonValue& change : changes->asArray()) {
+                const JsonValue* range = change.find("range");
+                const std::string& text = stringMember(&change, "text");
+                if (!range) {
+                    document.setText(text);
+                    continue;
+                }
+
+                const JsonValue* start = range->find("start");
+                const JsonValue* end = range->find("end");
+                document.applyChange(
+                    document.offsetOf(
+                        numberMember(start, "line"),
+                        numberMember(start, "character")
+                    ),
+                    document.offsetOf(
+                        numberMember(end, "line"),
+                        numberMember(end, "character")
+                    ),
+                    text
+                );
+            }
+            publishDiagnostics(uri, &document);
+        }
+        else if (method == "textDocument/didClose") {
+            documents.erase(uri);
+            publishDiagnostics(uri, nullptr);
+        }
+        else if (id) {
+            respondError(id, -32601, "Method not found: " + method);
+        }
+    }
+    return isShutdown ? 0 : 1;
+}
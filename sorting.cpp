@@ -0,0 +1,585 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "sorting.h"
+
+#include "entry.h"
+#include "formatter.h"
+#include "lexer.h"
+#include "mappedfile.h"
+#include "names.h"
+#include "outputbuffer.h"
+#include "parser.h"
+#include "stringpool.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+
+namespace {
+    // Chunks smaller than this are not worth a task of their own
+    constexpr size_t MinChunkSize = 4096;
+
+    // Years are stored in 16 bits, so that the year and the first six bytes of the name
+    // fit into the prefix
+    constexpr uint64_t NoYear = 0xffff;
+
+    // The venue of the key is compared by its bytes instead of its rank in a StringPool
+    constexpr uint32_t NoRank = std::numeric_limits<uint32_t>::max();
+
+    // Everything that entries are compared by. Most comparisons are decided by the
+    // prefix, which holds the first bytes of the primary key in big-endian order, so
+    // that comparing the integers compares the bytes
+    struct SortKey {
+        uint64_t prefix = 0;
+        // The cite key, the folded von and last part of the first author, or the venue
+        std::string_view primary;
+        // The year if it doesn't fit into the prefix
+        uint64_t secondary = 0;
+        std::string_view citeKey;
+        // The chunk or file of the entry and the position of the entry in there, which
+        // make every key unique and keep entries that are otherwise equal in order
+        uint32_t source = 0;
+        uint32_t position = 0;
+    };
+
+    bool operator<(const SortKey& lhs, const SortKey& rhs) {
+        if (lhs.prefix != rhs.prefix) {
+            return lhs.prefix < rhs.prefix;
+        }
+        if (const int c = lhs.primary.compare(rhs.primary); c != 0) {
+            return c < 0;
+        }
+        if (lhs.secondary != rhs.secondary) {
+            return lhs.secondary < rhs.secondary;
+        }
+        if (const int c = lhs.citeKey.compare(rhs.citeKey); c != 0) {
+            return c < 0;
+        }
+        if (lhs.source != rhs.source) {
+            return lhs.source < rhs.source;
+        }
+        return lhs.position < rhs.position;
+    }
+
+    uint64_t packPrefix(std::string_view text, int nBytes) {
+        uint64_t prefix = 0;
+        for (int i = 0; i < nBytes; ++i) {
+            const size_t index = static_cast<size_t>(i);
+            prefix = (prefix << 8) |
+                     (index < text.size() ? static_cast<unsigned char>(text[index]) : 0);
+        }
+        return prefix;
+    }
+
+    uint64_t parseYear(std::string_view year) {
+        uint64_t value = 0;
+        size_t nDigits = 0;
+        for (char c : year) {
+            if (c >= '0' && c <= '9') {
+                value = value * 10 + static_cast<uint64_t>(c - '0');
+                if (++nDigits == 4) {
+                    break;
+                }
+            }
+            else if (nDigits > 0) {
+                break;
+            }
+        }
+        return nDigits > 0 ? value : NoYear;
+    }
+
+    // The venue of an entry as it is compared by SortOrder::Venue
+    const Field* venueField(const Entry& entry) {
+        const Field* journal = entry.field(Keyword::Journal);
+        return journal && !journal->value.empty() ? journal :
+                                                    entry.field(Keyword::BookTitle);
+    }
+
+    // The folded name is a view into the cache, which has to outlive the key. A
+    // 'venueRank' other than NoRank replaces the 'venue'; entries without a venue have to
+    // be ranked after all venues
+    SortKey makeKey(SortOrder order, std::string_view citeKey, std::string_view year,
+                    std::string_view authors, std::string_view venue, uint32_t venueRank,
+                    NameCache& names)
+    {
+        SortKey key;
+        key.citeKey = citeKey;
+        if (order == SortOrder::CiteKey) {
+            key.primary = citeKey;
+            key.prefix = packPrefix(citeKey, 8);
+        }
+        else if (order == SortOrder::Venue && venueRank != NoRank) {
+            key.prefix = (uint64_t(venueRank) << 16) | parseYear(year);
+        }
+        else if (order == SortOrder::Venue) {
+            // UTF-8 never contains the byte 0xff, so no venue has this prefix
+            key.prefix = venue.empty() ? std::numeric_limits<uint64_t>::max() :
+                                         packPrefix(venue, 8);
+            key.primary = venue;
+            key.secondary = parseYear(year);
+        }
+        else {
+            const NameList& list = names.names(authors);
+            if (!list.names.empty()) {
+                key.primary = list.names.front().folded;
+            }
+            key.prefix = (parseYear(year) << 48) | packPrefix(key.primary, 6);
+        }
+        return key;
+    }
+
+    // Sorts chunks of the keys in parallel and then merges pairs of them, also in
+    // parallel, until only one is left. As no two keys are equal, the result is the same
+    // as that of std::sort, regardless of the number of threads
+    void parallelSort(std::vector<SortKey>& keys, ThreadPool& pool) {
+        const size_t nChunks = std::min<size_t>(pool.size(), keys.size() / MinChunkSize);
+        if (nChunks <= 1) {
+            std::sort(keys.begin(), keys.end());
+            return;
+        }
+
+        std::vector<size_t> bounds;
+        for (size_t i = 0; i <= nChunks; ++i) {
+            bounds.push_back(keys.size() * i / nChunks);
+        }
+        for (size_t i = 0; i < nChunks; ++i) {
+            pool.enqueue([&keys, begin = bounds[i], end = bounds[i + 1]]() {
+                std::sort(keys.begin() + begin, keys.begin() + end);
+            });
+        }
+        pool.wait();
+
+        std::vector<SortKey> merged(keys.size());
+        while (bounds.size() > 2) {
+            std::vector<size_t> mergedBounds;
+            for (size_t i = 0; i + 1 < bounds.size(); i += 2) {
+                mergedBounds.push_back(bounds[i]);
+                // An odd chunk at the end is merged in the next round
+                const size_t middle = bounds[i + 1];
+                const size_t end = i + 2 < bounds.size() ? bounds[i + 2] : middle;
+                pool.enqueue([&keys, &merged, begin = bounds[i], middle, end]() {
+                    std::merge(
+                        keys.begin() + begin,
+                        keys.begin() + middle,
+                        keys.begin() + middle,
+                        keys.begin() + end,
+                        merged.begin() + begin
+                    );
+                });
+            }
+            mergedBounds.push_back(keys.size());
+            pool.wait();
+            keys.swap(merged);
+            bounds = std::move(mergedBounds);
+        }
+    }
+
+    // Writes the text of an entry, which is parsed again if it has to be formatted
+    void writeEntry(std::string_view text, bool shouldFormat, Formatter& formatter) {
+        if (!shouldFormat) {
+            formatter.writeVerbatim(text);
+            return;
+        }
+        ParseResult result;
+        parse(text, 0, text.size(), false, ParseOptions(), result);
+        for (const Block& block : result.blocks) {
+            const bool canFormat = block.entryIndex != Block::NoEntry &&
+                result.entries[block.entryIndex].entryType != Type::Unknown;
+            if (canFormat) {
+                formatter.write(result.entries[block.entryIndex]);
+            }
+            else {
+                formatter.writeVerbatim(block.text);
+            }
+        }
+    }
+
+    // One of the sources of a merge, which is read one entry at a time
+    class SortedSource {
+    public:
+        SortedSource(std::string_view source, uint32_t index, SortOrder order,
+                     NameCache& names)
+            : _source(source)
+            , _lexer(source)
+            , _index(index)
+            , _order(order)
+            , _names(names)
+        {}
+
+        // Moves to the next entry and returns false at the end of the source. The blocks
+        // that are skipped on the way, as they are not entries, are added to 'blocks'
+        bool next(std::vector<std::string_view>* blocks) {
+            RawEntry raw;
+            while (_lexer.next(raw)) {
+                const std::string_view text =
+                    _source.substr(raw.begin, raw.end - raw.begin);
+                if (raw.error != LexError::None || raw.kind != EntryKind::Regular) {
+                    if (blocks) {
+                        blocks->push_back(text);
+                    }
+                    continue;
+                }
+
+                FieldParser parser(raw.body, raw.kind);
+                std::string_view year;
+                std::string_view authors;
+                std::string_view journal;
+                std::string_view bookTitle;
+                RawField field;
+                while (parser.next(field)) {
+                    // Like in an Entry, the first of repeated fields counts
+                    const Keyword keyword = keywordFromString(field.key);
+                    if (keyword == Keyword::Year && year.empty()) {
+                        year = field.contents;
+                    }
+                    else if (keyword == Keyword::Author && authors.empty()) {
+                        authors = field.contents;
+                    }
+                    else if (keyword == Keyword::Journal && journal.empty()) {
+                        journal = field.contents;
+                    }
+                    else if (keyword == Keyword::BookTitle && bookTitle.empty()) {
+                        bookTitle = field.contents;
+                    }
+                }
+                if (parser.error() != LexError::None) {
+                    if (blocks) {
+                        blocks->push_back(text);
+                    }
+                    continue;
+                }
+
+                // The venue is joined like in an Entry. The previous key is still needed
+                // to check the order of the source, so the venues alternate between two
+                // buffers, while the folded name of the previous key stays valid in the
+                // cache
+                std::string& venue = _venues[_position % 2];
+                if (_order == SortOrder::Venue) {
+                    const std::string_view value = journal.empty() ? bookTitle : journal;
+                    venue.resize(value.size());
+                    venue.resize(normalizeWhitespace(value, venue.data()));
+                }
+                SortKey key = makeKey(
+                    _order,
+                    parser.citeKey(),
+                    year,
+                    authors,
+                    venue,
+                    NoRank,
+                    _names
+                );
+                key.source = _index;
+                key.position = _position++;
+                if (_position > 1 && key < _key && _unsortedKey.empty()) {
+                    _unsortedKey = key.citeKey;
+                }
+                _key = key;
+                _text = text;
+                return true;
+            }
+            return false;
+        }
+
+        const SortKey& key() const {
+            return _key;
+        }
+
+        std::string_view text() const {
+            return _text;
+        }
+
+        // The cite key of the first entry that comes before the entry preceding it, or
+        // an empty view if the source is sorted
+        std::string_view unsortedKey() const {
+            return _unsortedKey;
+        }
+
+    private:
+        std::string_view _source;
+        Lexer _lexer;
+        uint32_t _index;
+        SortOrder _order;
+        NameCache& _names;
+
+        SortKey _key;
+        uint32_t _position = 0;
+        std::string _venues[2];
+        std::string_view _text;
+        std::string_view _unsortedKey;
+    };
+
+    std::string_view sortOrderDescription(SortOrder order) {
+        switch (order) {
+            case SortOrder::CiteKey:    return "cite key";
+            case SortOrder::YearAuthor: return "year and author";
+            case SortOrder::Venue:      return "venue and year";
+        }
+        return std::string_view();
+    }
+} // namespace
+
+bool sortOrderFromName(std::string_view name, SortOrder& order) {
+    if (name == "key") {
+        order = SortOrder::CiteKey;
+    }
+    else if (name == "year") {
+        order = SortOrder::YearAuthor;
+    }
+    else if (name == "venue") {
+        order = SortOrder::Venue;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+bool collisionPolicyFromName(std::string_view name, CollisionPolicy& policy) {
+    if (name == "first") {
+        policy = CollisionPolicy::KeepFirst;
+    }
+    else if (name == "last") {
+        policy = CollisionPolicy::KeepLast;
+    }
+    else if (name == "all") {
+        policy = CollisionPolicy::KeepAll;
+    }
+    else if (name == "error") {
+        policy = CollisionPolicy::Fail;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+bool writeSorted(const std::vector<ParseResult>& results, SortOrder order,
+                 bool shouldFormat, unsigned int nThreads, OutputBuffer& output,
+                 const StringPool* venues)
+{
+    ThreadPool pool(nThreads);
+
+    // Interned venues are compared as integers. Entries without a venue are ranked
+    // after all of them
+    const bool comparesRanks = venues && order == SortOrder::Venue;
+    const std::vector<uint32_t> ranks =
+        comparesRanks ? venues->ranks() : std::vector<uint32_t>();
+    const uint32_t lastRank = comparesRanks ? static_cast<uint32_t>(venues->size()) : 0;
+
+    // The keys of every chunk are computed on their own, while the names of the authors
+    // are shared by all chunks, as the same lists recur throughout the file
+    std::vector<std::vector<SortKey>> chunkKeys(results.size());
+    NameCache names;
+    for (size_t i = 0; i < results.size(); ++i) {
+        pool.enqueue([&results, &chunkKeys, &names, &ranks, comparesRanks, lastRank,
+                      order, i]()
+        {
+            const ParseResult& result = results[i];
+            for (size_t j = 0; j < result.blocks.size(); ++j) {
+                const Block& block = result.blocks[j];
+                if (block.entryIndex == Block::NoEntry) {
+                    continue;
+                }
+                const Entry& entry = result.entries[block.entryIndex];
+                const Field* venue =
+                    order == SortOrder::Venue ? venueField(entry) : nullptr;
+                uint32_t venueRank = NoRank;
+                if (comparesRanks) {
+                    const bool hasRank = venue && !venue->value.empty() &&
+                                         venue->valueId != NoStringId;
+                    venueRank = hasRank ? ranks[venue->valueId] : lastRank;
+                }
+                SortKey key = makeKey(
+                    order,
+                    entry.citeKey,
+                    entry[Keyword::Year],
+                    entry[Keyword::Author],
+                    venue ? venue->value : std::string_view(),
+                    venueRank,
+                    names
+                );
+                key.source = static_cast<uint32_t>(i);
+                key.position = static_cast<uint32_t>(j);
+                chunkKeys[i].push_back(key);
+            }
+        });
+    }
+    pool.wait();
+
+    std::vector<SortKey> keys;
+    for (std::vector<SortKey>& chunk : chunkKeys) {
+        keys.insert(keys.end(), chunk.begin(), chunk.end());
+    }
+    parallelSort(keys, pool);
+
+    Formatter formatter(output);
+    for (const ParseResult& result : results) {
+        for (const Block& block : result.blocks) {
+            if (block.entryIndex == Block::NoEntry) {
+                formatter.writeVerbatim(block.text);
+            }
+        }
+    }
+    for (const SortKey& key : keys) {
+        const ParseResult& result = results[key.source];
+        const Block& block = result.blocks[key.position];
+        const Entry& entry = result.entries[block.entryIndex];
+        if (shouldFormat && entry.entryType != Type::Unknown) {
+            formatter.write(entry);
+        }
+        else {
+            formatter.writeVerbatim(block.text);
+        }
+    }
+    return output.flush();
+}
+
+MergeReport mergeSorted(const std::vector<std::string>& paths, SortOrder order,
+                        CollisionPolicy policy, bool shouldFormat, OutputBuffer& output)
+{
+    MergeReport report;
+    std::vector<std::unique_ptr<MappedFile>> files;
+    for (const std::string& path : paths) {
+        files.push_back(std::make_unique<MappedFile>(path));
+        if (!files.back()->isValid()) {
+            report.error = "Could not open BibTex file " + path;
+            return report;
+        }
+    }
+
+    // The first pass only checks the order and collects the blocks that are not
+    // entries, which have to be written before all entries. The names of the authors
+    // that it parses are reused by the second pass
+    NameCache names;
+    std::vector<std::string_view> blocks;
+    for (size_t i = 0; i < files.size(); ++i) {
+        const uint32_t index = static_cast<uint32_t>(i);
+        SortedSource source(files[i]->contents(), index, order, names);
+        while (source.next(&blocks)) {}
+        if (!source.unsortedKey().empty()) {
+            report.error = "The entries of " + paths[i] + " are not sorted by " +
+                           std::string(sortOrderDescription(order)) + ", " +
+                           std::string(source.unsortedKey()) + " is out of order";
+            return report;
+        }
+    }
+
+    Formatter formatter(output);
+    for (std::string_view block : blocks) {
+        formatter.writeVerbatim(block);
+    }
+
+    std::vector<std::unique_ptr<SortedSource>> sources;
+    for (size_t i = 0; i < files.size(); ++i) {
+        const uint32_t index = static_cast<uint32_t>(i);
+        sources.push_back(
+            std::make_unique<SortedSource>(files[i]->contents(), index, order, names)
+        );
+    }
+    // A min-heap of the sources that have entries left, ordered by their current entry
+    auto isAfter = [](const SortedSource* lhs, const SortedSource* rhs) {
+        return rhs->key() < lhs->key();
+    };
+    std::vector<SortedSource*> heap;
+    for (const std::unique_ptr<SortedSource>& source : sources) {
+        if (source->next(nullptr)) {
+            heap.push_back(source.get());
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), isAfter);
+
+    // Colliding entries are next to each other, so only the last entry is held back
+    // until it is clear whether the next one replaces it
+    std::string_view pendingText;
+    std::string_view pendingKey;
+    bool hasPending = false;
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), isAfter);
+        SortedSource* source = heap.back();
+        const std::string_view text = source->text();
+        const std::string_view citeKey = source->key().citeKey;
+
+        if (hasPending && citeKey == pendingKey) {
+            if (policy == CollisionPolicy::Fail) {
+                report.error = "The cite key " + std::string(citeKey) +
+                               " is used by more than one entry";
+                output.flush();
+                return report;
+            }
+            if (report.collisions.empty() || report.collisions.back() != citeKey) {
+                report.collisions.emplace_back(citeKey);
+            }
+            switch (policy) {
+                case CollisionPolicy::KeepFirst:
+                    break;
+                case CollisionPolicy::KeepLast:
+                    pendingText = text;
+                    break;
+                case CollisionPolicy::KeepAll:
+                    writeEntry(pendingText, shouldFormat, formatter);
+                    pendingText = text;
+                    break;
+                case CollisionPolicy::Fail:
+                    break;
+            }
+        }
+        else {
+            if (hasPending) {
+                writeEntry(pendingText, shouldFormat, formatter);
+            }
+            pendingText = text;
+            pendingKey = citeKey;
+            hasPending = true;
+        }
+
+        if (source->next(nullptr)) {
+            std::push_heap(heap.begin(), heap.end(), isAfter);
+        }
+        else {
+            heap.pop_back();
+        }
+    }
+    if (hasPending) {
+        writeEntry(pendingText, shouldFormat, formatter);
+    }
+    if (!output.flush()) {
+        report.error = "Could not write the merged bibliography";
+    }
+    return report;
+}
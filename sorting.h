@@ -0,0 +1,104 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#ifndef __BIBTEXFORMAT___SORTING___H__
+#define __BIBTEXFORMAT___SORTING___H__
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+class OutputBuffer;
+class StringPool;
+struct ParseResult;
+
+enum class SortOrder {
+    // The cite keys byte by byte
+    CiteKey,
+    // The year, then the folded von and last part of the first author's name, see
+    // parseNames, then the cite key. Entries without a year come last
+    YearAuthor,
+    // The journal or, if there is none, the booktitle byte by byte, then the year, then
+    // the cite key. Entries without either come last
+    Venue
+};
+
+// Accepts 'key', 'year', and 'venue'
+bool sortOrderFromName(std::string_view name, SortOrder& order);
+
+// What happens to entries with the same cite key when bibliographies are merged
+enum class CollisionPolicy {
+    KeepFirst, // Only the entry of the first file that has the cite key is written
+    KeepLast,  // Only the entry of the last file that has the cite key is written
+    KeepAll,   // All entries are written, BibTeX then uses the first one
+    Fail       // The merge stops at the first collision
+};
+
+// Accepts 'first', 'last', 'all', and 'error'
+bool collisionPolicyFromName(std::string_view name, CollisionPolicy& policy);
+
+// Writes the parsed source with its entries in the order. Blocks that are not entries,
+// such as @string, @preamble, comments, and entries that could not be parsed, come first
+// in the order of the source, as the entries might use the macros. Entries that are
+// equal in the order keep the order of the source. The sort keys are computed and
+// sorted on 'nThreads' threads, but the output is the same for every number of threads.
+// If the results were parsed with 'venues' as ParseOptions::venues, the venues are
+// compared by their rank in the pool instead of their bytes, which gives the same order.
+// Returns false if writing failed
+bool writeSorted(const std::vector<ParseResult>& results, SortOrder order,
+                 bool shouldFormat, unsigned int nThreads, OutputBuffer& output,
+                 const StringPool* venues = nullptr);
+
+struct MergeReport {
+    // The reason why the merge failed or an empty string on success
+    std::string error;
+    // The cite keys that were used by more than one entry, each one only once
+    std::vector<std::string> collisions;
+};
+
+// Merges bibliographies that are each sorted in the order into one sorted bibliography.
+// The blocks that are not entries come first, in the order of the files and of their
+// sources. The entries are merged by streaming through all sources at the same time,
+// so apart from the mapped files only one entry per file is held at any time. Entries
+// that are equal in the order are taken from the files in the order of 'paths'.
+//
+// Entries with the same cite key collide if they are next to each other in the merged
+// order, which, when sorting by year, also requires the same year and first author. A
+// file that is not sorted is reported before anything is written, but with
+// CollisionPolicy::Fail the output ends at the first collision
+MergeReport mergeSorted(const std::vector<std::string>& paths, SortOrder order,
+                        CollisionPolicy policy, bool shouldFormat, OutputBuffer& output);
+
+#endif // __BIBTEXFORMAT___SORTING___H__
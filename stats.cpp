@@ -0,0 +1,234 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "stats.h"
+
+#include "lexer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<bool> IsCountingAllocations = false;
+    std::atomic<uint64_t> NAllocations = 0;
+    std::atomic<uint64_t> NAllocatedBytes = 0;
+
+    constexpr const char* PhaseNames[NPhases] = {
+        "read", "lex", "validate", "diagnostics", "duplicates", "format", "write"
+    };
+
+    double megabytes(uint64_t bytes) {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    template <typename... Args>
+    void appendFormatted(std::string& output, const char* format, Args... args) {
+        char buffer[256];
+        const int size = std::snprintf(buffer, sizeof(buffer), format, args...);
+        if (size > 0) {
+            const size_t length = std::min(static_cast<size_t>(size), sizeof(buffer) - 1);
+            output.append(buffer, length);
+        }
+    }
+} // namespace
+
+// The replacements for the global allocation functions, through which all other forms
+// of operator new and delete go as well
+void* operator new(std::size_t size) {
+    if (IsCountingAllocations.load(std::memory_order_relaxed)) {
+        NAllocations.fetch_add(1, std::memory_order_relaxed);
+        NAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    while (true) {
+        if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+            return pointer;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+Stopwatch::Stopwatch()
+    : _start(std::chrono::steady_clock::now())
+{}
+
+uint64_t Stopwatch::lap() {
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const std::chrono::nanoseconds elapsed =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - _start);
+    _start = now;
+    return elapsed.count();
+}
+
+void setAllocationCounting(bool isCounting) {
+    IsCountingAllocations = isCounting;
+}
+
+AllocationCounts allocationCounts() {
+    return { NAllocations.load(), NAllocatedBytes.load() };
+}
+
+Statistics::Statistics(size_t nSlowestEntries)
+    : _nSlowestEntries(nSlowestEntries)
+{}
+
+size_t Statistics::nSlowestEntries() const {
+    return _nSlowestEntries;
+}
+
+void Statistics::addPhase(Phase phase, uint64_t nanoseconds) {
+    _phaseNanoseconds[static_cast<size_t>(phase)] += nanoseconds;
+}
+
+void Statistics::addFile(uint64_t size) {
+    _nFiles += 1;
+    _nBytes += size;
+}
+
+void Statistics::addTimings(std::string_view path, std::string_view source,
+                            const ParseTimings& timings, const SourceStart& start)
+{
+    addPhase(Phase::Lex, timings.lexNanoseconds);
+    addPhase(Phase::Validate, timings.validateNanoseconds);
+    _nEntries += timings.nEntries;
+
+    // The lines and cite keys are only looked up for the few slowest entries, so that
+    // they don't cost anything while parsing
+    std::vector<EntryTime> times = timings.slowestEntries;
+    std::sort(
+        times.begin(),
+        times.end(),
+        [](const EntryTime& lhs, const EntryTime& rhs) { return lhs.offset < rhs.offset; }
+    );
+    std::vector<SlowEntry> entries;
+    size_t line = start.line;
+    size_t lineOffset = 0;
+    for (const EntryTime& time : times) {
+        line += std::count(
+            source.begin() + lineOffset,
+            source.begin() + time.offset,
+            '\n'
+        );
+        lineOffset = time.offset;
+
+        Lexer lexer(source, time.offset, time.offset + 1, false);
+        RawEntry raw;
+        std::string_view citeKey;
+        if (lexer.next(raw) && raw.kind == EntryKind::Regular) {
+            citeKey = FieldParser(raw.body, raw.kind).citeKey();
+        }
+        entries.push_back({
+            time.nanoseconds,
+            std::string(path),
+            line,
+            std::string(citeKey)
+        });
+    }
+
+    std::lock_guard lock(_mutex);
+    std::move(entries.begin(), entries.end(), std::back_inserter(_slowestEntries));
+    std::stable_sort(
+        _slowestEntries.begin(),
+        _slowestEntries.end(),
+        [](const SlowEntry& lhs, const SlowEntry& rhs) {
+            return lhs.nanoseconds > rhs.nanoseconds;
+        }
+    );
+    if (_slowestEntries.size() > _nSlowestEntries) {
+        _slowestEntries.resize(_nSlowestEntries);
+    }
+}
+
+std::string Statistics::report(uint64_t nanoseconds,
+                               const AllocationCounts& allocations) const
+{
+    const uint64_t nBytes = _nBytes;
+    const uint64_t nEntries = _nEntries;
+    const double seconds = std::max(nanoseconds, uint64_t(1)) / 1e9;
+
+    std::string output = "Statistics:\n";
+    appendFormatted(output, "  Files:        %llu\n",
+                    static_cast<unsigned long long>(_nFiles.load()));
+    appendFormatted(output, "  Input:        %.2f MB, %llu entries\n", megabytes(nBytes),
+                    static_cast<unsigned long long>(nEntries));
+    appendFormatted(output, "  Wall time:    %.2f ms, %.1f MB/s, %.0f entries/s\n",
+                    seconds * 1000.0, megabytes(nBytes) / seconds, nEntries / seconds);
+    appendFormatted(output, "  Allocations:  %llu, %.2f MB\n",
+                    static_cast<unsigned long long>(allocations.nAllocations),
+                    megabytes(allocations.nBytes));
+
+    // With several threads, the phases can add up to more than the wall time
+    output += "  Phase (summed over threads)       ms       MB/s\n";
+    for (size_t i = 0; i < NPhases; ++i) {
+        const uint64_t phase = _phaseNanoseconds[i];
+        if (phase == 0) {
+            continue;
+        }
+        // The throughput of very short phases is meaningless
+        const double phaseSeconds = phase / 1e9;
+        appendFormatted(output, "    %-27s %10.2f", PhaseNames[i], phaseSeconds * 1000.0);
+        if (phaseSeconds >= 0.001) {
+            appendFormatted(output, " %10.1f", megabytes(nBytes) / phaseSeconds);
+        }
+        output += '\n';
+    }
+
+    std::lock_guard lock(_mutex);
+    if (!_slowestEntries.empty()) {
+        output += "  Slowest entries:\n";
+    }
+    for (const SlowEntry& entry : _slowestEntries) {
+        appendFormatted(output, "    %10.3f ms  ", entry.nanoseconds / 1e6);
+        output += entry.path + ':' + std::to_string(entry.line);
+        if (!entry.citeKey.empty()) {
+            output += "  " + entry.citeKey;
+        }
+        output += '\n';
+    }
+    return output;
+}
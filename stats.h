@@ -0,0 +1,127 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#ifndef __BIBTEXFORMAT___STATS___H__
+#define __BIBTEXFORMAT___STATS___H__
+
+#include "diagnostic.h"
+#include "parser.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The phases of a run. A phase that is run for every file is summed over all files
+enum class Phase {
+    Read,        // Opening and reading or mapping the files
+    Lex,         // Finding the entries
+    Validate,    // Splitting the entries into fields and validating them
+    Diagnostics, // Turning the diagnostics into text, JSON, or SARIF
+    Duplicates,  // Collecting the keys and searching for duplicates
+    Format,      // Writing the formatted bibliography
+    Write        // Writing the diagnostics
+};
+constexpr size_t NPhases = 7;
+
+// Measures the time since it was created or since the last lap
+class Stopwatch {
+public:
+    Stopwatch();
+
+    // Returns the nanoseconds since the last lap and starts a new one
+    uint64_t lap();
+
+private:
+    std::chrono::steady_clock::time_point _start;
+};
+
+// While enabled, every allocation through operator new is counted. The counters are
+// shared by all threads, but as they are only updated with relaxed atomic operations,
+// the cost is small compared to the allocation itself
+void setAllocationCounting(bool isCounting);
+
+struct AllocationCounts {
+    uint64_t nAllocations = 0;
+    uint64_t nBytes = 0;
+};
+AllocationCounts allocationCounts();
+
+// Collects the numbers that are reported by --stats. All functions can be called from
+// any thread
+class Statistics {
+public:
+    explicit Statistics(size_t nSlowestEntries);
+
+    // The number of slowest entries that are kept, which ParseOptions::nSlowestEntries
+    // should be set to
+    size_t nSlowestEntries() const;
+
+    void addPhase(Phase phase, uint64_t nanoseconds);
+    void addFile(uint64_t size);
+
+    // Adds the lexing and validation times and the slowest entries of a parsed
+    // 'source', which begins at 'start' in the file 'path'
+    void addTimings(std::string_view path, std::string_view source,
+                    const ParseTimings& timings,
+                    const SourceStart& start = SourceStart());
+
+    // Returns the human readable summary, where 'nanoseconds' is the wall time of the
+    // whole run from which the throughput is computed
+    std::string report(uint64_t nanoseconds, const AllocationCounts& allocations) const;
+
+private:
+    struct SlowEntry {
+        uint64_t nanoseconds;
+        std::string path;
+        size_t line;
+        std::string citeKey;
+    };
+
+    std::atomic<uint64_t> _phaseNanoseconds[NPhases] = {};
+    std::atomic<uint64_t> _nFiles = 0;
+    std::atomic<uint64_t> _nBytes = 0;
+    std::atomic<uint64_t> _nEntries = 0;
+
+    const size_t _nSlowestEntries;
+    mutable std::mutex _mutex;
+    // Sorted from the slowest to the fastest
+    std::vector<SlowEntry> _slowestEntries;
+};
+
+#endif // __BIBTEXFORMAT___STATS___H__
@@ -0,0 +1,219 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "stream.h"
+
+#include "diagnostic.h"
+#include "entry.h"
+#include "formatter.h"
+#include "lexer.h"
+#include "macros.h"
+#include "outputbuffer.h"
+#include "parser.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace {
+    constexpr size_t ChunkSize = 4 * 1024 * 1024;
+    constexpr size_t MaxPendingSize = 64 * 1024 * 1024;
+
+    // Returns the end of the last entry in the window that is certainly complete. An
+    // unterminated entry for which the lexer had to search until the end of the window
+    // might still be terminated by the next chunk, so it and everything after it has to
+    // wait. Text after the last complete entry waits as well, so that a comment that
+    // straddles two chunks is still reproduced as a single block
+    size_t findCompleteEntries(std::string_view window, bool isRecovering) {
+        Lexer lexer(window, 0, window.size(), isRecovering);
+        RawEntry raw;
+        size_t end = 0;
+        while (true) {
+            const bool wasRecovering = lexer.isRecovering();
+            if (!lexer.next(raw)) {
+                break;
+            }
+            const bool isCutOff = raw.error == LexError::UnterminatedEntry &&
+                (raw.end == window.size() || wasRecovering != lexer.isRecovering());
+            if (isCutOff) {
+                break;
+            }
+            end = raw.end;
+        }
+        return end;
+    }
+
+    // Returns how much of a window without complete entries is handled as if the input
+    // ended there. That is the first entry, which ends wherever the lexer recovers, or
+    // the whole window if it only contains text
+    size_t findForcedEnd(std::string_view window, bool isRecovering) {
+        Lexer lexer(window, 0, window.size(), isRecovering);
+        RawEntry raw;
+        return lexer.next(raw) ? raw.end : window.size();
+    }
+} // namespace
+
+bool processStream(std::FILE* input, std::FILE* output, DiagnosticFormat format,
+                   std::string_view path, std::FILE* diagnostics, Statistics* stats,
+                   const RuleSet* rules)
+{
+    Stopwatch stopwatch;
+    auto endPhase = [stats, &stopwatch](Phase phase) {
+        const uint64_t nanoseconds = stopwatch.lap();
+        if (stats) {
+            stats->addPhase(phase, nanoseconds);
+        }
+    };
+
+    std::unique_ptr<OutputBuffer> buffer;
+    std::unique_ptr<Formatter> formatter;
+    if (output) {
+        buffer = std::make_unique<OutputBuffer>(output);
+        formatter = std::make_unique<Formatter>(*buffer);
+    }
+
+    // The macros of all windows so far
+    MacroTable macros;
+    ParseOptions options;
+    options.needsEntries = output != nullptr;
+    options.macros = &macros;
+    options.rules = rules;
+    if (stats) {
+        options.measuresTime = true;
+        options.nSlowestEntries = stats->nSlowestEntries();
+    }
+
+    std::string window;
+    bool isEnd = false;
+    bool hasReadError = false;
+    bool isRecovering = false;
+    SourceStart start;
+    bool hasDiagnostics = false;
+    std::string report(reportBegin(format));
+    while (!isEnd) {
+        // Read at least as much as is already pending, so that an entry that stays
+        // incomplete for a long time is only scanned a logarithmic number of times, but
+        // never more than what is left until the pending limit is reached
+        size_t readSize = std::max(ChunkSize, window.size());
+        if (window.size() < MaxPendingSize) {
+            readSize = std::min(readSize, MaxPendingSize - window.size());
+        }
+        const size_t pendingSize = window.size();
+        window.resize(pendingSize + readSize);
+        const size_t nRead = std::fread(window.data() + pendingSize, 1, readSize, input);
+        window.resize(pendingSize + nRead);
+        if (nRead < readSize) {
+            isEnd = true;
+            hasReadError = std::ferror(input) != 0;
+        }
+        endPhase(Phase::Read);
+
+        std::string_view source = window;
+        size_t end = isEnd ? source.size() : findCompleteEntries(source, isRecovering);
+        if (end == 0 && source.size() >= MaxPendingSize) {
+            end = findForcedEnd(source, isRecovering);
+        }
+        // Looking for the complete entries is counted as lexing
+        endPhase(Phase::Lex);
+        if (end == 0) {
+            continue;
+        }
+
+        // The entries before 'end' don't extend past it, so they are parsed exactly as
+        // they would have been as part of the whole file
+        macros.collect(source, 0, end, isRecovering);
+        ParseResult result;
+        parse(source, 0, end, isRecovering, options, result);
+        if (stats) {
+            stats->addTimings(path, source, result.timings, start);
+        }
+        stopwatch.lap();
+
+        // In the machine readable formats, the objects of all windows are joined
+        const bool isJoined = format != DiagnosticFormat::Text && hasDiagnostics;
+        if (isJoined && !result.diagnostics.empty()) {
+            report += ",\n";
+        }
+        hasDiagnostics |= !result.diagnostics.empty();
+        appendDiagnostics(report, format, path, source, result.diagnostics, start);
+        endPhase(Phase::Diagnostics);
+        std::fwrite(report.data(), 1, report.size(), diagnostics);
+        report.clear();
+        endPhase(Phase::Write);
+
+        if (formatter) {
+            for (const Block& block : result.blocks) {
+                const bool canFormat = block.entryIndex != Block::NoEntry &&
+                    result.entries[block.entryIndex].entryType != Type::Unknown;
+                if (canFormat) {
+                    formatter->write(result.entries[block.entryIndex]);
+                }
+                else {
+                    formatter->writeVerbatim(block.text);
+                }
+            }
+            endPhase(Phase::Format);
+        }
+
+        // The next window can begin in the middle of a line
+        const size_t lastNewline = source.substr(0, end).rfind('\n');
+        const bool hasNewline = lastNewline != std::string_view::npos;
+        const size_t lineStart = hasNewline ? lastNewline + 1 : 0;
+        start.column = (hasNewline ? 1 : start.column) + std::count_if(
+            source.begin() + lineStart,
+            source.begin() + end,
+            [](char c) { return (static_cast<unsigned char>(c) & 0xC0) != 0x80; }
+        );
+        start.line += std::count(source.begin(), source.begin() + end, '\n');
+        start.offset += end;
+        isRecovering = result.isRecovering;
+        window.erase(0, end);
+    }
+
+    report += reportEnd(format);
+    std::fwrite(report.data(), 1, report.size(), diagnostics);
+    std::fflush(diagnostics);
+    endPhase(Phase::Write);
+
+    const bool isWritten = !buffer || buffer->flush();
+    if (buffer) {
+        endPhase(Phase::Format);
+    }
+    if (stats) {
+        stats->addFile(start.offset);
+    }
+    return !hasReadError && isWritten;
+}
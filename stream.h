@@ -0,0 +1,60 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___STREAM___H__
+#define __BIBTEXFORMAT___STREAM___H__
+
+#include "diagnostic.h"
+
+class RuleSet;
+class Statistics;
+
+#include <cstdio>
+#include <string_view>
+
+// Reads the input in fixed-size chunks and handles every entry as soon as it is complete:
+// its diagnostics are written to 'diagnostics' in the given format, where 'path' is the
+// name that is reported for the input, and, if 'output' is not nullptr, the
+// formatted entry is written to 'output'. Afterwards the entry is released, so the
+// memory use only depends on the chunk size and the size of the largest entry, not on the
+// size of the input. Entries that are still incomplete after 64 MB are treated as
+// unterminated. As the input is never seen as a whole, a macro has to be defined before
+// the entries that use it, like BibTeX requires. If 'stats' is not nullptr, the phases
+// and entries are recorded in it. The entries are checked against 'rules' if it is not
+// nullptr, see ParseOptions::rules. Returns false if reading or writing failed
+bool processStream(std::FILE* input, std::FILE* output, DiagnosticFormat format,
+                   std::string_view path, std::FILE* diagnostics, Statistics* stats,
+                   const RuleSet* rules = nullptr);
+
+#endif // __BIBTEXFORMAT___STREAM___H__
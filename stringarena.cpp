@@ -0,0 +1,74 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "stringarena.h"
+
+#include <algorithm>
+#include <cstring>
+
+std::string_view StringArena::store(std::string_view string) {
+    if (string.empty()) {
+        return std::string_view();
+    }
+    char* buffer = allocate(string.size());
+    std::memcpy(buffer, string.data(), string.size());
+    return std::string_view(buffer, string.size());
+}
+
+char* StringArena::allocate(size_t size) {
+    _size += size;
+    if (size > MaxBlockSize / 4) {
+        // Large strings get their own block so that they don't waste the rest of the
+        // current one. It is inserted before the current block to keep using that
+        std::unique_ptr<char[]> block(new char[size]);
+        char* result = block.get();
+        _blocks.insert(_blocks.end() - (_blocks.empty() ? 0 : 1), std::move(block));
+        return result;
+    }
+    if (_blockUsed + size > _blockSize) {
+        // Strings up to a quarter of the largest block size can be bigger than the next
+        // block would be
+        _blockSize = std::min(std::max(_blockSize * 2, MinBlockSize), MaxBlockSize);
+        _blockSize = std::max(_blockSize, size);
+        _blocks.emplace_back(new char[_blockSize]);
+        _blockUsed = 0;
+    }
+    char* result = _blocks.back().get() + _blockUsed;
+    _blockUsed += size;
+    return result;
+}
+
+size_t StringArena::size() const {
+    return _size;
+}
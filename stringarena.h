@@ -0,0 +1,71 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___STRINGARENA___H__
+#define __BIBTEXFORMAT___STRINGARENA___H__
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Owns the few strings that can't be represented as a view into the source file, for
+// example values whose line breaks had to be collapsed. Strings are packed into blocks
+// that are never reallocated, so the returned views stay valid until the arena is
+// destroyed. The blocks start small and grow, so that arenas that only ever hold a few
+// strings, such as the ones of a single entry, stay small as well
+class StringArena {
+public:
+    StringArena() = default;
+    StringArena(StringArena&&) = default;
+    StringArena& operator=(StringArena&&) = default;
+
+    std::string_view store(std::string_view string);
+
+    // Returns a writable buffer of 'size' bytes that lives as long as the arena
+    char* allocate(size_t size);
+
+    // Total number of bytes stored in the arena
+    size_t size() const;
+
+private:
+    static constexpr size_t MinBlockSize = 256;
+    static constexpr size_t MaxBlockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> _blocks;
+    size_t _blockSize = 0;
+    size_t _blockUsed = 0;
+    size_t _size = 0;
+};
+
+#endif // __BIBTEXFORMAT___STRINGARENA___H__
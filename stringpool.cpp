@@ -0,0 +1,148 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "stringpool.h"
+
+#include "hash.h"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+namespace {
+    int highestBit(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long bit;
+        _BitScanReverse64(&bit, value);
+        return static_cast<int>(bit);
+#else // ^^^^ _MSC_VER // !_MSC_VER vvvv
+        return 63 - __builtin_clzll(value);
+#endif // _MSC_VER
+    }
+
+    // The segment that holds the local index of a shard and the position in it
+    struct Slot {
+        int segment;
+        size_t offset;
+    };
+
+    template <int FirstSegmentBits>
+    Slot slotOf(uint32_t index) {
+        const uint64_t biased = uint64_t(index) + (uint64_t(1) << FirstSegmentBits);
+        const int bit = highestBit(biased);
+        return { bit - FirstSegmentBits, size_t(biased - (uint64_t(1) << bit)) };
+    }
+} // namespace
+
+uint32_t StringPool::intern(std::string_view string) {
+    const uint64_t hash = hash64(string);
+    const int shardIndex = static_cast<int>(hash >> 60);
+    static_assert(NumShards == 16, "The shard is taken from the top four bits");
+    Shard& shard = _shards[shardIndex];
+
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.ids.find(string);
+    if (it != shard.ids.end()) {
+        return it->second;
+    }
+
+    const uint32_t index = shard.size.load(std::memory_order_relaxed);
+    const Slot slot = slotOf<FirstSegmentBits>(index);
+    std::unique_ptr<std::string_view[]>& segment = shard.segments[slot.segment];
+    if (!segment) {
+        const size_t segmentSize = size_t(1) << (slot.segment + FirstSegmentBits);
+        segment.reset(new std::string_view[segmentSize]);
+    }
+    const std::string_view stored = shard.arena.store(string);
+    segment[slot.offset] = stored;
+    shard.size.store(index + 1, std::memory_order_release);
+
+    const uint32_t id = index * NumShards + static_cast<uint32_t>(shardIndex);
+    shard.ids.emplace(stored, id);
+    return id;
+}
+
+std::string_view StringPool::view(uint32_t id) const {
+    const Shard& shard = _shards[id % NumShards];
+    const Slot slot = slotOf<FirstSegmentBits>(id / NumShards);
+    return shard.segments[slot.segment][slot.offset];
+}
+
+size_t StringPool::size() const {
+    size_t size = 0;
+    for (const Shard& shard : _shards) {
+        size += shard.size.load(std::memory_order_acquire);
+    }
+    return size;
+}
+
+size_t StringPool::bytes() const {
+    size_t bytes = 0;
+    for (const Shard& shard : _shards) {
+        std::lock_guard lock(shard.mutex);
+        bytes += shard.arena.size();
+    }
+    return bytes;
+}
+
+uint32_t StringPool::idLimit() const {
+    uint32_t limit = 0;
+    for (const Shard& shard : _shards) {
+        limit = std::max(limit, shard.size.load(std::memory_order_acquire));
+    }
+    return limit * NumShards;
+}
+
+std::vector<uint32_t> StringPool::ranks() const {
+    std::vector<std::pair<std::string_view, uint32_t>> strings;
+    strings.reserve(size());
+    for (uint32_t shard = 0; shard < NumShards; ++shard) {
+        const uint32_t size = _shards[shard].size.load(std::memory_order_acquire);
+        for (uint32_t index = 0; index < size; ++index) {
+            const uint32_t id = index * NumShards + shard;
+            strings.emplace_back(view(id), id);
+        }
+    }
+    std::sort(strings.begin(), strings.end());
+
+    std::vector<uint32_t> ranks(idLimit(), 0);
+    for (size_t rank = 0; rank < strings.size(); ++rank) {
+        ranks[strings[rank].second] = static_cast<uint32_t>(rank);
+    }
+    return ranks;
+}
@@ -0,0 +1,99 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#ifndef __BIBTEXFORMAT___STRINGPOOL___H__
+#define __BIBTEXFORMAT___STRINGPOOL___H__
+
+#include "stringarena.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Interns strings that repeat across many entries, such as the names of journals, so
+// that every distinct string is stored once and is identified by a 32 bit id. Two
+// interned strings are equal if and only if their ids are equal. Several threads can
+// intern at the same time: the strings are distributed over shards by their hash and
+// only the shard of a string is locked. Neither the strings nor the table from ids to
+// strings is ever reallocated, so the view of an id can be read without a lock by any
+// thread that got the id
+class StringPool {
+public:
+    StringPool() = default;
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    // Returns the id of the string, which is added to the pool if it is not in it yet
+    uint32_t intern(std::string_view string);
+
+    std::string_view view(uint32_t id) const;
+
+    // Number of distinct strings in the pool
+    size_t size() const;
+
+    // Number of bytes of all distinct strings
+    size_t bytes() const;
+
+    // Ids are dense per shard, so all of them are smaller than this limit
+    uint32_t idLimit() const;
+
+    // The position of every string in the lexicographic order of all strings in the
+    // pool, indexed by id, so that strings can be sorted by comparing integers. Must not
+    // be called while other threads intern strings
+    std::vector<uint32_t> ranks() const;
+
+private:
+    static constexpr int NumShards = 16;
+    // Segment k holds 2^(k + FirstSegmentBits) views, so that 26 segments cover all ids
+    static constexpr int FirstSegmentBits = 6;
+    static constexpr int NumSegments = 26;
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string_view, uint32_t> ids;
+        StringArena arena;
+        std::array<std::unique_ptr<std::string_view[]>, NumSegments> segments;
+        std::atomic<uint32_t> size = 0;
+    };
+
+    std::array<Shard, NumShards> _shards;
+};
+
+#endif // __BIBTEXFORMAT___STRINGPOOL___H__
@@ -0,0 +1,590 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "structural.h"
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BIBTEXFORMAT_SSE2
+#include <immintrin.h>
+#endif // __SSE2__ || _M_X64 || _M_IX86_FP >= 2
+
+#if defined(BIBTEXFORMAT_SSE2) && (defined(__GNUC__) || defined(_MSC_VER))
+// The AVX2 version is compiled regardless of the target architecture and only called if
+// the processor supports it. MSVC allows the intrinsics everywhere, GCC and Clang need
+// them to be enabled per function
+#define BIBTEXFORMAT_AVX2
+#ifdef _MSC_VER
+#define BIBTEXFORMAT_TARGET_AVX2
+#else // ^^^^ _MSC_VER // !_MSC_VER vvvv
+#define BIBTEXFORMAT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif // _MSC_VER
+#endif // BIBTEXFORMAT_SSE2 && (__GNUC__ || _MSC_VER)
+
+namespace {
+    constexpr size_t BlockSize = 64;
+    // The last blocks of the TokenScanner that are shorter than this are not padded
+    constexpr ptrdiff_t ShortBlockSize = 16;
+
+    constexpr std::array<bool, 256> StructuralCharacters = []() {
+        std::array<bool, 256> table = {};
+        for (unsigned char c : { '{', '}', ')', '"', '@' }) {
+            table[c] = true;
+        }
+        return table;
+    }();
+
+    // Bit i of every mask belongs to byte i of the block
+    struct BlockMasks {
+        uint64_t structural = 0;
+        uint64_t openBraces = 0;
+        uint64_t closeBraces = 0;
+    };
+
+    // Bit i of every mask belongs to byte i of the block. The first three masks are only
+    // computed when they are asked for, as values are mostly skipped by their braces
+    struct TokenMasks {
+        uint64_t whitespace = 0;
+        // Whitespace, control characters, and " # % ' ( ) , = { } @, which is every byte
+        // that can't be part of an identifier in the lexer
+        uint64_t identifierEnds = 0;
+        uint64_t commas = 0;
+        uint64_t quotes = 0;
+        uint64_t openBraces = 0;
+        uint64_t closeBraces = 0;
+    };
+
+    // The masks of TokenMasks in which a byte is set, one bit per mask
+    enum TokenClass : uint8_t {
+        Whitespace = 1 << 0,
+        IdentifierEnd = 1 << 1,
+        Comma = 1 << 2,
+        Quote = 1 << 3,
+        OpenBrace = 1 << 4,
+        CloseBrace = 1 << 5
+    };
+
+    constexpr std::array<uint8_t, 256> TokenClasses = []() {
+        std::array<uint8_t, 256> table = {};
+        for (int c = 0; c <= ' '; ++c) {
+            table[c] = IdentifierEnd;
+        }
+        for (unsigned char c : { ' ', '\t', '\n', '\v', '\f', '\r' }) {
+            table[c] |= Whitespace;
+        }
+        for (unsigned char c : std::string_view("\"#%'(),={}@")) {
+            table[c] = IdentifierEnd;
+        }
+        table[','] |= Comma;
+        table['"'] |= Quote;
+        table['{'] |= OpenBrace;
+        table['}'] |= CloseBrace;
+        return table;
+    }();
+
+    BlockMasks classifyScalar(const char* block) {
+        BlockMasks masks;
+        for (size_t i = 0; i < BlockSize; ++i) {
+            const unsigned char c = static_cast<unsigned char>(block[i]);
+            masks.structural |= uint64_t(StructuralCharacters[c]) << i;
+            masks.openBraces |= uint64_t(c == '{') << i;
+            masks.closeBraces |= uint64_t(c == '}') << i;
+        }
+        return masks;
+    }
+
+    // Classifies the first 'size' bytes of the block and leaves the other bits empty. All
+    // masks are computed, as a table lookup finds all classes of a byte at once
+    TokenMasks classifyTokensPrefix(const char* block, size_t size) {
+        TokenMasks masks;
+        for (size_t i = 0; i < size; ++i) {
+            const uint8_t c = TokenClasses[static_cast<unsigned char>(block[i])];
+            if (c == 0) {
+                // Most bytes are part of identifiers or values and in no mask
+                continue;
+            }
+            const uint64_t bit = uint64_t(1) << i;
+            masks.whitespace |= (c & Whitespace) ? bit : 0;
+            masks.identifierEnds |= (c & IdentifierEnd) ? bit : 0;
+            masks.commas |= (c & Comma) ? bit : 0;
+            masks.quotes |= (c & Quote) ? bit : 0;
+            masks.openBraces |= (c & OpenBrace) ? bit : 0;
+            masks.closeBraces |= (c & CloseBrace) ? bit : 0;
+        }
+        return masks;
+    }
+
+    TokenMasks classifyTokensScalar(const char* block, bool) {
+        return classifyTokensPrefix(block, BlockSize);
+    }
+
+#ifdef BIBTEXFORMAT_SSE2
+    BlockMasks classifySse2(const char* block) {
+        const __m128i openBrace = _mm_set1_epi8('{');
+        const __m128i closeBrace = _mm_set1_epi8('}');
+        const __m128i closeParenthesis = _mm_set1_epi8(')');
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i at = _mm_set1_epi8('@');
+
+        BlockMasks masks;
+        for (size_t i = 0; i < BlockSize; i += 16) {
+            const __m128i bytes =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+            const __m128i opens = _mm_cmpeq_epi8(bytes, openBrace);
+            const __m128i closes = _mm_cmpeq_epi8(bytes, closeBrace);
+            const __m128i others = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_cmpeq_epi8(bytes, closeParenthesis),
+                    _mm_cmpeq_epi8(bytes, quote)
+                ),
+                _mm_cmpeq_epi8(bytes, at)
+            );
+            const __m128i all = _mm_or_si128(_mm_or_si128(opens, closes), others);
+            masks.structural |= uint64_t(uint32_t(_mm_movemask_epi8(all))) << i;
+            masks.openBraces |= uint64_t(uint32_t(_mm_movemask_epi8(opens))) << i;
+            masks.closeBraces |= uint64_t(uint32_t(_mm_movemask_epi8(closes))) << i;
+        }
+        return masks;
+    }
+
+    TokenMasks classifyTokensSse2(const char* block, bool withTokens) {
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        // \t \n \v \f \r are the 5 bytes from '\t' on
+        const __m128i controlWhitespace = _mm_set1_epi8('\r' - '\t');
+        const __m128i comma = _mm_set1_epi8(',');
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i openBrace = _mm_set1_epi8('{');
+        const __m128i closeBrace = _mm_set1_epi8('}');
+
+        TokenMasks masks;
+        for (size_t i = 0; i < BlockSize; i += 16) {
+            const __m128i bytes =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+            const __m128i quotes = _mm_cmpeq_epi8(bytes, quote);
+            const __m128i opens = _mm_cmpeq_epi8(bytes, openBrace);
+            const __m128i closes = _mm_cmpeq_epi8(bytes, closeBrace);
+            masks.quotes |= uint64_t(uint32_t(_mm_movemask_epi8(quotes))) << i;
+            masks.openBraces |= uint64_t(uint32_t(_mm_movemask_epi8(opens))) << i;
+            masks.closeBraces |= uint64_t(uint32_t(_mm_movemask_epi8(closes))) << i;
+            if (!withTokens) {
+                continue;
+            }
+
+            const __m128i fromTab = _mm_sub_epi8(bytes, tab);
+            const __m128i whitespace = _mm_or_si128(
+                _mm_cmpeq_epi8(bytes, space),
+                _mm_cmpeq_epi8(_mm_min_epu8(fromTab, controlWhitespace), fromTab)
+            );
+            // Unsigned bytes up to ' ', which includes all whitespace
+            const __m128i controls =
+                _mm_cmpeq_epi8(_mm_min_epu8(bytes, space), bytes);
+            const __m128i commas = _mm_cmpeq_epi8(bytes, comma);
+            __m128i ends = _mm_or_si128(
+                _mm_or_si128(controls, commas),
+                _mm_or_si128(quotes, _mm_or_si128(opens, closes))
+            );
+            for (char c : { '#', '%', '\'', '(', ')', '=', '@' }) {
+                ends = _mm_or_si128(ends, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+            }
+            masks.whitespace |= uint64_t(uint32_t(_mm_movemask_epi8(whitespace))) << i;
+            masks.identifierEnds |= uint64_t(uint32_t(_mm_movemask_epi8(ends))) << i;
+            masks.commas |= uint64_t(uint32_t(_mm_movemask_epi8(commas))) << i;
+        }
+        return masks;
+    }
+#endif // BIBTEXFORMAT_SSE2
+
+#ifdef BIBTEXFORMAT_AVX2
+    BIBTEXFORMAT_TARGET_AVX2 BlockMasks classifyAvx2(const char* block) {
+        const __m256i openBrace = _mm256_set1_epi8('{');
+        const __m256i closeBrace = _mm256_set1_epi8('}');
+        const __m256i closeParenthesis = _mm256_set1_epi8(')');
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i at = _mm256_set1_epi8('@');
+
+        BlockMasks masks;
+        for (size_t i = 0; i < BlockSize; i += 32) {
+            const __m256i bytes =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+            const __m256i opens = _mm256_cmpeq_epi8(bytes, openBrace);
+            const __m256i closes = _mm256_cmpeq_epi8(bytes, closeBrace);
+            const __m256i others = _mm256_or_si256(
+                _mm256_or_si256(
+                    _mm256_cmpeq_epi8(bytes, closeParenthesis),
+                    _mm256_cmpeq_epi8(bytes, quote)
+                ),
+                _mm256_cmpeq_epi8(bytes, at)
+            );
+            const __m256i all =
+                _mm256_or_si256(_mm256_or_si256(opens, closes), others);
+            masks.structural |= uint64_t(uint32_t(_mm256_movemask_epi8(all))) << i;
+            masks.openBraces |= uint64_t(uint32_t(_mm256_movemask_epi8(opens))) << i;
+            masks.closeBraces |= uint64_t(uint32_t(_mm256_movemask_epi8(closes))) << i;
+        }
+        return masks;
+    }
+
+    BIBTEXFORMAT_TARGET_AVX2 TokenMasks classifyTokensAvx2(const char* block,
+                                                           bool withTokens)
+    {
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i controlWhitespace = _mm256_set1_epi8('\r' - '\t');
+        const __m256i comma = _mm256_set1_epi8(',');
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i openBrace = _mm256_set1_epi8('{');
+        const __m256i closeBrace = _mm256_set1_epi8('}');
+
+        TokenMasks masks;
+        for (size_t i = 0; i < BlockSize; i += 32) {
+            const __m256i bytes =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+            const __m256i quotes = _mm256_cmpeq_epi8(bytes, quote);
+            const __m256i opens = _mm256_cmpeq_epi8(bytes, openBrace);
+            const __m256i closes = _mm256_cmpeq_epi8(bytes, closeBrace);
+            masks.quotes |= uint64_t(uint32_t(_mm256_movemask_epi8(quotes))) << i;
+            masks.openBraces |= uint64_t(uint32_t(_mm256_movemask_epi8(opens))) << i;
+            masks.closeBraces |= uint64_t(uint32_t(_mm256_movemask_epi8(closes))) << i;
+            if (!withTokens) {
+                continue;
+            }
+
+            const __m256i fromTab = _mm256_sub_epi8(bytes, tab);
+            const __m256i whitespace = _mm256_or_si256(
+                _mm256_cmpeq_epi8(bytes, space),
+                _mm256_cmpeq_epi8(_mm256_min_epu8(fromTab, controlWhitespace), fromTab)
+            );
+            const __m256i controls =
+                _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, space), bytes);
+            const __m256i commas = _mm256_cmpeq_epi8(bytes, comma);
+            __m256i ends = _mm256_or_si256(
+                _mm256_or_si256(controls, commas),
+                _mm256_or_si256(quotes, _mm256_or_si256(opens, closes))
+            );
+            for (char c : { '#', '%', '\'', '(', ')', '=', '@' }) {
+                const __m256i matches = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c));
+                ends = _mm256_or_si256(ends, matches);
+            }
+            masks.whitespace |= uint64_t(uint32_t(_mm256_movemask_epi8(whitespace))) << i;
+            masks.identifierEnds |= uint64_t(uint32_t(_mm256_movemask_epi8(ends))) << i;
+            masks.commas |= uint64_t(uint32_t(_mm256_movemask_epi8(commas))) << i;
+        }
+        return masks;
+    }
+
+    bool supportsAvx2() {
+#ifdef _MSC_VER
+        // AVX2 support of the processor and AVX state saving by the operating system
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuid(info, 1);
+        const bool hasXsave = (info[2] & (1 << 27)) != 0;
+        if (!hasXsave || (_xgetbv(0) & 0x6) != 0x6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else // ^^^^ _MSC_VER // !_MSC_VER vvvv
+        return __builtin_cpu_supports("avx2");
+#endif // _MSC_VER
+    }
+#endif // BIBTEXFORMAT_AVX2
+
+    using ClassifyFunction = BlockMasks(*)(const char*);
+    using ClassifyTokensFunction = TokenMasks(*)(const char*, bool);
+
+    int bitCount(uint64_t mask) {
+#ifdef _MSC_VER
+        return static_cast<int>(__popcnt64(mask));
+#else // ^^^^ _MSC_VER // !_MSC_VER vvvv
+        return __builtin_popcountll(mask);
+#endif // _MSC_VER
+    }
+
+    // Sets every bit from a set bit of 'mask' up to, but not including, the next one. For
+    // a mask of quotes, these are the bytes that are inside of a quoted string
+    uint64_t prefixXor(uint64_t mask) {
+        mask ^= mask << 1;
+        mask ^= mask << 2;
+        mask ^= mask << 4;
+        mask ^= mask << 8;
+        mask ^= mask << 16;
+        mask ^= mask << 32;
+        return mask;
+    }
+
+    ScanImplementation bestImplementation() {
+#ifdef BIBTEXFORMAT_AVX2
+        if (supportsAvx2()) {
+            return ScanImplementation::Avx2;
+        }
+#endif // BIBTEXFORMAT_AVX2
+#ifdef BIBTEXFORMAT_SSE2
+        return ScanImplementation::Sse2;
+#else // ^^^^ BIBTEXFORMAT_SSE2 // !BIBTEXFORMAT_SSE2 vvvv
+        return ScanImplementation::Scalar;
+#endif // BIBTEXFORMAT_SSE2
+    }
+
+    ClassifyFunction classifyFunction(ScanImplementation implementation) {
+        switch (implementation) {
+#ifdef BIBTEXFORMAT_AVX2
+            case ScanImplementation::Avx2:  return classifyAvx2;
+#endif // BIBTEXFORMAT_AVX2
+#ifdef BIBTEXFORMAT_SSE2
+            case ScanImplementation::Sse2:  return classifySse2;
+#endif // BIBTEXFORMAT_SSE2
+            default:                        return classifyScalar;
+        }
+    }
+
+    ClassifyTokensFunction classifyTokensFunction(ScanImplementation implementation) {
+        switch (implementation) {
+#ifdef BIBTEXFORMAT_AVX2
+            case ScanImplementation::Avx2:  return classifyTokensAvx2;
+#endif // BIBTEXFORMAT_AVX2
+#ifdef BIBTEXFORMAT_SSE2
+            case ScanImplementation::Sse2:  return classifyTokensSse2;
+#endif // BIBTEXFORMAT_SSE2
+            default:                        return classifyTokensScalar;
+        }
+    }
+
+    ScanImplementation CurrentImplementation = bestImplementation();
+    ClassifyFunction Classify = classifyFunction(CurrentImplementation);
+    ClassifyTokensFunction ClassifyTokens = classifyTokensFunction(CurrentImplementation);
+} // namespace
+
+std::string_view scanImplementationName(ScanImplementation implementation) {
+    switch (implementation) {
+        case ScanImplementation::Scalar:    return "scalar";
+        case ScanImplementation::Sse2:      return "sse2";
+        case ScanImplementation::Avx2:      return "avx2";
+        default:                            return "";
+    }
+}
+
+ScanImplementation scanImplementation() {
+    return CurrentImplementation;
+}
+
+bool setScanImplementation(ScanImplementation implementation) {
+    const bool isSupported =
+        implementation == ScanImplementation::Scalar ||
+#ifdef BIBTEXFORMAT_SSE2
+        implementation == ScanImplementation::Sse2 ||
+#endif // BIBTEXFORMAT_SSE2
+#ifdef BIBTEXFORMAT_AVX2
+        (implementation == ScanImplementation::Avx2 && supportsAvx2()) ||
+#endif // BIBTEXFORMAT_AVX2
+        false;
+    if (isSupported) {
+        CurrentImplementation = implementation;
+        Classify = classifyFunction(implementation);
+        ClassifyTokens = classifyTokensFunction(implementation);
+    }
+    return isSupported;
+}
+
+StructuralScanner::StructuralScanner(const char* begin, const char* end)
+    : _block(begin)
+    , _end(end)
+{
+    // The first block starts at 'begin' and does not have to be aligned to anything
+    if (_block < _end) {
+        classify();
+    }
+}
+
+bool StructuralScanner::advance() {
+    if (_end - _block <= static_cast<ptrdiff_t>(BlockSize)) {
+        return false;
+    }
+    _block += BlockSize;
+    classify();
+    return true;
+}
+
+int StructuralScanner::skipBraces(int depth) {
+    const uint64_t braces = _openBraces | _closeBraces;
+    if ((_mask & ~braces) != 0) {
+        return depth;
+    }
+    const int nCloses = bitCount(_mask & _closeBraces);
+    if (nCloses > depth) {
+        return depth;
+    }
+    depth += bitCount(_mask & _openBraces) - nCloses;
+    _mask = 0;
+    return depth;
+}
+
+void StructuralScanner::classify() {
+    BlockMasks masks;
+    if (_end - _block >= static_cast<ptrdiff_t>(BlockSize)) {
+        masks = Classify(_block);
+    }
+    else {
+        // The last block is padded with bytes that are not structural, as reading past
+        // the end of a mapped file can fault
+        char padded[BlockSize] = {};
+        std::memcpy(padded, _block, _end - _block);
+        masks = Classify(padded);
+    }
+    _mask = masks.structural;
+    _openBraces = masks.openBraces;
+    _closeBraces = masks.closeBraces;
+}
+
+TokenScanner::TokenScanner(const char* begin, const char* end)
+    : _begin(begin)
+    , _end(end)
+{}
+
+const char* TokenScanner::closingBrace(const char* open) {
+    int depth = 1;
+    const char* p = open + 1;
+    while (p < _end) {
+        load(p, false);
+        const uint64_t from = ~uint64_t(0) << (p - _block);
+        const uint64_t opens = _openBraces & from;
+        const uint64_t closes = _closeBraces & from;
+        const int nCloses = bitCount(closes);
+        if (nCloses < depth) {
+            // The depth can't reach zero in this block
+            depth += bitCount(opens) - nCloses;
+        }
+        else {
+            for (uint64_t braces = opens | closes; braces != 0; braces &= braces - 1) {
+                const uint64_t bit = braces & (~braces + 1);
+                depth += (bit & opens) ? 1 : -1;
+                if (depth == 0) {
+                    return _block + lowestBit(bit);
+                }
+            }
+        }
+        if (_end - _block <= BlockSize) {
+            break;
+        }
+        p = _block + BlockSize;
+    }
+    return nullptr;
+}
+
+const char* TokenScanner::closingQuote(const char* quote) {
+    // Braces inside of the value have to be balanced, but they may go below zero, and a
+    // quote only closes the value outside of them. As BibTeX has no other escapes, the
+    // first quote closes the value unless there is a brace in front of it
+    int depth = 0;
+    const char* p = quote + 1;
+    while (p < _end) {
+        load(p, false);
+        const uint64_t from = ~uint64_t(0) << (p - _block);
+        const uint64_t quotes = _quotes & from;
+        const uint64_t braces = (_openBraces | _closeBraces) & from;
+        if (depth == 0) {
+            // The prefix-XOR marks the quoted strings that start at the following
+            // quotes, so the bytes that are left are those of the value up to its end
+            // and those between later strings
+            const uint64_t outside = ~prefixXor(quotes) & from;
+            const uint64_t first = quotes & (~quotes + 1);
+            const uint64_t value = first != 0 ? outside & (first - 1) : outside;
+            if ((braces & value) == 0) {
+                if (first != 0) {
+                    return _block + lowestBit(first);
+                }
+                if (_end - _block <= BlockSize) {
+                    break;
+                }
+                p = _block + BlockSize;
+                continue;
+            }
+        }
+
+        for (uint64_t tokens = quotes | braces; tokens != 0; tokens &= tokens - 1) {
+            const uint64_t bit = tokens & (~tokens + 1);
+            if (bit & _openBraces) {
+                ++depth;
+            }
+            else if (bit & _closeBraces) {
+                --depth;
+            }
+            else if (depth <= 0) {
+                return _block + lowestBit(bit);
+            }
+        }
+        if (_end - _block <= BlockSize) {
+            break;
+        }
+        p = _block + BlockSize;
+    }
+    return nullptr;
+}
+
+void TokenScanner::classify(const char* p, bool withTokens) {
+    _block = _begin + (p - _begin) / BlockSize * BlockSize;
+    _hasTokens = withTokens;
+    TokenMasks masks;
+    if (_end - _block >= BlockSize) {
+        masks = ClassifyTokens(_block, withTokens);
+    }
+    else if (_end - _block < ShortBlockSize) {
+        // The last block is often all of a short body, such as a lone cite key, and these
+        // few bytes are classified faster one by one than by copying them into a padded
+        // block
+        masks = classifyTokensPrefix(_block, _end - _block);
+        _hasTokens = true;
+    }
+    else {
+        // Padded like the last block of the StructuralScanner. Zeros end identifiers, but
+        // no match is returned past the end
+        char padded[BlockSize] = {};
+        std::memcpy(padded, _block, _end - _block);
+        masks = ClassifyTokens(padded, withTokens);
+    }
+    _whitespace = masks.whitespace;
+    _identifierEnds = masks.identifierEnds;
+    _commas = masks.commas;
+    _quotes = masks.quotes;
+    _openBraces = masks.openBraces;
+    _closeBraces = masks.closeBraces;
+}
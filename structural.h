@@ -0,0 +1,212 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#ifndef __BIBTEXFORMAT___STRUCTURAL___H__
+#define __BIBTEXFORMAT___STRUCTURAL___H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+// Returns the index of the lowest set bit of 'mask', which must not be 0
+inline int lowestBit(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward64(&bit, mask);
+    return static_cast<int>(bit);
+#else // ^^^^ _MSC_VER // !_MSC_VER vvvv
+    return __builtin_ctzll(mask);
+#endif // _MSC_VER
+}
+
+// The ways in which 64 byte blocks can be classified. The fastest one that the processor
+// supports is picked when the program starts
+enum class ScanImplementation {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+std::string_view scanImplementationName(ScanImplementation implementation);
+
+ScanImplementation scanImplementation();
+
+// Switches to a different implementation, which is only useful to compare them. Returns
+// false if the processor does not support it
+bool setScanImplementation(ScanImplementation implementation);
+
+// Walks over the characters that can change the state of the lexer, which are
+// { } ) " and @, and skips everything else. The input is classified in blocks of 64
+// bytes into a bitmask of these characters, so the bytes in between are never looked at
+// one by one. Nothing is read outside of [begin, end)
+class StructuralScanner {
+public:
+    StructuralScanner(const char* begin, const char* end);
+
+    // Returns the next structural character or 'end' once there are no more
+    const char* next();
+
+    // Skips the rest of the current block at once if it contains no structural
+    // characters other than braces and at most 'depth' closing braces, so that none of
+    // them can take the depth below zero. Returns the depth after the skipped braces, or
+    // 'depth' if nothing was skipped
+    int skipBraces(int depth);
+
+private:
+    // Moves on to the next block. Returns false at the end of the input
+    bool advance();
+
+    // Computes the mask of the block that starts at '_block'
+    void classify();
+
+    const char* _block;
+    const char* _end;
+    // The structural characters of the current block that next() has not returned yet
+    uint64_t _mask = 0;
+    uint64_t _openBraces = 0;
+    uint64_t _closeBraces = 0;
+};
+
+// Finds the tokens of a body of an entry: runs of whitespace, identifiers, cite keys,
+// and the ends of braced and quoted values. The body is classified in blocks of 64 bytes
+// into bitmasks of whitespace, of the characters that end an identifier (which includes
+// ',' and '='), of commas, of quotes, and of braces. Each question is then answered with
+// a bit scan per block instead of a loop per byte. Only the block under the position
+// that is asked about is classified and kept, so the positions should mostly increase.
+// Nothing is read outside of [begin, end)
+class TokenScanner {
+public:
+    TokenScanner(const char* begin, const char* end);
+
+    // Returns the first byte at or after 'p' that is not whitespace, or 'end'
+    const char* skipWhitespace(const char* p);
+
+    // Returns the first byte at or after 'p' that can't be part of an identifier, or
+    // 'end'
+    const char* skipIdentifier(const char* p);
+
+    // Returns the first whitespace or ',' at or after 'p', which ends a cite key, or
+    // 'end'
+    const char* skipCiteKey(const char* p);
+
+    // Returns the '}' that closes the '{' at 'open', or nullptr if there is none
+    const char* closingBrace(const char* open);
+
+    // Returns the '"' that closes the quoted value that opens at 'quote', or nullptr if
+    // there is none. Quotes inside of braces don't close the value
+    const char* closingQuote(const char* quote);
+
+private:
+    static constexpr ptrdiff_t BlockSize = 64;
+
+    // Classifies the block that contains 'p' unless it is the current one. The masks of
+    // whitespace, identifier ends, and commas are only computed if 'withTokens' is true
+    void load(const char* p, bool withTokens);
+
+    // Computes the masks of the block that contains 'p'
+    void classify(const char* p, bool withTokens);
+
+    // Returns the first byte at or after 'p' whose bit is set in the mask that 'mask'
+    // computes for each block, or 'end'
+    template <typename Mask>
+    const char* find(const char* p, Mask mask);
+
+    const char* _begin;
+    const char* _end;
+    // The start of the classified block, which is a multiple of 64 bytes after '_begin'
+    const char* _block = nullptr;
+    bool _hasTokens = false;
+    uint64_t _whitespace = 0;
+    uint64_t _identifierEnds = 0;
+    uint64_t _commas = 0;
+    uint64_t _quotes = 0;
+    uint64_t _openBraces = 0;
+    uint64_t _closeBraces = 0;
+};
+
+inline const char* StructuralScanner::next() {
+    while (_mask == 0) {
+        if (!advance()) {
+            return _end;
+        }
+    }
+    const int bit = lowestBit(_mask);
+    // Clears the lowest set bit
+    _mask &= _mask - 1;
+    return _block + bit;
+}
+
+inline const char* TokenScanner::skipWhitespace(const char* p) {
+    return find(p, [](const TokenScanner& s) { return ~s._whitespace; });
+}
+
+inline const char* TokenScanner::skipIdentifier(const char* p) {
+    return find(p, [](const TokenScanner& s) { return s._identifierEnds; });
+}
+
+inline const char* TokenScanner::skipCiteKey(const char* p) {
+    return find(p, [](const TokenScanner& s) { return s._whitespace | s._commas; });
+}
+
+inline void TokenScanner::load(const char* p, bool withTokens) {
+    const bool isLoaded = _block != nullptr && p >= _block && p - _block < BlockSize;
+    if (!isLoaded || (withTokens && !_hasTokens)) {
+        classify(p, withTokens);
+    }
+}
+
+template <typename Mask>
+inline const char* TokenScanner::find(const char* p, Mask mask) {
+    while (p < _end) {
+        load(p, true);
+        const uint64_t bits = mask(*this) >> (p - _block);
+        if (bits != 0) {
+            // The padding after the end of the last block can match as well
+            const char* match = p + lowestBit(bits);
+            return match < _end ? match : _end;
+        }
+        if (_end - _block <= BlockSize) {
+            break;
+        }
+        p = _block + BlockSize;
+    }
+    return _end;
+}
+
+#endif // __BIBTEXFORMAT___STRUCTURAL___H__
@@ -0,0 +1,348 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+
+#include "formatter.h"
+#include "index.h"
+#include "macros.h"
+#include "outputbuffer.h"
+#include "parser.h"
+#include "sorting.h"
+#include "stringpool.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Checks the behavior of the library on small inputs for which it once did the wrong
+// thing. Every case is a separate test in ctest
+
+namespace {
+    bool check(bool condition, const char* expectation) {
+        if (!condition) {
+            std::printf("  Expected: %s\n", expectation);
+        }
+        return condition;
+    }
+
+    // Returns everything that 'write' writes into the OutputBuffer
+    template <typename Write>
+    std::string capture(Write write) {
+        std::FILE* file = std::tmpfile();
+        if (!file) {
+            std::cerr << "Could not create a temporary file\n";
+            std::exit(-1);
+        }
+        {
+            OutputBuffer output(file);
+            write(output);
+            output.flush();
+        }
+
+        std::string written;
+        std::rewind(file);
+        char buffer[4096];
+        while (size_t size = std::fread(buffer, 1, sizeof(buffer), file)) {
+            written.append(buffer, size);
+        }
+        std::fclose(file);
+        return written;
+    }
+
+    // Formats all blocks of the result like main does
+    std::string format(const ParseResult& result) {
+        return capture([&result](OutputBuffer& output) {
+            Formatter formatter(output);
+            for (const Block& block : result.blocks) {
+                if (block.entryIndex != Block::NoEntry) {
+                    formatter.write(result.entries[block.entryIndex]);
+                }
+                else {
+                    formatter.writeVerbatim(block.text);
+                }
+            }
+        });
+    }
+
+    bool hasDiagnostic(const ParseResult& result, Diagnostic::Kind kind,
+                       std::string_view message)
+    {
+        for (const Diagnostic& diagnostic : result.diagnostics) {
+            if (diagnostic.kind == kind && diagnostic.message == message) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // BibTeX uses the first of two fields with the same name and warns about the second
+    bool duplicateField() {
+        const std::string_view source =
+            "@misc{key,\n"
+            "  title = {First title},\n"
+            "  Title = {Second title}\n"
+            "}\n";
+        ParseResult result;
+        parse(source, 0, source.size(), false, ParseOptions(), result);
+
+        bool isCorrect = check(result.entries.size() == 1, "One entry");
+        if (!isCorrect) {
+            return false;
+        }
+        isCorrect &= check(result.entries[0][Keyword::Title] == "First title",
+                           "The first title is used");
+        isCorrect &= check(
+            hasDiagnostic(result, Diagnostic::Kind::DuplicateField, "Title"),
+            "A diagnostic for the second title"
+        );
+        const std::string formatted = format(result);
+        isCorrect &= check(
+            formatted.find("First title") < formatted.find("Second title") &&
+            formatted.find("Second title") != std::string::npos,
+            "Both titles are written, the first one first"
+        );
+        return isCorrect;
+    }
+
+    // The macros have to be collected from the same blocks that the parser finds, even if
+    // a block does not start at the beginning of a line
+    bool macrosOnOneLine() {
+        const std::string_view source =
+            "@string{aa = \"X\"} @string{bb = \"Y\"}\n"
+            "@misc{key,\n"
+            "  note = aa # bb\n"
+            "}\n";
+        MacroTable macros;
+        macros.collect(source);
+        ParseOptions options;
+        options.macros = &macros;
+        ParseResult result;
+        parse(source, 0, source.size(), false, options, result);
+
+        bool isCorrect = check(result.entries.size() == 1, "One entry");
+        if (!isCorrect) {
+            return false;
+        }
+        isCorrect &= check(
+            !hasDiagnostic(result, Diagnostic::Kind::UndefinedMacro, "bb"),
+            "No diagnostic for the second macro"
+        );
+        const Field* note = result.entries[0].field(Keyword::Note);
+        StringArena arena;
+        isCorrect &= check(note && macros.expand(*note, arena) == "XY",
+                           "Both macros are expanded");
+        return isCorrect;
+    }
+
+    // Venues of which some are spread over several lines or are macros
+    constexpr std::string_view VenueSource =
+        "@string{tvcg = \"IEEE TVCG\"}\n"
+        "@article{c, journal = {Journal B}, year = 2001}\n"
+        "@article{a, journal = {Journal\n    B}, year = 2000}\n"
+        "@inproceedings{d, booktitle = {Journal A}, year = 2005}\n"
+        "@misc{e, year = 1999}\n"
+        "@article{b, journal = tvcg, year = 2003}\n"
+        "@article{f, journal = {Journal B}, booktitle = {Other}, year = 2000}\n";
+
+    // Comparing the ranks of interned venues has to give the order of their bytes, which
+    // is what merging sorted files relies on
+    bool venueSort() {
+        const std::string_view source = VenueSource;
+        auto sort = [source](StringPool* venues) {
+            ParseOptions options;
+            options.venues = venues;
+            const std::vector<ParseResult> results = parseParallel(source, 2, options);
+            return capture([&results, venues](OutputBuffer& output) {
+                writeSorted(results, SortOrder::Venue, false, 2, output, venues);
+            });
+        };
+        StringPool venues;
+        const std::string byRank = sort(&venues);
+        const std::string byBytes = sort(nullptr);
+
+        bool isCorrect =
+            check(byRank == byBytes, "The same order with and without a pool");
+        std::vector<size_t> positions;
+        for (std::string_view key : { "{d,", "{a,", "{f,", "{c,", "{b,", "{e," }) {
+            positions.push_back(byRank.find(key));
+        }
+        isCorrect &= check(
+            std::is_sorted(positions.begin(), positions.end()) &&
+            positions.back() != std::string::npos,
+            "Sorted by venue, then by year, with the entry without a venue last"
+        );
+        return isCorrect;
+    }
+
+    // Adding the venues to the names of the index by their id must not change the index
+    bool indexVenues() {
+        const std::string_view source = VenueSource;
+        MacroTable macros;
+        macros.collect(source);
+        const SourceStamp stamp = { source.size(), 0, 0 };
+
+        StringPool venues;
+        ParseOptions options;
+        options.venues = &venues;
+        const std::string byId = buildIndex(
+            source,
+            parseParallel(source, 2, options),
+            stamp,
+            &macros,
+            &venues
+        );
+        const std::string byValue = buildIndex(
+            source,
+            parseParallel(source, 2, ParseOptions()),
+            stamp,
+            &macros
+        );
+
+        bool isCorrect = check(!byId.empty() && byId == byValue,
+                               "The same index with and without a pool");
+        BibIndex index;
+        IndexedEntry entry;
+        isCorrect &= check(index.open(byId) && index.find("a", entry) &&
+                           entry["journal"] == "Journal B",
+                           "A joined venue is found");
+        isCorrect &= check(index.find("b", entry) && entry["journal"] == "IEEE TVCG",
+                           "A venue macro is expanded");
+        return isCorrect;
+    }
+
+    // A group of alternatives without fields can't be satisfied and has to be rejected
+    // when the rules are loaded instead of reporting a missing field without a name
+    bool emptyAlternatives() {
+        const char* path = "empty-alternatives.json";
+        std::FILE* file = std::fopen(path, "wb");
+        if (!file) {
+            std::cerr << "Could not create " << path << '\n';
+            std::exit(-1);
+        }
+        std::fputs(
+            "{ \"rules\": [ { \"venues\": [ \"Journal A\" ], "
+            "\"types\": [ \"article\" ], \"alternatives\": [ [ \"doi\" ], [] ] } ] }",
+            file
+        );
+        std::fclose(file);
+
+        RuleSet rules;
+        const std::string error = rules.load(path);
+        std::remove(path);
+        return check(
+            error.find("Journal A") != std::string::npos &&
+            error.find(path) != std::string::npos,
+            "An error that names the venue and the rules file"
+        );
+    }
+
+    // Cite keys are case-insensitive in BibTeX, so the index has to find them in any case
+    bool indexCase() {
+        const std::string_view source =
+            "@misc{smith2020, title = {First}}\n"
+            "@misc{Smith2020, title = {Second}}\n";
+        const SourceStamp stamp = { source.size(), 0, 0 };
+        const std::string data = buildIndex(
+            source,
+            parseParallel(source, 1, ParseOptions()),
+            stamp
+        );
+
+        BibIndex index;
+        IndexedEntry entry;
+        bool isCorrect = check(index.open(data), "A valid index");
+        for (std::string_view key : { "smith2020", "Smith2020", "SMITH2020" }) {
+            isCorrect &= check(index.find(key, entry) && entry["title"] == "First",
+                               "The first entry is found with any case of the key");
+        }
+        isCorrect &= check(!index.find("smith2021", entry), "Other keys are not found");
+        return isCorrect;
+    }
+
+    struct Case {
+        std::string_view name;
+        bool (*run)();
+    };
+
+    constexpr Case Cases[] = {
+        { "duplicate-field", duplicateField },
+        { "macros-on-one-line", macrosOnOneLine },
+        { "venue-sort", venueSort },
+        { "index-venues", indexVenues },
+        { "empty-alternatives", emptyAlternatives },
+        { "index-case", indexCase }
+    };
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<const Case*> cases;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        const Case* match = nullptr;
+        if (arg == "--case" && i + 1 < argc) {
+            std::string_view name = argv[++i];
+            for (const Case& c : Cases) {
+                if (c.name == name) {
+                    match = &c;
+                }
+            }
+            if (!match) {
+                std::cerr << "Unknown case " << name << '\n';
+                return -1;
+            }
+            cases.push_back(match);
+        }
+        else {
+            std::cerr << "Usage: bibtex_tests [--case name]...\n";
+            return -1;
+        }
+    }
+    if (cases.empty()) {
+        for (const Case& c : Cases) {
+            cases.push_back(&c);
+        }
+    }
+
+    bool isCorrect = true;
+    for (const Case* c : cases) {
+        std::printf("%.*s\n", static_cast<int>(c->name.size()), c->name.data());
+        isCorrect &= c->run();
+    }
+    return isCorrect ? 0 : -1;
+}
@@ -0,0 +1,136 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "threadpool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int nThreads) {
+    if (nThreads == 0) {
+        nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    for (unsigned int i = 0; i < nThreads; ++i) {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+    for (unsigned int i = 0; i < nThreads; ++i) {
+        _threads.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard lock(_sleepMutex);
+        _isStopping = true;
+    }
+    _wakeUp.notify_all();
+    for (std::thread& thread : _threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    _nUnfinished++;
+
+    const size_t index = _nextWorker++ % _workers.size();
+    {
+        std::lock_guard lock(_workers[index]->mutex);
+        _workers[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Incrementing under the lock guarantees that a worker that is about to go to
+        // sleep either sees the new task or receives the notification
+        std::lock_guard lock(_sleepMutex);
+        _nQueued++;
+    }
+    _wakeUp.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock lock(_finishMutex);
+    _finished.wait(lock, [this]() { return _nUnfinished == 0; });
+}
+
+unsigned int ThreadPool::size() const {
+    return static_cast<unsigned int>(_threads.size());
+}
+
+void ThreadPool::work(size_t index) {
+    while (true) {
+        std::function<void()> task;
+        if (popTask(index, task)) {
+            task();
+
+            if (--_nUnfinished == 0) {
+                std::lock_guard lock(_finishMutex);
+                _finished.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock lock(_sleepMutex);
+        _wakeUp.wait(lock, [this]() { return _isStopping || _nQueued > 0; });
+        if (_isStopping && _nQueued <= 0) {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::popTask(size_t index, std::function<void()>& task) {
+    // Our own queue first, newest task first as its data is most likely still cached
+    {
+        Worker& worker = *_workers[index];
+        std::lock_guard lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            _nQueued--;
+            return true;
+        }
+    }
+
+    // Then steal the oldest task from someone else
+    for (size_t i = 1; i < _workers.size(); ++i) {
+        Worker& victim = *_workers[(index + i) % _workers.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            _nQueued--;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+# Scripted client for the language server mode of BibTexFormat.
+#
+# Opens a BibTeX file in the server, applies a sequence of random edits and checks after
+# every edit that the incrementally updated diagnostics are identical to those of a
+# freshly opened document with the same text, and that they are the diagnostics that the
+# command line reports for a file with that text. Prints the time each round trip took.
+#
+# Usage: lsp-client.py <BibTexFormat executable> <file> [number of edits] [seed]
+#                      [--rules file]
+
+import json
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import time
+
+
+class Client:
+    def __init__(self, executable, options):
+        self.process = subprocess.Popen(
+            [executable, "--lsp"] + options, stdin=subprocess.PIPE, stdout=subprocess.PIPE
+        )
+        self.next_id = 1
+
+    def send(self, method, params, is_request=False):
+        message = {"jsonrpc": "2.0", "method": method, "params": params}
+        if is_request:
+            message["id"] = self.next_id
+            self.next_id += 1
+        body = json.dumps(message).encode("utf-8")
+        header = "Content-Length: {}\r\n\r\n".format(len(body)).encode("ascii")
+        self.process.stdin.write(header + body)
+        self.process.stdin.flush()
+
+    def receive(self):
+        length = 0
+        while True:
+            line = self.process.stdout.readline().decode("ascii").strip()
+            if not line:
+                break
+            if line.startswith("Content-Length:"):
+                length = int(line[len("Content-Length:"):])
+        return json.loads(self.process.stdout.read(length).decode("utf-8"))
+
+    def diagnostics(self):
+        message = self.receive()
+        assert message["method"] == "textDocument/publishDiagnostics"
+        return message["params"]["diagnostics"]
+
+
+def position(text, offset):
+    line = text.count("\n", 0, offset)
+    line_start = text.rfind("\n", 0, offset) + 1
+    character = len(text[line_start:offset].encode("utf-16-le")) // 2
+    return {"line": line, "character": character}
+
+
+SNIPPETS = [
+    "@", "{", "}", ",", "\"", "=", "\n", " ", "x",
+    "\n@article{new,\n  author = {A},\n}\n",
+    "  note = {Something},\n",
+    "@misc{",
+]
+
+
+# The diagnostics of the command line for the text, in the form of the language server
+# without the end of the range, which only the server has
+def command_line_diagnostics(executable, options, text):
+    with tempfile.NamedTemporaryFile("wb", suffix=".bib", delete=False) as f:
+        f.write(text.encode("utf-8"))
+    try:
+        output = subprocess.run(
+            [executable, "--diagnostics=json"] + options + [f.name],
+            stdout=subprocess.PIPE
+        ).stdout
+    finally:
+        os.remove(f.name)
+
+    encoded = text.encode("utf-8")
+    diagnostics = []
+    for d in json.loads(output.decode("utf-8"))["diagnostics"]:
+        offset = len(encoded[:d["offset"]].decode("utf-8"))
+        severity = 2 if d["severity"] == "warning" else 1
+        diagnostics.append((position(text, offset), severity, d["message"]))
+    return diagnostics
+
+
+def comparable(diagnostics):
+    return [(d["range"]["start"], d["severity"], d["message"]) for d in diagnostics]
+
+
+def matches_command_line(executable, options, text, diagnostics, step):
+    expected = command_line_diagnostics(executable, options, text)
+    if comparable(diagnostics) == expected:
+        return True
+    print("Mismatch with the command line after {}".format(step))
+    print("Server:       {}".format(json.dumps(comparable(diagnostics))))
+    print("Command line: {}".format(json.dumps(expected)))
+    return False
+
+
+def random_edit(rng, text):
+    begin = rng.randrange(len(text) + 1)
+    end = min(len(text), begin + rng.choice([0, 0, 1, 5, 40]))
+    return begin, end, rng.choice(SNIPPETS) if rng.random() < 0.8 else ""
+
+
+def main():
+    args = sys.argv[1:]
+    # The options are passed to the server and the command line alike
+    options = []
+    if "--rules" in args:
+        i = args.index("--rules")
+        options = args[i:i + 2]
+        del args[i:i + 2]
+    if len(args) < 2 or len(options) == 1:
+        print("Usage: lsp-client.py <BibTexFormat executable> <file> [edits] [seed] "
+              "[--rules file]")
+        return 1
+
+    executable = args[0]
+    with open(args[1], encoding="utf-8") as f:
+        text = f.read()
+    edits = int(args[2]) if len(args) > 2 else 100
+    rng = random.Random(int(args[3]) if len(args) > 3 else 0)
+
+    client = Client(executable, options)
+    client.send("initialize", {"capabilities": {}}, is_request=True)
+    client.receive()
+    client.send("initialized", {})
+
+    start = time.perf_counter()
+    client.send("textDocument/didOpen", {"textDocument": {
+        "uri": "file:///edited.bib", "languageId": "bibtex", "version": 0, "text": text
+    }})
+    diagnostics = client.diagnostics()
+    print("Open: {} diagnostics in {:.1f} ms".format(
+        len(diagnostics), (time.perf_counter() - start) * 1000
+    ))
+    if not matches_command_line(executable, options, text, diagnostics, "opening"):
+        return 1
+
+    timings = []
+    for version in range(1, edits + 1):
+        begin, end, replacement = random_edit(rng, text)
+        change = {
+            "range": {"start": position(text, begin), "end": position(text, end)},
+            "text": replacement,
+        }
+        text = text[:begin] + replacement + text[end:]
+
+        start = time.perf_counter()
+        client.send("textDocument/didChange", {
+            "textDocument": {"uri": "file:///edited.bib", "version": version},
+            "contentChanges": [change],
+        })
+        incremental = client.diagnostics()
+        timings.append((time.perf_counter() - start) * 1000)
+
+        client.send("textDocument/didOpen", {"textDocument": {
+            "uri": "file:///reference.bib", "languageId": "bibtex", "version": 0,
+            "text": text
+        }})
+        reference = client.diagnostics()
+        if incremental != reference:
+            print("Mismatch after edit {}: {}".format(version, json.dumps(change)))
+            print("Incremental: {}".format(json.dumps(incremental)))
+            print("Reference:   {}".format(json.dumps(reference)))
+            return 1
+        if not matches_command_line(executable, options, text, incremental,
+                                    "edit {}".format(version)):
+            return 1
+
+    if timings:
+        timings.sort()
+        print("Edits: {}, median {:.2f} ms, max {:.2f} ms".format(
+            len(timings), timings[len(timings) // 2], timings[-1]
+        ))
+
+    client.send("shutdown", None, is_request=True)
+    client.receive()
+    client.send("exit", None)
+    return client.process.wait()
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,294 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#include "validation.h"
+
+#include "hash.h"
+#include "json.h"
+#include "mappedfile.h"
+#include "normalize.h"
+
+#include <string_view>
+
+namespace {
+    // Appends the missing fields of the rule to 'missing'
+    void reportMissing(const FieldRule& rule, KeywordMask filled,
+                       std::vector<std::string>& missing)
+    {
+        for (Keyword keyword : rule.required) {
+            if ((filled & maskOf(keyword)) == 0) {
+                missing.emplace_back(keywordName(keyword));
+            }
+        }
+        for (size_t i = 0; i < rule.nAlternatives; ++i) {
+            const KeywordList& group = rule.alternatives[i];
+            if ((filled & group.mask) != 0) {
+                continue;
+            }
+            std::string names;
+            for (Keyword keyword : group) {
+                names += names.empty() ? "" : " or ";
+                names += keywordName(keyword);
+            }
+            missing.push_back(std::move(names));
+        }
+    }
+
+    uint64_t hashRule(const FieldRule& rule, uint64_t hash) {
+        for (Keyword keyword : rule.required) {
+            hash = hash64(keywordName(keyword), hash);
+        }
+        for (size_t i = 0; i < rule.nAlternatives; ++i) {
+            hash = hash64("|", hash);
+            for (Keyword keyword : rule.alternatives[i]) {
+                hash = hash64(keywordName(keyword), hash);
+            }
+        }
+        return hash;
+    }
+
+    // Reads a list of field names. Returns false if any of them is not a known Keyword
+    bool readKeywords(const JsonValue* list, KeywordList& keywords, std::string& error) {
+        if (!list) {
+            return true;
+        }
+        if (list->type() != JsonValue::Type::Array) {
+            error = "Expected a list of field names";
+            return false;
+        }
+        for (const JsonValue& name : list->asArray()) {
+            const Keyword keyword = name.type() == JsonValue::Type::String ?
+                keywordFromString(name.asString()) :
+                Keyword::Unknown;
+            if (keyword == Keyword::Unknown) {
+                error = "Unknown field " +
+                    (name.type() == JsonValue::Type::String ? name.asString() : "");
+                return false;
+            }
+            keywords.add(keyword);
+        }
+        return true;
+    }
+} // namespace
+
+std::string RuleSet::load(const std::string& path) {
+    MappedFile file(path);
+    JsonValue root;
+    if (!file.isValid()) {
+        return "Could not open rules file " + path;
+    }
+    if (!JsonValue::parse(file.contents(), root)) {
+        return "The rules file " + path + " is not valid JSON";
+    }
+    const JsonValue* rules = root.find("rules");
+    if (!rules || rules->type() != JsonValue::Type::Array) {
+        return "The rules file " + path + " has no list of \"rules\"";
+    }
+
+    // The venues that were already looked up could be affected by the new rules
+    for (Shard& shard : _spellings) {
+        shard.indices.clear();
+    }
+
+    for (const JsonValue& rule : rules->asArray()) {
+        std::string error;
+        FieldRule fields;
+        if (!readKeywords(rule.find("required"), fields.required, error)) {
+            return error + " in the rules file " + path;
+        }
+        // An empty group could never be satisfied. It is reported with the name of a
+        // venue once the venues are read
+        bool hasEmptyGroup = false;
+        if (const JsonValue* groups = rule.find("alternatives")) {
+            const size_t nGroups =
+                groups->type() == JsonValue::Type::Array ? groups->asArray().size() : 0;
+            if (nGroups == 0 || nGroups > FieldRule::MaxAlternatives) {
+                return "Expected a list of up to " +
+                       std::to_string(FieldRule::MaxAlternatives) +
+                       " lists of alternatives in the rules file " + path;
+            }
+            for (const JsonValue& group : groups->asArray()) {
+                KeywordList& alternatives = fields.alternatives[fields.nAlternatives++];
+                if (!readKeywords(&group, alternatives, error)) {
+                    return error + " in the rules file " + path;
+                }
+                hasEmptyGroup |= alternatives.mask == 0;
+            }
+        }
+
+        // Without any types, the rule applies to all of them
+        std::vector<Type> ruleTypes;
+        if (const JsonValue* names = rule.find("types")) {
+            if (names->type() != JsonValue::Type::Array) {
+                return "Expected a list of types in the rules file " + path;
+            }
+            for (const JsonValue& name : names->asArray()) {
+                const Type type = name.type() == JsonValue::Type::String ?
+                    typeFromString(name.asString()) :
+                    Type::Unknown;
+                if (type == Type::Unknown) {
+                    return "Unknown type in the rules file " + path;
+                }
+                ruleTypes.push_back(type);
+            }
+        }
+        else {
+            for (int i = 0; i < NumTypes; ++i) {
+                ruleTypes.push_back(static_cast<Type>(i));
+            }
+        }
+
+        const JsonValue* venues = rule.find("venues");
+        if (!venues || venues->type() != JsonValue::Type::Array ||
+            venues->asArray().empty())
+        {
+            return "Every rule needs a list of \"venues\" in the rules file " + path;
+        }
+        for (const JsonValue& venue : venues->asArray()) {
+            if (venue.type() != JsonValue::Type::String) {
+                return "Expected the name of a venue in the rules file " + path;
+            }
+            if (hasEmptyGroup) {
+                return "Empty list of alternatives for " + venue.asString() +
+                       " in the rules file " + path;
+            }
+            const auto [it, isNew] =
+                _venues.emplace(foldText(venue.asString()), _venueRules.size());
+            if (isNew) {
+                _venueRules.emplace_back();
+            }
+
+            // Several rules for the same venue and type are combined into one
+            for (Type type : ruleTypes) {
+                FieldRule& combined = _venueRules[it->second][static_cast<int>(type)];
+                for (Keyword keyword : fields.required) {
+                    combined.required.add(keyword);
+                }
+                for (size_t i = 0; i < fields.nAlternatives; ++i) {
+                    if (combined.nAlternatives == FieldRule::MaxAlternatives) {
+                        return "Too many alternatives for one venue in the rules file " +
+                               path;
+                    }
+                    combined.alternatives[combined.nAlternatives++] =
+                        fields.alternatives[i];
+                }
+            }
+        }
+    }
+    return std::string();
+}
+
+std::vector<std::string> RuleSet::check(const Entry& entry) const {
+    if (entry.entryType == Type::Unknown) {
+        return {};
+    }
+    const FieldRule& rule = RequiredFields[static_cast<int>(entry.entryType)];
+    const KeywordMask filled = entry.filledKeywordMask();
+
+    const FieldRule* venueRule = nullptr;
+    if (!_venues.empty()) {
+        const std::string_view venue = entry.has(Keyword::Journal) ?
+            entry[Keyword::Journal] :
+            entry[Keyword::BookTitle];
+        const size_t index = venueIndex(venue);
+        if (index != NoVenue) {
+            venueRule = &_venueRules[index][static_cast<int>(entry.entryType)];
+        }
+    }
+
+    const bool isComplete =
+        rule.isSatisfied(filled) && (!venueRule || venueRule->isSatisfied(filled));
+    if (isComplete) {
+        return {};
+    }
+
+    std::vector<std::string> missing;
+    reportMissing(rule, filled, missing);
+    if (venueRule) {
+        // Fields that the venue requires as well are only reported once
+        const KeywordMask reported = ~filled & rule.required.mask;
+        reportMissing(*venueRule, filled | reported, missing);
+    }
+    return missing;
+}
+
+size_t RuleSet::venueIndex(std::string_view venue) const {
+    const uint64_t hash = hash64(venue);
+    static_assert(NumShards == 16, "The shard is taken from the top four bits");
+    Shard& shard = _spellings[static_cast<int>(hash >> 60)];
+
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.indices.find(venue);
+    if (it != shard.indices.end()) {
+        return it->second;
+    }
+    auto folded = _venues.find(foldText(venue));
+    const size_t index = folded != _venues.end() ? folded->second : NoVenue;
+    shard.indices.emplace(shard.arena.store(venue), index);
+    return index;
+}
+
+uint64_t RuleSet::fingerprint() const {
+    // The order of the map is not stable, so the venues are combined independent of it
+    uint64_t combined = 0;
+    for (const auto& [venue, index] : _venues) {
+        uint64_t hash = hash64(venue);
+        for (const FieldRule& rule : _venueRules[index]) {
+            hash = hashRule(rule, hash64("", hash));
+        }
+        combined += hash;
+    }
+    return combined;
+}
+
+std::vector<std::string> checkCompleteness(const Entry& entry, const RuleSet* rules) {
+    static const RuleSet Standard;
+    return (rules ? *rules : Standard).check(entry);
+}
+
+uint64_t rulesetFingerprint(const RuleSet* rules) {
+    // Bump this whenever the messages or the logic of the validation change in a way
+    // that is not visible in the tables
+    constexpr uint64_t Version = 3;
+
+    uint64_t hash = Version;
+    for (int i = 0; i < NumTypes; ++i) {
+        hash = hash64(typeName(static_cast<Type>(i)), hash);
+        for (Keyword keyword : AcceptedKeywords[i]) {
+            hash = hash64(keywordName(keyword), hash);
+        }
+        hash = hashRule(RequiredFields[i], hash);
+    }
+    return rules ? hash64(std::to_string(rules->fingerprint()), hash) : hash;
+}
@@ -0,0 +1,198 @@
+/*****************************************************************************************
+ *                                                                                       *
+ * BSD 3-Clause License                                                                  *
+ *                                                                                       *
+ * Copyright (c) 2018, Alexander Bock                                                    *
+ * All rights reserved.                                                                  *
+ *                                                                                       *
+ * Redistribution and use in source and binary forms, with or without modification, are  *
+ * permitted provided that the following conditions are met:                             *
+ *                                                                                       *
+ * Redistributions of source code must retain the above copyright notice, this list of   *
+ * conditions and the following disclaimer.                                              *
+ *                                                                                       *
+ * Redistributions in binary form must reproduce the above copyright noticem this list   *
+ * of conditions and the following disclaimer in the documentation and/or other          *
+ * materials provided with the distribution.                                             *
+ *                                                                                       *
+ * Neither the name of the copyright holder nor the names of its contributors may be     *
+ * used to endorse or promote products derived from this software without specific prior *
+ * written permission.                                                                   *
+ *                                                                                       *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY   *
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES  *
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT   *
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,        *
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED  *
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR    *
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN      *
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN    *
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+ * DAMAGE.                                                                               *
+ *                                                                                       *
+*****************************************************************************************/
+
+#ifndef __BIBTEXFORMAT___VALIDATION___H__
+#define __BIBTEXFORMAT___VALIDATION___H__
+
+#include "entry.h"
+#include "stringarena.h"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The fields that an entry has to have: all of the required ones and at least one of
+// every group of alternatives. A field with an empty value counts as missing. The
+// lists keep the order in which the missing fields are reported
+struct FieldRule {
+    static constexpr int MaxAlternatives = 4;
+
+    // No field is required
+    constexpr FieldRule() : FieldRule({}) {}
+
+    constexpr FieldRule(std::initializer_list<Keyword> requiredFields,
+                        std::initializer_list<KeywordList> alternativeGroups = {})
+        : required(requiredFields)
+    {
+        for (const KeywordList& group : alternativeGroups) {
+            alternatives[nAlternatives++] = group;
+        }
+    }
+
+    // Checking a rule is a few bitwise operations on the filled fields of an entry
+    constexpr bool isSatisfied(KeywordMask filled) const {
+        bool satisfied = (required.mask & ~filled) == 0;
+        for (size_t i = 0; i < nAlternatives; ++i) {
+            satisfied &= (alternatives[i].mask & filled) != 0;
+        }
+        return satisfied;
+    }
+
+    KeywordList required;
+    std::array<KeywordList, MaxAlternatives> alternatives = {};
+    size_t nAlternatives = 0;
+};
+
+// Indexed by Type
+inline constexpr std::array<FieldRule, NumTypes> RequiredFields = {{
+    // Type::Article
+    {
+        { Keyword::Author, Keyword::Title, Keyword::Journal, Keyword::Year,
+          Keyword::Volume }
+    },
+    // Type::Book
+    {
+        { Keyword::Title, Keyword::Publisher, Keyword::Year },
+        { { Keyword::Author, Keyword::Editor } }
+    },
+    // Type::Booklet
+    { { Keyword::Title } },
+    // Type::InBook
+    {
+        { Keyword::Title, Keyword::Publisher, Keyword::Year },
+        { { Keyword::Author, Keyword::Editor }, { Keyword::Chapter, Keyword::Pages } }
+    },
+    // Type::InCollection
+    {
+        { Keyword::Author, Keyword::Title, Keyword::BookTitle, Keyword::Publisher,
+          Keyword::Year }
+    },
+    // Type::InProceedings
+    { { Keyword::Author, Keyword::Title, Keyword::BookTitle, Keyword::Year } },
+    // Type::Manual
+    { { Keyword::Title } },
+    // Type::MastersThesis
+    { { Keyword::Author, Keyword::Title, Keyword::School, Keyword::Year } },
+    // Type::Misc
+    {},
+    // Type::PhDThesis
+    { { Keyword::Author, Keyword::Title, Keyword::School, Keyword::Year } },
+    // Type::Proceedings
+    { { Keyword::Title, Keyword::Year } },
+    // Type::TechReport
+    { { Keyword::Author, Keyword::Title, Keyword::Institution, Keyword::Year } },
+    // Type::Unpublished
+    { { Keyword::Author, Keyword::Title, Keyword::Note } }
+}};
+
+static_assert(!RequiredFields[static_cast<int>(Type::Book)].isSatisfied(
+    maskOf(Keyword::Title) | maskOf(Keyword::Publisher) | maskOf(Keyword::Year)
+));
+static_assert(RequiredFields[static_cast<int>(Type::Book)].isSatisfied(
+    maskOf(Keyword::Title) | maskOf(Keyword::Publisher) | maskOf(Keyword::Year) |
+    maskOf(Keyword::Editor)
+));
+
+// The rules that the entries are checked against. These are always the RequiredFields
+// of the types, and can be extended with rules for the entries of a venue, which are
+// loaded from a JSON file such as:
+//
+// { "rules": [
+//     { "venues": ["tvcg", "IEEE Transactions on Visualization and Computer Graphics"],
+//       "types": ["article"],
+//       "required": ["doi", "pages"],
+//       "alternatives": [["url", "doi"]] }
+// ] }
+//
+// The venue of an entry is its journal or, if it has none, its booktitle, which is
+// compared to the 'venues' after folding both, see foldText. A macro is compared by its
+// name. 'types' is optional and defaults to all types, as is 'alternatives'
+class RuleSet {
+public:
+    RuleSet() = default;
+    RuleSet(const RuleSet&) = delete;
+    RuleSet& operator=(const RuleSet&) = delete;
+
+    // Adds the rules of the file. Returns the reason for the failure or an empty string
+    // on success
+    std::string load(const std::string& path);
+
+    // Returns the names of the required fields that are missing in the entry, and 'a or
+    // b' for a group of alternatives of which none is present. Nothing is allocated for
+    // entries that are complete, apart from storing a venue the first time it is seen
+    std::vector<std::string> check(const Entry& entry) const;
+
+    // See rulesetFingerprint
+    uint64_t fingerprint() const;
+
+private:
+    static constexpr size_t NoVenue = std::numeric_limits<size_t>::max();
+    static constexpr int NumShards = 16;
+
+    // The index in _venueRules of the venue as it is written in an entry or NoVenue.
+    // Folding is the expensive part, so every distinct spelling is folded only once
+    size_t venueIndex(std::string_view venue) const;
+
+    // The combined rules of all venue rules that apply to a venue and type
+    std::vector<std::array<FieldRule, NumTypes>> _venueRules;
+    // From the folded venue to its index in _venueRules
+    std::unordered_map<std::string, size_t> _venues;
+
+    // From the spellings of the venues that have been checked to their index. check()
+    // is called by all threads of parseParallel, so the spellings are distributed over
+    // shards by their hash and only the shard of a spelling is locked
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string_view, size_t> indices;
+        StringArena arena;
+    };
+    mutable std::array<Shard, NumShards> _spellings;
+};
+
+// Returns the names of all required fields that are missing in the entry, see
+// RuleSet::check. Without 'rules', only the RequiredFields of the types are checked
+std::vector<std::string> checkCompleteness(const Entry& entry,
+                                           const RuleSet* rules = nullptr);
+
+// A hash that changes whenever the result of the validation for any entry could change.
+// It is derived from the rule tables themselves, so results that were stored for a
+// different set of rules can be detected
+uint64_t rulesetFingerprint(const RuleSet* rules = nullptr);
+
+#endif // __BIBTEXFORMAT___VALIDATION___H__